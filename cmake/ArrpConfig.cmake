@@ -26,6 +26,7 @@ function(arrp_to_jack name arrp_source)
       --interface jack
       --output ${name}
       --jack-name ${name}
+      ${ARGN}
     WORKING_DIRECTORY ${work_dir}
   )
 
@@ -98,6 +99,7 @@ function(arrp_to_pd name arrp_source)
       --interface puredata
       --pd-name ${name}
       --output ${name}
+      ${ARGN}
     WORKING_DIRECTORY ${work_dir}
   )
 
@@ -64,6 +64,14 @@ enum {
     infinite = -1
 };
 
+// Value of an array element.
+class element_value
+{
+public:
+    vector<int> index;
+    double value;
+};
+
 class array
 {
 public:
@@ -88,6 +96,17 @@ public:
     int last_period_access = 0;
     bool inter_period_dependency = true;
 #endif
+    // Arrays in the same storage group may share memory.
+    int storage_group = -1;
+    // Pipeline stage of first statement writing the array.
+    // Statements in later stages access it with a lag.
+    int pipeline_stage = 0;
+    // Values of all elements in row-major order, if computed
+    // during compilation (see constant_array_evaluator).
+    vector<double> constant_values;
+    // Values written by the prelude in order of writing, if computed
+    // during compilation (see prelude_evaluator).
+    vector<element_value> prelude_writes;
 };
 
 class statement
@@ -100,12 +119,16 @@ public:
     string name;
     isl::set domain;
     functional::expr_ptr expr = nullptr;
+    // Location of the source definition computed by the statement.
+    location_type location;
     isl::map self_relations { nullptr };
     vector<shared_ptr<array_access>> array_accesses;
     unordered_map<array*, int> array_access_offset;
     bool streaming_needs_modulo = false;
     bool is_infinite = false;
     bool is_input_or_output = false;
+    // Executes period (n - pipeline_stage) in n-th period.
+    int pipeline_stage = 0;
 };
 
 class array_access : public functional::expression
@@ -158,6 +181,70 @@ public:
     expr_ptr value;
 };
 
+// Accumulation of values along one dimension of an array
+// using an associative operation:
+//   s[i,0] = a[i,0];
+//   s[i,k] = s[i,k-1] + a[i,k];
+// Unless a scan, only the last element along the accumulated dimension
+// is read by other statements.
+// Dimensions refer to domains of statements,
+// which are the same as dimensions of the array.
+
+class reduction
+{
+public:
+    array_ptr accumulator;
+    // Writes the first element along the reduction dimension.
+    stmt_ptr init;
+    // Accumulates the remaining elements.
+    stmt_ptr update;
+    // Combines the previous element with a new value.
+    primitive_op op = primitive_op::add;
+
+    int reduction_dim = -1;
+    // Remaining dimensions, fixed for each execution of a kernel.
+    vector<int> batch_dims;
+
+    // Inclusive bounds.
+    int reduction_begin = 0;
+    int reduction_end = 0;
+};
+
+// Accumulation of products, such as a matrix product:
+//   s[i,j,0] = a[i,0] * b[0,j];
+//   s[i,j,k] = s[i,j,k-1] + a[i,k] * b[k,j];
+
+class contraction : public reduction
+{
+public:
+    // Dimension indexing only the left or right factor, or -1.
+    // Not included in batch dimensions.
+    int row_dim = -1;
+    int col_dim = -1;
+
+    // Inclusive bounds.
+    int row_begin = 0;
+    int row_end = 0;
+    int col_begin = 0;
+    int col_end = 0;
+};
+
+// First-order linear recurrence with constant coefficient:
+//   s[..., k] = a * s[..., k-1] + u
+
+class linear_recurrence
+{
+public:
+    array_ptr array;
+    stmt_ptr update;
+    // Dimension k.
+    int dim = -1;
+    double coefficient = 0;
+    // Expressions s[..., k-1] and u.
+    expr_ptr previous;
+    expr_ptr input;
+};
+
 class io_channel
 {
 public:
@@ -166,6 +253,15 @@ public:
     array_ptr array;
     stmt_ptr statement;
     int latency = 0;
+
+    // Range of statement instances in prelude and period.
+    // Only computed for streams with block I/O.
+    int prelude_offset = 0;
+    int prelude_count = 0;
+    int period_offset = 0;
+    int period_count = 0;
+    // One past the last array element accessed in prelude.
+    int prelude_access_end = 0;
 };
 
 class model
@@ -176,10 +272,22 @@ public:
     vector<stmt_ptr> statements;
     vector<io_channel> inputs;
     vector<io_channel> outputs;
+    // Computed by kernels rather than scheduled loop nests.
+    vector<contraction> contractions;
+    vector<reduction> reductions;
+    // Reductions of which all elements are read.
+    vector<reduction> scans;
+    // Computed in blocks by vectorized loops.
+    vector<linear_recurrence> recurrences;
     unordered_map<string, array_ptr> phase_ids;
     isl::union_map parallel_accesses { nullptr };
 
     isl::union_map clock_relations { nullptr };
+
+    int pipeline_stage_count = 1;
+
+    // Prelude is computed during compilation (see prelude_evaluator).
+    bool prelude_is_computed = false;
 };
 
 class model_summary
@@ -276,6 +384,8 @@ public:
         full = isl_ast_node_copy(other.full);
         prelude = isl_ast_node_copy(other.prelude);
         period = isl_ast_node_copy(other.period);
+        for (auto stage : other.period_stages)
+            period_stages.push_back(isl_ast_node_copy(stage));
     }
 
     ~ast_isl()
@@ -283,6 +393,8 @@ public:
         isl_ast_node_free(full);
         isl_ast_node_free(prelude);
         isl_ast_node_free(period);
+        for (auto stage : period_stages)
+            isl_ast_node_free(stage);
     }
 
     ast_isl & operator=(const ast_isl & other)
@@ -290,12 +402,17 @@ public:
         full = isl_ast_node_copy(other.full);
         prelude = isl_ast_node_copy(other.prelude);
         period = isl_ast_node_copy(other.period);
+        period_stages.clear();
+        for (auto stage : other.period_stages)
+            period_stages.push_back(isl_ast_node_copy(stage));
         return *this;
     }
 
     isl_ast_node * full = nullptr;
     isl_ast_node * prelude = nullptr;
     isl_ast_node * period = nullptr;
+    // Period of each pipeline stage, if more than one.
+    vector<isl_ast_node*> period_stages;
 };
 
 struct ast_node_info
@@ -303,6 +420,17 @@ struct ast_node_info
     bool is_parallelizable = false;
     bool is_parallel = false;
     bool is_vector = false;
+    // Contraction, reduction or scan computed entirely by the loop, or -1.
+    int contraction = -1;
+    int reduction = -1;
+    int scan = -1;
+    // Deepest loop computing only a linear recurrence.
+    bool is_recurrence = false;
+    // Call expression with arguments equal to batch dimensions
+    // of the contraction, reduction or scan.
+    isl_ast_expr * kernel_batch = nullptr;
+
+    ~ast_node_info() { isl_ast_expr_free(kernel_batch); }
 
     static ast_node_info * get_from_id(isl_id * id)
     {
@@ -38,8 +38,11 @@ along with this program; if not, write to the Free Software Foundation, Inc.,
 #include "../frontend/ph_model_gen.hpp"
 #include "../polyhedral/scheduling.hpp"
 #include "../polyhedral/storage_alloc.hpp"
-//#include "../polyhedral/modulo_avoidance.hpp"
+#include "../polyhedral/pipelining.hpp"
+#include "../polyhedral/modulo_avoidance.hpp"
 #include "../polyhedral/isl_ast_gen.hpp"
+#include "../polyhedral/reduction.hpp"
+#include "../polyhedral/constant_arrays.hpp"
 #include "../cpp/cpp_target.hpp"
 #include "report.hpp"
 #include "../interface/raw/generator.h"
@@ -64,6 +67,7 @@ namespace stream {
 namespace compiler {
 
 void compute_io_latencies(polyhedral::model & ph_model, polyhedral::schedule & schedule);
+void compute_io_ranges(polyhedral::model & ph_model, polyhedral::schedule & schedule);
 void report_io(const polyhedral::model & ph_model);
 
 result::code compile(const options & opts)
@@ -286,9 +290,13 @@ result::code compile_module
 
             polyhedral::model ph_model;
 
+            // Pipeline stages are executed by other threads,
+            // so streams are transferred in blocks between periods instead.
+            bool block_io = opts.block_io || opts.zero_copy_io || opts.pipeline_stages > 1;
+
             {
                 functional::polyhedral_gen::options ph_opts;
-                ph_opts.atomic_io = opts.atomic_io;
+                ph_opts.atomic_io = opts.atomic_io && !block_io;
                 ph_opts.ordered_io = opts.ordered_io;
 
                 functional::polyhedral_gen gen(ph_opts);
@@ -319,11 +327,64 @@ result::code compile_module
                 }
             }
 
-            if (opts.clocked_io)
+            if (opts.constant_tables)
+            {
+                // Larger tables would make generated code very large.
+                const int max_table_size = 64 * 1024;
+
+                polyhedral::constant_array_evaluator evaluator(ph_model);
+                evaluator.process(max_table_size);
+            }
+
+            // Blocks are transferred between periods, so hosts
+            // synchronize streams at block boundaries instead of a clock.
+            if (opts.clocked_io && !block_io)
             {
                 functional::add_io_clock(ph_model);
             }
 
+            {
+                polyhedral::reduction_finder finder(ph_model);
+                if (opts.contraction_kernels)
+                    finder.find_contractions();
+                if (opts.reassociate_reductions)
+                {
+                    finder.find_reductions();
+                    if (opts.parallel)
+                        finder.find_scans();
+                    if (opts.vectorize)
+                        finder.find_linear_recurrences();
+                }
+            }
+
+            {
+                vector<polyhedral::reduction> reassociated = ph_model.reductions;
+                reassociated.insert(reassociated.end(),
+                                    ph_model.scans.begin(), ph_model.scans.end());
+
+                for (auto & r : reassociated)
+                {
+                    if (is_real(r.accumulator->type) &&
+                            (r.op == primitive_op::add || r.op == primitive_op::multiply))
+                    {
+                        cerr << "Warning: '" << r.accumulator->name << "'"
+                             << " may be computed in a different order."
+                             << " Results may differ due to rounding."
+                             << endl;
+                        arrp::report()["reassociated_reductions"].push_back(r.accumulator->name);
+                    }
+                }
+
+                for (auto & r : ph_model.recurrences)
+                {
+                    cerr << "Warning: '" << r.array->name << "'"
+                         << " may be computed in a different order."
+                         << " Results may differ due to rounding."
+                         << endl;
+                    arrp::report()["reassociated_reductions"].push_back(r.array->name);
+                }
+            }
+
             // Compute polyhedral schedule
 
             polyhedral::schedule schedule(ph_model.context);
@@ -342,17 +403,81 @@ result::code compile_module
                 schedule = poly_scheduler.schedule(sched_opts);
             }
 
+            if (opts.batch < 1)
+                throw error("Batch must have at least one lane.");
+
+            if (opts.batch > 1)
+            {
+                // These access buffers assuming a single value per element.
+                if (opts.vectorize)
+                    throw error("Batch is not supported with vectorization.");
+                if (opts.contraction_kernels || opts.reassociate_reductions)
+                    throw error("Batch is not supported with contraction and reduction kernels.");
+                if (opts.pipeline_stages > 1)
+                    throw error("Batch is not supported with pipelining.");
+                if (block_io)
+                    throw error("Batch is not supported with block I/O.");
+                if (opts.buffer_data_shifting)
+                    throw error("Batch is not supported with data shifting.");
+                if (opts.storage == storage_type::mirrored)
+                    throw error("Batch is not supported with mirrored storage.");
+                if (opts.complex != complex_type::standard)
+                    throw error("Batch is not supported with split complex storage.");
+                if (opts.prelude_image)
+                    throw error("Batch is not supported with prelude image.");
+            }
+
+            if (opts.instrument)
+            {
+                // Counters are not shared by threads, and statements
+                // in vectorized loops and kernels are not counted.
+                if (opts.parallel)
+                    throw error("Instrumentation is not supported with parallelization.");
+                if (opts.vectorize)
+                    throw error("Instrumentation is not supported with vectorization.");
+                if (opts.contraction_kernels || opts.reassociate_reductions)
+                    throw error("Instrumentation is not supported with contraction and reduction kernels.");
+            }
+
+            if (opts.storage == storage_type::mirrored)
+            {
+                if (opts.buffer_data_shifting)
+                    throw error("Mirrored storage is not supported with data shifting.");
+                if (opts.split_statements)
+                    throw error("Mirrored storage is not supported with modulo avoidance by splitting.");
+                if (opts.pipeline_stages > 1)
+                    throw error("Mirrored storage is not supported with pipelining.");
+            }
+
+            // Partition period into pipeline stages
+
+            if (opts.pipeline_stages > 1)
+            {
+                if (opts.buffer_data_shifting)
+                    throw error("Pipelining is not supported with data shifting.");
+                // The host would access buffers while stages are still filling.
+                if (opts.zero_copy_io)
+                    throw error("Pipelining is not supported with zero-copy I/O.");
+
+                polyhedral::pipeline_partitioner partitioner(ph_model);
+                int stage_count = partitioner.partition(schedule, opts.pipeline_stages);
+
+                arrp::report()["pipeline"]["stages"] = stage_count;
+                arrp::report()["pipeline"]["latency_periods"] = stage_count - 1;
+            }
+
             // Generate AST for schedule
 
             polyhedral::ast_isl ast;
 
-            {
-                polyhedral::ast_gen::options ast_opts;
-                ast_opts.separate_loops = opts.separate_loops;
-                ast_opts.parallel = opts.parallel;
-                ast_opts.parallel_dim = opts.parallel_dim;
-                ast_opts.vectorize = opts.vectorize;
+            polyhedral::ast_gen::options ast_opts;
+            ast_opts.separate_loops = opts.separate_loops;
+            ast_opts.parallel = opts.parallel;
+            ast_opts.parallel_dim = opts.parallel_dim;
+            ast_opts.prelude_parallel_dim = opts.prelude_parallel_dim;
+            ast_opts.vectorize = opts.vectorize;
 
+            {
                 polyhedral::ast_gen ast_gen(ph_model, schedule, ast_opts);
 
                 ast = ast_gen.generate();
@@ -363,13 +488,40 @@ result::code compile_module
             polyhedral::storage_allocator storage_alloc( ph_model, opts.classic_storage_allocation );
             storage_alloc.allocate(schedule);
 
+            if (opts.share_storage)
+            {
+                // Concurrent accesses to different arrays are not ordered by schedule.
+                if (opts.parallel)
+                    throw error("Storage sharing is not supported with parallelization.");
+                if (ph_model.pipeline_stage_count > 1)
+                    throw error("Storage sharing is not supported with pipelining.");
+
+                storage_alloc.share_storage(schedule);
+            }
+
             compute_io_latencies(ph_model, schedule);
 
+            if (block_io)
+                compute_io_ranges(ph_model, schedule);
+
             // Modulo avoidance
 
+            if (opts.split_statements)
             {
-                // FIXME: It's broken and incomplete
-                //avoid_modulo(schedule, ph_model, opts.split_statements);
+                if (opts.buffer_data_shifting)
+                    throw error("Modulo avoidance by splitting is not supported with data shifting.");
+                if (ph_model.pipeline_stage_count > 1)
+                    throw error("Modulo avoidance by splitting is not supported with pipelining.");
+
+                polyhedral::modulo_avoidance mod_avoid
+                        (ph_model, schedule, opts.data_size_power_of_two);
+                mod_avoid.process();
+
+                // Storage is already allocated, so only the AST changes.
+
+                polyhedral::ast_gen ast_gen(ph_model, schedule, ast_opts);
+
+                ast = ast_gen.generate();
             }
 
             if (verbose<polyhedral::ast_isl>::enabled())
@@ -393,6 +545,21 @@ result::code compile_module
                 }
             }
 
+            if (opts.prelude_image)
+            {
+                if (ph_model.pipeline_stage_count > 1)
+                    throw error("Prelude image is not supported with pipelining.");
+
+                const int max_instance_count = 1024 * 1024;
+
+                polyhedral::prelude_evaluator evaluator(ph_model, schedule);
+                if (!evaluator.process(max_instance_count))
+                {
+                    cerr << "Warning: Prelude could not be computed during compilation."
+                         << endl;
+                }
+            }
+
             report_io(ph_model);
 
             string output_filename_base = opts.output_filename_base;
@@ -543,7 +710,10 @@ void compute_io_latencies(polyhedral::model & ph_model, polyhedral::schedule & s
             {
                 in.latency = max_latency.integer();
 
-                report[in.name] = max_latency.integer();
+                // Outputs of a pipeline lag behind by a period per stage.
+                in.latency += (ph_model.pipeline_stage_count - 1) * in.array->period;
+
+                report[in.name] = in.latency;
             }
             else
             {
@@ -556,6 +726,69 @@ void compute_io_latencies(polyhedral::model & ph_model, polyhedral::schedule & s
         arrp::report()["latencies"] = report;
 }
 
+void compute_io_ranges(polyhedral::model & ph_model, polyhedral::schedule & schedule)
+{
+    polyhedral::model_summary summary(ph_model);
+
+    auto compute_range = [&](const polyhedral::io_channel & channel,
+            const isl::union_map & sched, int & offset, int & count)
+    {
+        auto stmt = channel.statement;
+
+        auto domain = sched.in_domain(stmt->domain).domain()
+                .set_for(stmt->domain.get_space());
+
+        if (domain.is_empty())
+        {
+            offset = 0;
+            count = 0;
+            return;
+        }
+
+        auto i = domain.get_space().var(0);
+        offset = domain.minimum(i).integer();
+        count = domain.maximum(i).integer() - offset + 1;
+    };
+
+    auto compute = [&](polyhedral::io_channel & channel)
+    {
+        if (!channel.statement->is_infinite)
+            return;
+
+        compute_range(channel, schedule.prelude,
+                      channel.prelude_offset, channel.prelude_count);
+        compute_range(channel, schedule.period,
+                      channel.period_offset, channel.period_count);
+
+        // Each period must transfer a contiguous range of elements.
+        if (channel.period_count != channel.array->period)
+            throw error("Could not compute block I/O for channel " + channel.name);
+
+        auto array = channel.array;
+
+        auto accessed_in_prelude =
+                (summary.read_relations | summary.write_relations)
+                (schedule.prelude.domain())
+                .set_for(array->domain.get_space())
+                & array->domain;
+
+        if (accessed_in_prelude.is_empty())
+        {
+            channel.prelude_access_end = 0;
+        }
+        else
+        {
+            auto i0 = array->domain.get_space().var(0);
+            channel.prelude_access_end = accessed_in_prelude.maximum(i0).integer() + 1;
+        }
+    };
+
+    for (auto & in : ph_model.inputs)
+        compute(in);
+    for (auto & out : ph_model.outputs)
+        compute(out);
+}
+
 arrp::json io_channel_report(const polyhedral::io_channel & channel)
 {
     // FIXME: Input order does not correspond to Arrp source.
@@ -31,10 +31,13 @@ along with this program; if not, write to the Free Software Foundation, Inc.,
 #include "../frontend/array_inflate.hpp"
 #include "../frontend/array_transpose.hpp"
 #include "../frontend/ph_model_gen.hpp"
-//#include "../polyhedral/modulo_avoidance.hpp"
+#include "../polyhedral/modulo_avoidance.hpp"
 #include "../polyhedral/scheduling.hpp"
 #include "../polyhedral/isl_ast_gen.hpp"
 #include "../polyhedral/storage_alloc.hpp"
+#include "../polyhedral/pipelining.hpp"
+#include "../polyhedral/reduction.hpp"
+#include "../polyhedral/constant_arrays.hpp"
 #include "../cpp/cpp_target.hpp"
 #include "../interface/raw/generator.h"
 // version.hpp generated by CMake
@@ -256,6 +259,39 @@ int main(int argc, char *argv[])
                     new switch_option(&opt.parallel, true));
     args.add_option({"parallel-dim", "", "<dim>", "Parallelize exclusively dimension <dim> of period, if possible."},
                     new int_option(&opt.parallel_dim));
+    args.add_option({"prelude-parallel-dim", "", "<dim>", "Parallelize exclusively dimension <dim> of prelude, if possible."},
+                    new int_option(&opt.prelude_parallel_dim));
+    args.add_option({"parallel-runtime", "", "<name>",
+                     "Runtime for parallel code: openmp (default), pool."
+                     " The pool runtime uses a thread pool owned by the program."},
+                    new enum_option<parallel_runtime_type>(opt.parallel_runtime, {
+                        {"openmp", parallel_runtime_type::openmp},
+                        {"pool", parallel_runtime_type::pool}
+                    }));
+    args.add_option({"no-thread-pinning", "", "",
+                     "Do not pin threads of the pool runtime or pipeline stages"
+                     " to CPUs. By default, each thread is pinned to one of the CPUs"
+                     " the process may run on."},
+                    new switch_option(&opt.pin_threads, false));
+    args.add_option({"pipeline", "", "<stages>",
+                     "Split period into at most <stages> pipeline stages"
+                     " executing concurrently, at the cost of a latency"
+                     " of one period per stage. Implies --io-block."},
+                    new int_option(&opt.pipeline_stages));
+    args.add_option({"batch", "", "<lanes>",
+                     "Generate program_batch, which computes <lanes> independent"
+                     " program instances in lockstep. Each buffer element holds"
+                     " a value per instance in an innermost dimension,"
+                     " and each statement is computed for all instances by a SIMD loop."},
+                    new int_option(&opt.batch));
+    args.add_option({"instrument", "", "",
+                     "Measure time and count instances of each statement."
+                     " The program's profile() maps them to source locations."},
+                    new switch_option(&opt.instrument, true));
+    args.add_option({"stats", "", "",
+                     "Record durations of periods and misses of a time budget."
+                     " The program's stats() provides them."},
+                    new switch_option(&opt.period_stats, true));
     args.add_option({"vector", "", "", "Generate explicitly vectorized code, if possible."},
                     new switch_option(&opt.vectorize, true));
 
@@ -267,18 +303,123 @@ int main(int argc, char *argv[])
                     new switch_option(&opt.data_size_power_of_two, false));
     args.add_option({"avoid-modulo-datashift", "", "", "Avoid modulo by shifting data in buffers."},
                     new switch_option(&opt.buffer_data_shifting, true));
+    args.add_option({"storage", "", "<name>",
+                     "Storage of stream buffers: standard (default), mirrored."
+                     " Mirrored buffers are mapped twice in a row in virtual memory,"
+                     " so indexes do not wrap in period (Linux only)."},
+                    new enum_option<storage_type>(opt.storage, {
+                        {"standard", storage_type::standard},
+                        {"mirrored", storage_type::mirrored}
+                    }));
+    args.add_option({"share-storage", "", "",
+                     "Share memory between arrays of same type"
+                     " which are never live at the same time."},
+                    new switch_option(&opt.share_storage, true));
+    args.add_option({"cache", "", "<source>",
+                     "Source of cache sizes not given explicitly:"
+                     " fixed (default) uses common sizes,"
+                     " auto detects sizes on the compiling host."},
+                    new enum_option<cache_size_source>(opt.cache.source, {
+                        {"fixed", cache_size_source::fixed},
+                        {"auto", cache_size_source::host}
+                    }));
+    args.add_option({"cache-l1", "", "<bytes>", "Size of L1 data cache (default: see --cache)."},
+                    new int_option(&opt.cache.l1_size));
+    args.add_option({"cache-l2", "", "<bytes>", "Size of L2 cache (default: see --cache)."},
+                    new int_option(&opt.cache.l2_size));
+    args.add_option({"scratch-budget", "", "<bytes>",
+                     "Max size of buffers local to a period placed on stack"
+                     " (default: 1024, or half of L1 cache with --cache auto)."},
+                    new int_option(&opt.scratch_budget));
+    args.add_option({"arena", "", "<name>",
+                     "Place all persistent buffers into a single block of memory,"
+                     " ordered by access in period: none (default), heap, huge"
+                     " (huge pages if available, Linux only)."
+                     " Memory may also be supplied to the program constructor."},
+                    new enum_option<arena_type>(opt.arena, {
+                        {"none", arena_type::none},
+                        {"heap", arena_type::heap},
+                        {"huge", arena_type::huge_pages}
+                    }));
+    args.add_option({"avoid-modulo-split", "", "", "Avoid modulo by splitting loops where buffers wrap around."},
+                    new switch_option(&opt.split_statements, true));
     args.add_option({"move-loop-invariant-code", "", "", ""},
                     new switch_option(&opt.loop_invariant_code_motion, true));
+    args.add_option({"select-cost", "", "<cost>",
+                     "Evaluate both arms of a conditional and select the result"
+                     " without branching, if their cost is at most <cost>"
+                     " and all their array accesses are within bounds"
+                     " (default: 8; 0 disables)."},
+                    new int_option(&opt.select_cost));
+    args.add_option({"math", "", "<name>",
+                     "Implementation of exp, log, sin, cos, tan, pow etc.:"
+                     " std (default), fast, vector."
+                     " Fast uses approximations without branches provided by arrp/math.hpp"
+                     " (see there for error bounds)."
+                     " Vector also uses them in loops vectorized with --vector."},
+                    new enum_option<math_type>(opt.math, {
+                        {"std", math_type::standard},
+                        {"fast", math_type::fast},
+                        {"vector", math_type::vector}
+                    }));
+    args.add_option({"complex", "", "<name>",
+                     "Complex arithmetic: std (default), fast, split."
+                     " Fast computes complex addition, multiplication, division"
+                     " and absolute value with plain real arithmetic,"
+                     " without the standard handling of infinity and NaN."
+                     " Split is like fast, and also stores real and imaginary parts"
+                     " of complex buffers in separate planes."},
+                    new enum_option<complex_type>(opt.complex, {
+                        {"std", complex_type::standard},
+                        {"fast", complex_type::fast},
+                        {"split", complex_type::split}
+                    }));
+    args.add_option({"contraction-kernels", "", "",
+                     "Compute matrix products and other sums of products"
+                     " by register-blocked kernels, if possible."},
+                    new switch_option(&opt.contraction_kernels, true));
+    args.add_option({"reassociate-reductions", "", "",
+                     "Compute sums, products, minima, maxima and bitwise operations"
+                     " over array dimensions in a different order,"
+                     " using independent chains, SIMD vectors (with --vector)"
+                     " and threads (with --parallel), if possible."
+                     " With --parallel, also compute cumulative sums etc."
+                     " (scans) as parallel prefix."
+                     " With --vector, also compute first-order linear recurrences"
+                     " (e.g. one-pole filters) in blocks of samples."
+                     " Floating-point sums and products may change due to rounding."},
+                    new switch_option(&opt.reassociate_reductions, true));
+
+    args.add_option({"constant-tables", "", "",
+                     "Compute finite arrays which do not depend on inputs"
+                     " (e.g. wavetables, windows) during compilation,"
+                     " and store them as static tables shared by all program instances."},
+                    new switch_option(&opt.constant_tables, true));
+
+    args.add_option({"prelude-image", "", "",
+                     "Execute the prelude during compilation, if it does not"
+                     " depend on inputs, and store the resulting state"
+                     " as a static image which the generated prelude copies."},
+                    new switch_option(&opt.prelude_image, true));
 
     args.add_option({"io-common-clock", "", "",
                      "All inputs and outputs are scheduled on a common clock"
                      " at a rate of 1 element/tick."
-                     " Overrides --io-unordered."},
+                     " Overrides --io-unordered. Ignored with block I/O."},
                     new switch_option(&opt.clocked_io, true));
     args.add_option({"io-unordered", "", "", "Do not necessarily order input and output."},
                     new switch_option(&opt.ordered_io, false));
     args.add_option({"io-atomic", "", "", "Input and output singular elements."},
                     new switch_option(&opt.atomic_io, true));
+    args.add_option({"io-block", "", "",
+                     "Input and output an entire period of a stream at once."
+                     " Overrides --io-atomic."},
+                    new switch_option(&opt.block_io, true));
+    args.add_option({"io-zero-copy", "", "",
+                     "Let the host access stream data in program buffers"
+                     " instead of calling input and output functions."
+                     " Implies --io-block."},
+                    new switch_option(&opt.zero_copy_io, true));
 
     args.add_option({"interface", "", "", "Interface type: cpp (default), stdio, jack, puredata"},
                     new string_option(&opt.interface_type));
@@ -307,12 +448,16 @@ int main(int argc, char *argv[])
     verbose_out->add_topic<functional::array_transposer>("array-transpose");
     verbose_out->add_topic<functional::polyhedral_gen>("ph-model-gen");
     verbose_out->add_topic<polyhedral::model>("ph-model");
-    //verbose_out->add_topic<polyhedral::modulo_avoidance>("mod-avoid");
+    verbose_out->add_topic<polyhedral::constant_array_evaluator>("constant");
+    verbose_out->add_topic<polyhedral::prelude_evaluator>("prelude-image");
+    verbose_out->add_topic<polyhedral::reduction_finder>("reduction");
+    verbose_out->add_topic<polyhedral::modulo_avoidance>("mod-avoid");
     verbose_out->add_topic<polyhedral::scheduler>("ph-scheduling");
     verbose_out->add_topic<polyhedral::ast_isl>("ph-ast");
     verbose_out->add_topic<polyhedral::ast_gen>("ph-ast-gen");
     verbose_out->add_topic<polyhedral::storage_allocator>("storage-alloc");
     verbose_out->add_topic<polyhedral::storage_output>("storage");
+    verbose_out->add_topic<polyhedral::pipeline_partitioner>("pipeline");
     verbose_out->add_topic<cpp_gen::cpp_target>("cpp");
     verbose_out->add_topic<io_latency>("latency");
     verbose_out->add_topic<arrp::generic_io::log>("exe");
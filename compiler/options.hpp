@@ -30,6 +30,45 @@ namespace compiler {
 using std::string;
 using std::vector;
 
+enum class parallel_runtime_type
+{
+    openmp,
+    pool
+};
+
+enum class storage_type
+{
+    standard,
+    mirrored
+};
+
+enum class arena_type
+{
+    none,
+    heap,
+    huge_pages
+};
+
+enum class math_type
+{
+    standard,
+    fast,
+    vector
+};
+
+enum class complex_type
+{
+    standard,
+    fast,
+    split
+};
+
+enum class cache_size_source
+{
+    fixed,
+    host
+};
+
 struct options
 {
     string input_filename;
@@ -72,17 +111,59 @@ struct options
 
     bool atomic_io = false;
     bool ordered_io = true;
+    bool block_io = false;
+    bool zero_copy_io = false;
     // clocked_io: all IO channels transfer a sample
     // before any of them transfers the next sample.
     bool clocked_io = false;
 
     bool parallel = false;
     int parallel_dim = -1;
+    int prelude_parallel_dim = -1;
+    parallel_runtime_type parallel_runtime = parallel_runtime_type::openmp;
+    // Pin threads of thread pool to CPUs allowed for the process.
+    bool pin_threads = true;
     bool vectorize = false;
+    // Number of pipeline stages, if more than 1.
+    int pipeline_stages = 1;
+    // Number of independent program instances computed together, if more than 1.
+    int batch = 1;
 
     bool classic_storage_allocation = false;
     bool buffer_data_shifting = false;
+    storage_type storage = storage_type::standard;
+    // Arrays with disjoint lifetimes share memory.
+    bool share_storage = false;
+    // Data cache sizes in bytes. From source if 0.
+    struct {
+        int l1_size = 0;
+        int l2_size = 0;
+        cache_size_source source = cache_size_source::fixed;
+    } cache;
+    // Max bytes of period-local buffers on stack if not 0.
+    // Else 1024, or half of L1 if detected on host.
+    int scratch_budget = 0;
+    // Single block of memory for all persistent buffers.
+    arena_type arena = arena_type::none;
     bool loop_invariant_code_motion = false;
+    // Max cost of both arms of a conditional evaluated without branching.
+    int select_cost = 8;
+    // Implementation of elementary functions.
+    math_type math = math_type::standard;
+    // Arithmetic on and storage of complex numbers.
+    complex_type complex = complex_type::standard;
+    // Compute sums of products by register-blocked kernels.
+    bool contraction_kernels = false;
+    // Compute reductions in a different order, allowing rounding differences.
+    bool reassociate_reductions = false;
+    // Compute finite arrays independent of inputs during compilation.
+    bool constant_tables = false;
+    // Compute the prelude during compilation, if independent of inputs.
+    bool prelude_image = false;
+    // Measure time and count instances of each statement.
+    bool instrument = false;
+    // Record durations of periods, see program::stats().
+    bool period_stats = false;
 
     int data_alignment = 0;
     bool data_size_power_of_two = true;
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <stdexcept>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+namespace arrp {
+
+// Single block of memory holding all persistent buffers of a program.
+// The memory is either supplied by the caller, allocated on the heap,
+// or mapped with huge pages if possible.
+// Caller-supplied memory must be aligned to the given alignment,
+// and remains owned by the caller.
+
+class arena
+{
+public:
+    enum memory_type
+    {
+        heap,
+        huge_pages
+    };
+
+    arena(std::size_t size, std::size_t alignment, memory_type type, void * memory = nullptr)
+    {
+        if (memory)
+        {
+            if (reinterpret_cast<std::uintptr_t>(memory) % alignment != 0)
+                throw std::runtime_error("Arena memory is not aligned.");
+            m_data = static_cast<char*>(memory);
+            return;
+        }
+
+        if (size == 0)
+            return;
+
+#ifdef __linux__
+        if (type == huge_pages)
+        {
+            const std::size_t huge_page_size = 2 * 1024 * 1024;
+            std::size_t mapped_size = (size + huge_page_size - 1) / huge_page_size * huge_page_size;
+
+            void * data = mmap(nullptr, mapped_size, PROT_READ | PROT_WRITE,
+                               MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+
+            if (data == MAP_FAILED)
+            {
+                // No reserved huge pages. Ask for transparent huge pages instead.
+                data = mmap(nullptr, mapped_size, PROT_READ | PROT_WRITE,
+                            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+                if (data != MAP_FAILED)
+                    madvise(data, mapped_size, MADV_HUGEPAGE);
+            }
+
+            if (data != MAP_FAILED)
+            {
+                m_data = static_cast<char*>(data);
+                m_mapped_size = mapped_size;
+                return;
+            }
+        }
+#endif
+
+        std::size_t allocated_size = (size + alignment - 1) / alignment * alignment;
+        m_data = static_cast<char*>(std::aligned_alloc(alignment, allocated_size));
+        if (!m_data)
+            throw std::bad_alloc();
+        m_allocated = true;
+    }
+
+    ~arena()
+    {
+#ifdef __linux__
+        if (m_mapped_size)
+            munmap(m_data, m_mapped_size);
+#endif
+        if (m_allocated)
+            std::free(m_data);
+    }
+
+    arena(const arena &) = delete;
+    arena & operator=(const arena &) = delete;
+
+    char * data() { return m_data; }
+
+private:
+    char * m_data = nullptr;
+    std::size_t m_mapped_size = 0;
+    bool m_allocated = false;
+};
+
+}
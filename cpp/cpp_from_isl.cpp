@@ -36,6 +36,38 @@ cpp_from_isl::cpp_from_isl(builder *ctx):
 {
 }
 
+// Name of statement called in the subtree, or empty if there are several.
+
+static isl_bool find_single_statement(isl_ast_node * node, void * data)
+{
+    if (isl_ast_node_get_type(node) != isl_ast_node_user)
+        return isl_bool_true;
+
+    auto expr = isl_ast_node_user_get_expr(node);
+    auto id_expr = isl_ast_expr_get_op_arg(expr, 0);
+    auto id = isl_ast_expr_get_id(id_expr);
+
+    auto result = reinterpret_cast<pair<string,bool>*>(data);
+    string name = isl_id_get_name(id);
+    if (result->first.empty())
+        result->first = name;
+    else if (result->first != name)
+        result->second = false;
+
+    isl_id_free(id);
+    isl_ast_expr_free(id_expr);
+    isl_ast_expr_free(expr);
+
+    return result->second ? isl_bool_true : isl_bool_error;
+}
+
+static string single_statement(isl_ast_node * node)
+{
+    pair<string,bool> result { string(), true };
+    isl_ast_node_foreach_descendant_top_down(node, &find_single_statement, &result);
+    return result.second ? result.first : string();
+}
+
 void cpp_from_isl::generate( isl_ast_node * ast )
 {
     m_is_user_stmt = false;
@@ -143,12 +175,6 @@ void cpp_from_isl::process_if(isl_ast_node *node)
 
 void cpp_from_isl::process_for(isl_ast_node *node)
 {
-    auto iter_expr = isl_ast_node_for_get_iterator(node);
-    auto init_expr = isl_ast_node_for_get_init(node);
-    auto cond_expr = isl_ast_node_for_get_cond(node);
-    auto inc_expr = isl_ast_node_for_get_inc(node);
-    auto body_node = isl_ast_node_for_get_body(node);
-
     polyhedral::ast_node_info * info = nullptr;
     {
         auto id = isl_ast_node_get_annotation(node);
@@ -159,6 +185,27 @@ void cpp_from_isl::process_for(isl_ast_node *node)
         }
     }
 
+    // The entire loop is replaced by a kernel.
+
+    if (info && info->kernel_batch && m_kernel_func)
+    {
+        auto batch = process_kernel_batch(info->kernel_batch);
+        m_kernel_func(*info, batch, m_parallel_depth > 0, m_ctx);
+        return;
+    }
+
+    string timed_stmt;
+    if (m_timer_func && m_timed_depth == 0)
+        timed_stmt = single_statement(node);
+    if (!timed_stmt.empty())
+        ++m_timed_depth;
+
+    auto iter_expr = isl_ast_node_for_get_iterator(node);
+    auto init_expr = isl_ast_node_for_get_init(node);
+    auto cond_expr = isl_ast_node_for_get_cond(node);
+    auto inc_expr = isl_ast_node_for_get_inc(node);
+    auto body_node = isl_ast_node_for_get_body(node);
+
     auto iter = process_expr(iter_expr);
     auto init = process_expr(init_expr);
     auto cond = process_expr(cond_expr);
@@ -178,14 +225,22 @@ void cpp_from_isl::process_for(isl_ast_node *node)
 
     for_stmt->update = binop(op::assign_add, iter, inc);
 
+    bool is_parallel = info && info->is_parallel;
+
     {
         vector<statement_ptr> stmts;
 
         m_ctx->push(&stmts);
         m_ctx->current_block().induction_var = iter_id->name;
 
+        if (is_parallel)
+            ++m_parallel_depth;
+
         process_node(body_node);
 
+        if (is_parallel)
+            --m_parallel_depth;
+
         m_ctx->pop();
 
         if (stmts.size() == 1)
@@ -200,7 +255,41 @@ void cpp_from_isl::process_for(isl_ast_node *node)
         for_stmt->is_vector = info->is_vector;
     }
 
-    m_ctx->add(for_stmt);
+    statement_ptr loop = for_stmt;
+
+    bool is_recurrence = info && info->is_recurrence;
+
+    if ((for_stmt->is_vector || is_recurrence) && !for_stmt->is_parallel)
+    {
+        auto vector_for = make_vector_for(body_node, cond_expr, inc_expr,
+                                          iter_id->name, init, for_stmt->body,
+                                          !for_stmt->is_vector);
+        if (vector_for)
+            loop = vector_for;
+    }
+
+    if (m_parallel_pool && for_stmt->is_parallel)
+    {
+        vector<statement_ptr> body;
+        if (auto b = dynamic_pointer_cast<block_statement>(for_stmt->body))
+            body = b->statements;
+        else
+            body.push_back(for_stmt->body);
+
+        auto pool_for = make_pool_for(cond_expr, inc_expr, iter_id->name, init, body);
+        if (pool_for)
+            loop = pool_for;
+        else
+            for_stmt->is_parallel = false;
+    }
+
+    if (!timed_stmt.empty())
+    {
+        --m_timed_depth;
+        loop = m_timer_func(timed_stmt, loop);
+    }
+
+    m_ctx->add(loop);
 
     isl_ast_expr_free(iter_expr);
     isl_ast_expr_free(init_expr);
@@ -209,10 +298,215 @@ void cpp_from_isl::process_for(isl_ast_node *node)
     isl_ast_node_free(body_node);
 }
 
+// Arguments of a call expression, following the function name.
+
+vector<expression_ptr> cpp_from_isl::process_kernel_batch(isl_ast_expr * call)
+{
+    vector<expression_ptr> batch;
+    int arg_count = isl_ast_expr_get_op_n_arg(call);
+    for (int i = 1; i < arg_count; ++i)
+    {
+        auto arg = isl_ast_expr_get_op_arg(call, i);
+        batch.push_back(process_expr(arg));
+        isl_ast_expr_free(arg);
+    }
+    return batch;
+}
+
+// End of loop of form: for(i = a; i <= b; i += 1) or for(i = a; i < b; i += 1),
+// else null.
+
+expression_ptr cpp_from_isl::loop_end
+(isl_ast_expr * cond_expr, isl_ast_expr * inc_expr, const string & iter)
+{
+    {
+        auto val = isl_ast_expr_get_val(inc_expr);
+        bool is_one = isl_val_is_one(val) == isl_bool_true;
+        isl_val_free(val);
+        if (!is_one)
+            return nullptr;
+    }
+
+    if (isl_ast_expr_get_type(cond_expr) != isl_ast_expr_op)
+        return nullptr;
+
+    auto cond_type = isl_ast_expr_get_op_type(cond_expr);
+    if (cond_type != isl_ast_op_le && cond_type != isl_ast_op_lt)
+        return nullptr;
+
+    expression_ptr end;
+
+    {
+        auto lhs = isl_ast_expr_get_op_arg(cond_expr, 0);
+        auto rhs = isl_ast_expr_get_op_arg(cond_expr, 1);
+
+        bool lhs_is_iter = false;
+        if (isl_ast_expr_get_type(lhs) == isl_ast_expr_id)
+        {
+            auto id = isl_ast_expr_get_id(lhs);
+            lhs_is_iter = iter == isl_id_get_name(id);
+            isl_id_free(id);
+        }
+
+        if (lhs_is_iter)
+            end = process_expr(rhs);
+
+        isl_ast_expr_free(lhs);
+        isl_ast_expr_free(rhs);
+    }
+
+    if (!end)
+        return nullptr;
+
+    if (cond_type == isl_ast_op_le)
+        end = binop(op::add, end, literal(1));
+
+    return end;
+}
+
+statement_ptr cpp_from_isl::make_pool_for
+(isl_ast_expr * cond_expr, isl_ast_expr * inc_expr,
+ const string & iter, expression_ptr init,
+ const vector<statement_ptr> & body)
+{
+    auto end = loop_end(cond_expr, inc_expr, iter);
+    if (!end)
+        return nullptr;
+
+    auto loop = make_shared<pool_for_statement>();
+    loop->pool = m_parallel_pool;
+    loop->iterator = iter;
+    loop->begin = init;
+    loop->end = end;
+    loop->body = make_shared<block_statement>(body);
+
+    return loop;
+}
+
+// Whether node only contains statements.
+
+static bool is_straight_line(isl_ast_node * node)
+{
+    switch(isl_ast_node_get_type(node))
+    {
+    case isl_ast_node_user:
+        return true;
+    case isl_ast_node_block:
+    {
+        auto list = isl_ast_node_block_get_children(node);
+        int n_children = isl_ast_node_list_n_ast_node(list);
+        bool result = true;
+        for(int i = 0; i < n_children && result; ++i)
+        {
+            auto child = isl_ast_node_list_get_ast_node(list, i);
+            result = is_straight_line(child);
+            isl_ast_node_free(child);
+        }
+        isl_ast_node_list_free(list);
+        return result;
+    }
+    default:
+        return false;
+    }
+}
+
+/*
+Executes iterations in vectors, followed by a scalar loop for the remainder:
+{
+  int e = a + (b - a) / W * W;
+  for (int i = a; i < e; i += W) <vector body>
+  for (int i = e; i < b; i += 1) <scalar body>
+}
+where W is the width of vectors of the element type of all statements.
+Returns null if any statement can not be vectorized.
+If 'recurrence', each statement computes a block of W iterations
+of a linear recurrence instead of a vector.
+*/
+
+statement_ptr cpp_from_isl::make_vector_for
+(isl_ast_node * body_node,
+ isl_ast_expr * cond_expr, isl_ast_expr * inc_expr,
+ const string & iter, expression_ptr init,
+ statement_ptr scalar_body,
+ bool recurrence)
+{
+    auto & stmt_func = recurrence ? m_recurrence_stmt_func : m_vector_stmt_func;
+    if (!stmt_func || !is_straight_line(body_node))
+        return nullptr;
+
+    auto end = loop_end(cond_expr, inc_expr, iter);
+    if (!end)
+        return nullptr;
+
+    vector<statement_ptr> vector_body;
+
+    // Code moved out of the vector body into enclosing blocks
+    // is removed again if vectorization fails.
+    vector<size_t> block_sizes;
+    for (int level = 0; level < m_ctx->block_count(); ++level)
+        block_sizes.push_back(m_ctx->block(level).stmts->size());
+
+    m_vector_iter = iter;
+    m_vector_type.clear();
+    m_vector_failed = false;
+    m_vector_recurrence = recurrence;
+
+    m_ctx->push(&vector_body);
+    m_ctx->current_block().induction_var = iter;
+    process_node(body_node);
+    m_ctx->pop();
+
+    m_vector_iter.clear();
+
+    if (m_vector_failed || m_vector_type.empty())
+    {
+        for (int level = 0; level < (int) block_sizes.size(); ++level)
+            m_ctx->block(level).stmts->resize(block_sizes[level]);
+        return nullptr;
+    }
+
+    auto width = make_id("arrp::simd::vec<" + m_vector_type + ">::width");
+    auto iter_id = make_id(iter);
+    auto vector_end = make_id(m_ctx->new_var_id());
+
+    auto result = make_shared<block_statement>();
+
+    {
+        auto count = binop(op::sub, end, init);
+        auto vector_count = binop(op::mult, binop(op::div, count, width), width);
+        auto value = binop(op::add, init, vector_count);
+        result->statements.push_back(stmt(decl_expr(int_type(), *vector_end, value)));
+    }
+    {
+        auto loop = make_shared<for_statement>();
+        loop->initialization = decl_expr(int_type(), *iter_id, init);
+        loop->condition = binop(op::lesser, iter_id, vector_end);
+        loop->update = binop(op::assign_add, iter_id, width);
+        loop->body = block(vector_body);
+        result->statements.push_back(loop);
+    }
+    {
+        auto loop = make_shared<for_statement>();
+        loop->initialization = decl_expr(int_type(), *iter_id, vector_end);
+        loop->condition = binop(op::lesser, iter_id, end);
+        loop->update = binop(op::assign_add, iter_id, literal(1));
+        loop->body = scalar_body;
+        result->statements.push_back(loop);
+    }
+
+    return result;
+}
+
 void cpp_from_isl::process_user(isl_ast_node *node)
 {
     auto ast_expr = isl_ast_node_user_get_expr(node);
 
+    bool is_timed = m_timer_func && m_timed_depth == 0;
+
+    vector<statement_ptr> stmts;
+    if (is_timed)
+        m_ctx->push(&stmts);
+
     m_is_user_stmt = true;
     auto expr = process_expr(ast_expr);
     m_is_user_stmt = false;
@@ -220,6 +514,12 @@ void cpp_from_isl::process_user(isl_ast_node *node)
     if (expr)
         m_ctx->add(expr);
 
+    if (is_timed)
+    {
+        m_ctx->pop();
+        m_ctx->add(m_timer_func(single_statement(node), block(stmts)));
+    }
+
     isl_ast_expr_free(ast_expr);
 }
 
@@ -356,7 +656,19 @@ expression_ptr cpp_from_isl::process_op(isl_ast_expr * ast_op)
 
         vector<expression_ptr> func_args(++args.begin(), args.end());
 
-        if (m_is_user_stmt && m_stmt_func)
+        if (m_is_user_stmt && !m_vector_iter.empty())
+        {
+            auto & stmt_func = m_vector_recurrence ?
+                        m_recurrence_stmt_func : m_vector_stmt_func;
+            string type;
+            if (stmt_func)
+                type = stmt_func(id->name, func_args, m_vector_iter, m_ctx);
+            if (type.empty() || (!m_vector_type.empty() && type != m_vector_type))
+                m_vector_failed = true;
+            else
+                m_vector_type = type;
+        }
+        else if (m_is_user_stmt && m_stmt_func)
             m_stmt_func(id->name, func_args, m_ctx);
         else
             expr = make_shared<call_expression>(id->name, func_args);
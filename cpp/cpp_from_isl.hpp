@@ -29,6 +29,9 @@ along with this program; if not, write to the Free Software Foundation, Inc.,
 #include <functional>
 
 namespace stream {
+
+namespace polyhedral { struct ast_node_info; }
+
 namespace cpp_gen {
 
 class cpp_from_isl
@@ -50,12 +53,65 @@ public:
         m_id_func = f;
     }
 
+    // Generates a statement with the given loop iterator
+    // advancing by a vector of iterations.
+    // Returns the vector element type, or empty string if not possible.
+    template<typename F>
+    void set_vector_stmt_func(F f)
+    {
+        m_vector_stmt_func = f;
+    }
+
+    // Like set_vector_stmt_func, for loops computing
+    // linear recurrences (see polyhedral::ast_node_info).
+    template<typename F>
+    void set_recurrence_stmt_func(F f)
+    {
+        m_recurrence_stmt_func = f;
+    }
+
+    // Generates a kernel replacing a loop (see polyhedral::ast_node_info),
+    // given values of its batch dimensions,
+    // and whether it is nested in a parallel loop.
+    template<typename F>
+    void set_kernel_func(F f)
+    {
+        m_kernel_func = f;
+    }
+
+    // Run parallel loops using a thread pool instead of OpenMP.
+    void set_parallel_pool(expression_ptr pool)
+    {
+        m_parallel_pool = pool;
+    }
+
+    // Wraps code computing instances of a single statement
+    // to measure its time, given the statement name.
+    // Loops computing a single statement are measured as a whole,
+    // other statements are measured per instance.
+    template<typename F>
+    void set_timer_func(F f)
+    {
+        m_timer_func = f;
+    }
+
 private:
     void process_node(isl_ast_node *node);
     void process_block(isl_ast_node *node);
     void process_for(isl_ast_node *node);
+    expression_ptr loop_end(isl_ast_expr * cond, isl_ast_expr * inc,
+                            const string & iter);
+    statement_ptr make_pool_for(isl_ast_expr * cond, isl_ast_expr * inc,
+                                const string & iter, expression_ptr init,
+                                const vector<statement_ptr> & body);
+    statement_ptr make_vector_for(isl_ast_node * body_node,
+                                  isl_ast_expr * cond, isl_ast_expr * inc,
+                                  const string & iter, expression_ptr init,
+                                  statement_ptr scalar_body,
+                                  bool recurrence);
     void process_if(isl_ast_node *node);
     void process_user(isl_ast_node *node);
+    vector<expression_ptr> process_kernel_batch(isl_ast_expr * call);
 
     expression_ptr process_expr(isl_ast_expr * expr);
     expression_ptr process_op(isl_ast_expr * expr);
@@ -68,7 +124,37 @@ private:
     std::function<expression_ptr(const string &)>
     m_id_func;
 
+    std::function<string(const string &,
+                         const vector<expression_ptr> &,
+                         const string &,
+                         builder *)>
+    m_vector_stmt_func;
+
+    std::function<string(const string &,
+                         const vector<expression_ptr> &,
+                         const string &,
+                         builder *)>
+    m_recurrence_stmt_func;
+
+    std::function<void(const polyhedral::ast_node_info &,
+                       const vector<expression_ptr> &,
+                       bool,
+                       builder *)>
+    m_kernel_func;
+
+    std::function<statement_ptr(const string &, statement_ptr)>
+    m_timer_func;
+
+    // Iterator of loop being vectorized, and element type.
+    string m_vector_iter;
+    string m_vector_type;
+    bool m_vector_failed = false;
+    bool m_vector_recurrence = false;
+
     bool m_is_user_stmt = false;
+    int m_parallel_depth = 0;
+    int m_timed_depth = 0;
+    expression_ptr m_parallel_pool;
     builder *m_ctx;
 };
 
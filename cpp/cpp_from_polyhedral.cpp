@@ -2,6 +2,9 @@
 #include "collect_names.hpp"
 #include "../common/error.hpp"
 
+#include <algorithm>
+#include <functional>
+
 using namespace std;
 
 namespace stream {
@@ -25,82 +28,1384 @@ static primitive_type prim_type(const functional::expression * expr)
     return scalar->primitive;
 }
 
-static primitive_type prim_type(const functional::expr_ptr & expr)
-{
-    return prim_type(expr.get());
-}
+static primitive_type prim_type(const functional::expr_ptr & expr)
+{
+    return prim_type(expr.get());
+}
+
+static expression_ptr to_complex64(expression_ptr e, primitive_type t)
+{
+    if (t == primitive_type::complex64)
+        return e;
+
+    auto f = make_id("complex<double>");
+
+    if (t == primitive_type::complex32)
+        return call(f, {e});
+    else
+        return call(f, {e, literal((double)0)});
+}
+#if 0
+static expression_ptr to_complex32(expression_ptr e, primitive_type t)
+{
+    if (t == primitive_type::complex32)
+        return e;
+
+    auto f = make_id("complex<float>");
+
+    if (t == primitive_type::complex64)
+        return call(f, {e});
+    else
+        return call(f, {e, literal((double)0)});
+}
+#endif
+
+static expression_ptr to_real64(expression_ptr e, primitive_type t)
+{
+    if (t == primitive_type::real64)
+        return e;
+    else
+        return cast(double_type(), e);
+}
+
+static expression_ptr to_real32(expression_ptr e, primitive_type t)
+{
+    if (t == primitive_type::real32)
+        return e;
+    else
+        return cast(float_type(), e);
+}
+
+static expression_ptr to_type(expression_ptr e, primitive_type a, primitive_type r)
+{
+    if (a == r)
+        return e;
+
+    return cast(type_for(r), e);
+}
+
+void cpp_from_polyhedral::generate_statement
+(const string & name, const index_type & index, builder* ctx)
+{
+    auto stmt_ref = std::find_if(m_model.statements.begin(), m_model.statements.end(),
+                                 [&](polyhedral::stmt_ptr s){ return s->name == name; });
+
+    if (stmt_ref == m_model.statements.end())
+        return;
+
+    generate_statement((*stmt_ref).get(), index, ctx);
+}
+
+void cpp_from_polyhedral::generate_statement
+(polyhedral::statement *stmt, const index_type & index, builder* ctx)
+{
+    // Data is transferred by the host directly into or out of the buffer.
+    if (m_direct_io.count(stmt))
+        return;
+
+    m_current_stmt = stmt;
+
+    auto counter = m_instance_counters.find(stmt->name);
+    if (counter != m_instance_counters.end())
+        ctx->add(unop(op::pre_incr, counter->second));
+
+    // Compute statement for all program instances in a batch.
+    // I/O transfers values of all instances at once.
+    if (m_lanes > 1 && !stmt->is_input_or_output)
+    {
+        string id = ctx->new_var_id();
+        m_lane = make_id(id);
+
+        vector<statement_ptr> stmts;
+        ctx->push(&stmts);
+        ctx->current_block().induction_var = id;
+        ctx->add(generate_expression(stmt->expr, index, ctx));
+        ctx->pop();
+
+        auto loop = make_shared<for_statement>();
+        loop->initialization = decl_expr(int_type(), id, literal(0));
+        loop->condition = binop(op::lesser, m_lane, literal(m_lanes));
+        loop->update = unop(op::pre_incr, m_lane);
+        loop->body = block(stmts);
+        loop->is_vector = true;
+        ctx->add(statement_ptr(loop));
+
+        m_lane = nullptr;
+        return;
+    }
+
+    auto expr = generate_expression(stmt->expr, index, ctx);
+
+    ctx->add(expr);
+}
+
+// Whether an access by any instance of the statement is within the array domain.
+// The frontend does not check bounds, so an access in an arm of a conditional
+// may be outside when the condition does not hold.
+
+static bool is_in_bounds(polyhedral::array_access * access, polyhedral::statement * stmt)
+{
+    if (!stmt || !access->map.is_valid())
+        return false;
+
+    // Statement parts share expressions with the original statement.
+    isl::map map(isl_map_set_tuple_name(access->map.copy(), isl_dim_in, stmt->name.c_str()));
+
+    auto accessed = map.in_domain(stmt->domain).range();
+    return (accessed - access->array->domain).is_empty();
+}
+
+// Approximate cost of evaluating expression, in number of simple operations,
+// or -1 if evaluation may have side effects or fail,
+// for any instance of the statement.
+
+static int evaluation_cost(const functional::expr_ptr & expr, polyhedral::statement * stmt)
+{
+    if (dynamic_cast<polyhedral::iterator_read*>(expr.get()) ||
+            dynamic_cast<functional::int_const*>(expr.get()) ||
+            dynamic_cast<functional::constant<double>*>(expr.get()) ||
+            dynamic_cast<functional::bool_const*>(expr.get()) ||
+            dynamic_cast<functional::complex_const*>(expr.get()))
+    {
+        return 0;
+    }
+    else if (auto access = dynamic_cast<polyhedral::array_access*>(expr.get()))
+    {
+        if (!is_in_bounds(access, stmt))
+            return -1;
+        int cost = 1;
+        for (auto & index : access->indexes)
+        {
+            int index_cost = evaluation_cost(index, stmt);
+            if (index_cost < 0)
+                return -1;
+            cost += index_cost;
+        }
+        return cost;
+    }
+    else if (auto prim = dynamic_cast<functional::primitive*>(expr.get()))
+    {
+        int cost;
+
+        switch(prim->kind)
+        {
+        case primitive_op::divide_integer:
+        case primitive_op::modulo:
+            // Division by zero traps.
+            if (is_integer(prim_type(prim->operands[0])) &&
+                    is_integer(prim_type(prim->operands[1])))
+                return -1;
+            cost = 4;
+            break;
+        case primitive_op::divide:
+        case primitive_op::sqrt:
+            cost = 4;
+            break;
+        case primitive_op::raise:
+        case primitive_op::exp:
+        case primitive_op::exp2:
+        case primitive_op::log:
+        case primitive_op::log2:
+        case primitive_op::log10:
+        case primitive_op::sin:
+        case primitive_op::cos:
+        case primitive_op::tan:
+        case primitive_op::asin:
+        case primitive_op::acos:
+        case primitive_op::atan:
+            cost = 20;
+            break;
+        default:
+            cost = 1;
+        }
+
+        if (is_complex(prim_type(expr)))
+            cost *= 4;
+
+        for (auto & operand : prim->operands)
+        {
+            int operand_cost = evaluation_cost(operand, stmt);
+            if (operand_cost < 0)
+                return -1;
+            cost += operand_cost;
+        }
+
+        return cost;
+    }
+
+    // External calls etc.
+    return -1;
+}
+
+bool cpp_from_polyhedral::is_cheap_select(functional::primitive * expr)
+{
+    if (m_select_cost <= 0)
+        return false;
+
+    int true_cost = evaluation_cost(expr->operands[1], m_current_stmt);
+    int false_cost = evaluation_cost(expr->operands[2], m_current_stmt);
+    if (true_cost < 0 || false_cost < 0)
+        return false;
+
+    return true_cost + false_cost <= m_select_cost;
+}
+
+// Whether both arms of all conditionals in expression can be evaluated
+// for any instance of the statement, so they can be replaced by selects.
+
+static bool can_select_conditionals(const functional::expr_ptr & expr, polyhedral::statement * stmt)
+{
+    auto prim = dynamic_cast<functional::primitive*>(expr.get());
+    if (!prim)
+        return true;
+
+    if (prim->kind == primitive_op::conditional &&
+            (evaluation_cost(prim->operands[1], stmt) < 0 ||
+             evaluation_cost(prim->operands[2], stmt) < 0))
+        return false;
+
+    for (auto & operand : prim->operands)
+    {
+        if (!can_select_conditionals(operand, stmt))
+            return false;
+    }
+
+    return true;
+}
+
+// Whether expression only contains operations on vectors of elements of type t.
+// Elementary functions are included if vector_math is true.
+
+static bool is_vectorizable(const functional::expr_ptr & expr, primitive_type t,
+                            bool vector_math)
+{
+    auto scalar = dynamic_pointer_cast<functional::scalar_type>(expr->type);
+    if (!scalar)
+        return false;
+
+    auto type = scalar->primitive;
+
+    if (auto access = dynamic_cast<polyhedral::array_access*>(expr.get()))
+    {
+        return access->array->type == t && type == t;
+    }
+    else if (dynamic_cast<functional::constant<double>*>(expr.get()))
+    {
+        return type == t;
+    }
+    else if (auto prim = dynamic_cast<functional::primitive*>(expr.get()))
+    {
+        auto operands_are = [&](primitive_type operand_type, int first = 0)
+        {
+            for (int i = first; i < (int) prim->operands.size(); ++i)
+            {
+                auto & operand = prim->operands[i];
+                if (prim_type(operand) != operand_type ||
+                        !is_vectorizable(operand, t, vector_math))
+                    return false;
+            }
+            return true;
+        };
+
+        switch(prim->kind)
+        {
+        case primitive_op::add:
+        case primitive_op::subtract:
+        case primitive_op::multiply:
+        case primitive_op::divide:
+        case primitive_op::min:
+        case primitive_op::max:
+        case primitive_op::sqrt:
+        case primitive_op::abs:
+            return type == t && operands_are(t);
+        case primitive_op::raise:
+        case primitive_op::exp:
+        case primitive_op::exp2:
+        case primitive_op::log:
+        case primitive_op::log2:
+        case primitive_op::log10:
+        case primitive_op::sin:
+        case primitive_op::cos:
+        case primitive_op::tan:
+            return vector_math && type == t && operands_are(t);
+        case primitive_op::negate:
+            return operands_are(type) && (type == t || type == primitive_type::boolean);
+        case primitive_op::compare_g:
+        case primitive_op::compare_geq:
+        case primitive_op::compare_l:
+        case primitive_op::compare_leq:
+        case primitive_op::compare_eq:
+        case primitive_op::compare_neq:
+            return type == primitive_type::boolean && operands_are(t);
+        case primitive_op::logic_and:
+        case primitive_op::logic_or:
+            return type == primitive_type::boolean && operands_are(primitive_type::boolean);
+        case primitive_op::conditional:
+            return type == t &&
+                    prim_type(prim->operands[0]) == primitive_type::boolean &&
+                    is_vectorizable(prim->operands[0], t, vector_math) &&
+                    operands_are(t, 1);
+        case primitive_op::to_real32:
+        case primitive_op::to_real64:
+            // Only if no conversion
+            return type == t && operands_are(t);
+        default:
+            return false;
+        }
+    }
+
+    return false;
+}
+
+// Coefficient of iterator in an integer index expression.
+// Returns false if the expression is not affine in the iterator.
+
+static bool iterator_coefficient(const expression_ptr & e, const string & iter, int & coef)
+{
+    if (auto id = dynamic_pointer_cast<id_expression>(e))
+    {
+        coef = id->name == iter ? 1 : 0;
+        return true;
+    }
+    else if (dynamic_pointer_cast<literal_expression<int>>(e) ||
+             dynamic_pointer_cast<literal_expression<string>>(e))
+    {
+        coef = 0;
+        return true;
+    }
+    else if (auto u = dynamic_pointer_cast<un_op_expression>(e))
+    {
+        int c;
+        if (!iterator_coefficient(u->rhs, iter, c))
+            return false;
+        if (u->op == op::u_minus)
+            coef = -c;
+        else if (c == 0)
+            coef = 0;
+        else
+            return false;
+        return true;
+    }
+    else if (auto bin = dynamic_pointer_cast<bin_op_expression>(e))
+    {
+        int a, b;
+        if (!iterator_coefficient(bin->lhs, iter, a) ||
+                !iterator_coefficient(bin->rhs, iter, b))
+            return false;
+
+        switch(bin->op)
+        {
+        case op::add:
+            coef = a + b;
+            return true;
+        case op::sub:
+            coef = a - b;
+            return true;
+        case op::mult:
+        {
+            if (a == 0 && b == 0)
+            {
+                coef = 0;
+                return true;
+            }
+            auto lhs_value = dynamic_pointer_cast<literal_expression<int>>(bin->lhs);
+            auto rhs_value = dynamic_pointer_cast<literal_expression<int>>(bin->rhs);
+            if (a == 0 && lhs_value)
+            {
+                coef = lhs_value->value * b;
+                return true;
+            }
+            if (b == 0 && rhs_value)
+            {
+                coef = rhs_value->value * a;
+                return true;
+            }
+            return false;
+        }
+        default:
+            // Wrapping etc. is not affine.
+            coef = 0;
+            return a == 0 && b == 0;
+        }
+    }
+    else if (auto call = dynamic_pointer_cast<call_expression>(e))
+    {
+        for (auto & arg : call->args)
+        {
+            int c;
+            if (!iterator_coefficient(arg, iter, c) || c != 0)
+                return false;
+        }
+        coef = 0;
+        return true;
+    }
+
+    return false;
+}
+
+enum access_pattern_type
+{
+    invariant_access,
+    contiguous_access,
+    irregular_access
+};
+
+// How elements accessed by consecutive values of iterator are laid out.
+
+static access_pattern_type access_pattern(const array_access_expression & access,
+                                          const string & iter)
+{
+    vector<int> coefs;
+    for (auto & i : access.index)
+    {
+        int c;
+        if (!iterator_coefficient(i, iter, c))
+            return irregular_access;
+        coefs.push_back(c);
+    }
+
+    if (std::all_of(coefs.begin(), coefs.end(), [](int c){ return c == 0; }))
+        return invariant_access;
+
+    if (coefs.back() == 1 &&
+            std::all_of(coefs.begin(), coefs.end() - 1, [](int c){ return c == 0; }))
+        return contiguous_access;
+
+    return irregular_access;
+}
+
+// Converts scalar expression into expression on vectors,
+// with given iterator advancing by vector width.
+// Returns null if not possible.
+
+static expression_ptr vectorized(const expression_ptr & e,
+                                 const string & iter,
+                                 const string & vec_type)
+{
+    auto broadcast = [&](const expression_ptr & x)
+    { return call(make_id(vec_type), { x }); };
+
+    if (auto access = dynamic_pointer_cast<array_access_expression>(e))
+    {
+        switch(access_pattern(*access, iter))
+        {
+        case invariant_access:
+            return broadcast(e);
+        case contiguous_access:
+            return call(make_id(vec_type + "::load"), { unop(op::address, e) });
+        default:
+            return nullptr;
+        }
+    }
+    else if (auto conversion = dynamic_pointer_cast<cast_expression>(e))
+    {
+        // Only conversions to same type are vectorizable.
+        return vectorized(conversion->expr, iter, vec_type);
+    }
+    else if (auto id = dynamic_pointer_cast<id_expression>(e))
+    {
+        if (id->name == iter)
+            return nullptr;
+        return broadcast(e);
+    }
+    else if (dynamic_pointer_cast<literal_expression<float>>(e) ||
+             dynamic_pointer_cast<literal_expression<double>>(e))
+    {
+        return broadcast(e);
+    }
+    else if (auto u = dynamic_pointer_cast<un_op_expression>(e))
+    {
+        if (u->op != op::u_minus && u->op != op::logic_neg)
+            return nullptr;
+        auto rhs = vectorized(u->rhs, iter, vec_type);
+        if (!rhs)
+            return nullptr;
+        return unop(u->op, rhs);
+    }
+    else if (auto b = dynamic_pointer_cast<bin_op_expression>(e))
+    {
+        switch(b->op)
+        {
+        case op::add:
+        case op::sub:
+        case op::mult:
+        case op::div:
+        case op::lesser:
+        case op::lesser_or_equal:
+        case op::greater:
+        case op::greater_or_equal:
+        case op::equal:
+        case op::not_equal:
+        case op::logic_and:
+        case op::logic_or:
+            break;
+        default:
+            return nullptr;
+        }
+        auto lhs = vectorized(b->lhs, iter, vec_type);
+        auto rhs = vectorized(b->rhs, iter, vec_type);
+        if (!lhs || !rhs)
+            return nullptr;
+        return binop(b->op, lhs, rhs);
+    }
+    else if (auto c = dynamic_pointer_cast<call_expression>(e))
+    {
+        auto f = dynamic_pointer_cast<id_expression>(c->callee);
+        if (!f)
+            return nullptr;
+
+        string name;
+        string math_prefix = "arrp::math::";
+        if (f->name.compare(0, math_prefix.size(), math_prefix) == 0)
+        {
+            // Overloaded for vectors; drop explicit element type.
+            name = f->name.substr(0, f->name.find('<'));
+        }
+        else if (f->name == "min" || f->name == "max" || f->name == "sqrt" || f->name == "abs")
+        {
+            // Found by argument-dependent lookup.
+            name = f->name;
+        }
+        else
+        {
+            return nullptr;
+        }
+
+        vector<expression_ptr> args;
+        for (auto & arg : c->args)
+        {
+            auto v = vectorized(arg, iter, vec_type);
+            if (!v)
+                return nullptr;
+            args.push_back(v);
+        }
+        return call(make_id(name), args);
+    }
+    else if (auto s = dynamic_pointer_cast<if_expression>(e))
+    {
+        auto cond = vectorized(s->condition, iter, vec_type);
+        auto t = vectorized(s->true_expr, iter, vec_type);
+        auto f = vectorized(s->false_expr, iter, vec_type);
+        if (!cond || !t || !f)
+            return nullptr;
+        return call(make_id("select"), { cond, t, f });
+    }
+
+    return nullptr;
+}
+
+string cpp_from_polyhedral::generate_vector_statement
+(const string & name, const index_type & index, const string & iter, builder * ctx)
+{
+    auto stmt_ref = std::find_if(m_model.statements.begin(), m_model.statements.end(),
+                                 [&](polyhedral::stmt_ptr s){ return s->name == name; });
+
+    if (stmt_ref == m_model.statements.end())
+        return string();
+
+    auto stmt = stmt_ref->get();
+
+    if (stmt->is_input_or_output)
+        return string();
+
+    auto assignment = dynamic_pointer_cast<polyhedral::assignment>(stmt->expr);
+    if (!assignment)
+        return string();
+
+    auto elem_type = prim_type(assignment->destination);
+
+    if (elem_type != primitive_type::real32 && elem_type != primitive_type::real64)
+        return string();
+
+    bool vector_math = m_math == compiler::math_type::vector;
+
+    if (!is_vectorizable(assignment->destination, elem_type, vector_math) ||
+            !is_vectorizable(assignment->value, elem_type, vector_math))
+        return string();
+
+    // Conditionals are evaluated as selects.
+    if (!can_select_conditionals(assignment->value, stmt))
+        return string();
+
+    string type_name = type_name_for(elem_type);
+    string vec_type = "arrp::simd::vec<" + type_name + ">";
+
+    m_current_stmt = stmt;
+
+    m_select_conditionals = true;
+    auto dest = generate_expression(assignment->destination, index, ctx);
+    auto value = generate_expression(assignment->value, index, ctx);
+    m_select_conditionals = false;
+
+    // Stored elements must be contiguous.
+    auto dest_access = dynamic_pointer_cast<array_access_expression>(dest);
+    if (!dest_access || access_pattern(*dest_access, iter) != contiguous_access)
+        return string();
+
+    auto vector_value = vectorized(value, iter, vec_type);
+    if (!vector_value)
+        return string();
+
+    ctx->add(call(make_id("store"), { unop(op::address, dest), vector_value }));
+
+    return type_name;
+}
+
+// Computes elements k ... k+W-1 of a linear recurrence
+// from element k-1, using arrp::simd::linear_recurrence.
+// The loop iterator must advance along the recurrence dimension only.
+
+string cpp_from_polyhedral::generate_recurrence_block
+(const string & name, const index_type & index, const string & iter, builder * ctx)
+{
+    auto rec_ref = std::find_if(m_model.recurrences.begin(), m_model.recurrences.end(),
+                                [&](const polyhedral::linear_recurrence & r)
+    { return r.update->name == name; });
+
+    if (rec_ref == m_model.recurrences.end())
+        return string();
+
+    auto & r = *rec_ref;
+
+    auto assignment = dynamic_cast<polyhedral::assignment*>(r.update->expr.get());
+    assert_or_throw(assignment);
+
+    auto type = r.array->type;
+    if (!is_real(type))
+        return string();
+
+    for (int d = 0; d < (int) index.size(); ++d)
+    {
+        int c;
+        if (!iterator_coefficient(index[d], iter, c) || c != (d == r.dim ? 1 : 0))
+            return string();
+    }
+
+    string type_name = type_name_for(type);
+
+    // Block coefficients are computed once before the loop.
+
+    string rec_id = ctx->new_var_id();
+    auto rec = make_id(rec_id);
+    {
+        auto rec_type = make_shared<basic_type>
+                ("arrp::simd::linear_recurrence<" + type_name + ">");
+        auto a = cast(type_for(type), literal(r.coefficient));
+        auto decl = decl_expr(rec_type, rec_id, a);
+        ctx->block(ctx->current_block_level() - 1).stmts->push_back(stmt(decl));
+    }
+
+    auto width = make_id("arrp::simd::linear_recurrence<" + type_name + ">::width");
+    auto input = make_shared<binary_operation>(op::member_of_reference, rec, make_id("input"));
+    auto output = make_shared<binary_operation>(op::member_of_reference, rec, make_id("output"));
+
+    m_current_stmt = r.update.get();
+
+    // Loop over j in block, with statement index advanced by j.
+
+    auto block_loop = [&](const std::function<void(expression_ptr, const index_type &)> & body)
+    {
+        string j_id = ctx->new_var_id();
+        auto j = make_id(j_id);
+
+        index_type shifted = index;
+        shifted[r.dim] = binop(op::add, index[r.dim], j);
+
+        vector<statement_ptr> stmts;
+        ctx->push(&stmts);
+        ctx->current_block().induction_var = j_id;
+        body(j, shifted);
+        ctx->pop();
+
+        auto loop = make_shared<for_statement>();
+        loop->initialization = decl_expr(int_type(), j_id, literal(0));
+        loop->condition = binop(op::lesser, j, width);
+        loop->update = unop(op::pre_incr, j);
+        loop->body = block(stmts);
+        ctx->add(statement_ptr(loop));
+    };
+
+    block_loop([&](expression_ptr j, const index_type & shifted)
+    {
+        auto value = generate_expression(r.input, shifted, ctx);
+        value = to_type(value, prim_type(r.input), type);
+        auto elem = make_shared<array_access_expression>(input, vector<expression_ptr>{ j });
+        ctx->add(assign(elem, value));
+    });
+
+    {
+        auto previous = generate_expression(r.previous, index, ctx);
+        ctx->add(make_shared<call_expression>(rec, vector<expression_ptr>{ previous }));
+    }
+
+    block_loop([&](expression_ptr j, const index_type & shifted)
+    {
+        auto dest = generate_expression(assignment->destination, shifted, ctx);
+        auto elem = make_shared<array_access_expression>(output, vector<expression_ptr>{ j });
+        ctx->add(assign(dest, elem));
+    });
+
+    m_current_stmt = nullptr;
+
+    return type_name;
+}
+
+// Computes all elements of a contraction for given batch dimensions.
+// Elements are accumulated in local variables, in blocks of rows and columns,
+// so that each element of a factor is loaded once for an entire block.
+// Blocks are grouped into tiles of columns, so that the elements
+// of the right factor used by a tile stay in cache for all rows.
+// Each element is accumulated in the same order as by the statements,
+// and only the last element along the reduction dimension is stored.
+
+void cpp_from_polyhedral::generate_contraction
+(const polyhedral::contraction & c, const index_type & batch, builder * ctx)
+{
+    auto init = dynamic_cast<polyhedral::assignment*>(c.init->expr.get());
+    auto update = dynamic_cast<polyhedral::assignment*>(c.update->expr.get());
+    assert_or_throw(init && update);
+    assert_or_throw(batch.size() == c.batch_dims.size());
+
+    auto type = c.accumulator->type;
+    int dim_count = c.update->domain.dimensions();
+
+    int row_count = c.row_dim >= 0 ? c.row_end - c.row_begin + 1 : 1;
+    int col_count = c.col_dim >= 0 ? c.col_end - c.col_begin + 1 : 1;
+    int reduction_count = c.reduction_end - c.reduction_begin + 1;
+
+    int block_rows = 1;
+    int block_cols = 1;
+    if (c.row_dim >= 0 && c.col_dim >= 0)
+    {
+        block_rows = 4;
+        block_cols = 4;
+    }
+    else if (c.row_dim >= 0)
+    {
+        block_rows = 8;
+    }
+    else if (c.col_dim >= 0)
+    {
+        block_cols = 8;
+    }
+    block_rows = std::min(block_rows, row_count);
+    block_cols = std::min(block_cols, col_count);
+
+    int full_rows = row_count / block_rows * block_rows;
+    int full_cols = col_count / block_cols * block_cols;
+
+    // Right factor of a tile takes at most half of L2 cache.
+    int64_t col_bytes = int64_t(reduction_count) * byte_size_for(type);
+    int tile_cols = int(std::min<int64_t>(full_cols, m_cache_size / 2 / col_bytes));
+    tile_cols = std::max(block_cols, tile_cols / block_cols * block_cols);
+
+    auto stmt_index = [&](expression_ptr row, expression_ptr col, expression_ptr k)
+    {
+        index_type index(dim_count);
+        for (int i = 0; i < (int) batch.size(); ++i)
+            index[c.batch_dims[i]] = batch[i];
+        if (c.row_dim >= 0)
+            index[c.row_dim] = row;
+        if (c.col_dim >= 0)
+            index[c.col_dim] = col;
+        index[c.reduction_dim] = k;
+        return index;
+    };
+
+    auto offset = [](expression_ptr e, int n) -> expression_ptr
+    {
+        return n ? binop(op::add, e, literal(n)) : e;
+    };
+
+    // for (int i = begin; i < end; i += step) body(i)
+
+    auto loop = [&](expression_ptr begin, expression_ptr end, int step,
+                    const std::function<void(expression_ptr)> & body)
+    {
+        string id = ctx->new_var_id();
+        auto iter = make_id(id);
+
+        auto for_stmt = make_shared<for_statement>();
+        for_stmt->initialization = decl_expr(int_type(), id, begin);
+        for_stmt->condition = binop(op::lesser, iter, end);
+        if (step == 1)
+            for_stmt->update = unop(op::pre_incr, iter);
+        else
+            for_stmt->update = binop(op::assign_add, iter, literal(step));
+
+        vector<statement_ptr> stmts;
+        ctx->push(&stmts);
+        ctx->current_block().induction_var = id;
+        body(iter);
+        ctx->pop();
+
+        for_stmt->body = block(stmts);
+        ctx->add(statement_ptr(for_stmt));
+    };
+
+    // Same as above for constant bounds, without a loop for a single iteration.
+
+    auto range = [&](int begin, int end, int step,
+                     const std::function<void(expression_ptr)> & body)
+    {
+        if (end - begin <= 0)
+            return;
+        if (end - begin <= step)
+            body(literal(begin));
+        else
+            loop(literal(begin), literal(end), step, body);
+    };
+
+    // Computes a block of elements starting at given row and column.
+
+    auto kernel = [&](expression_ptr row, expression_ptr col, int rows, int cols)
+    {
+        vector<expression_ptr> accumulators;
+
+        m_current_stmt = c.init.get();
+
+        for (int r = 0; r < rows; ++r)
+        {
+            for (int cl = 0; cl < cols; ++cl)
+            {
+                auto index = stmt_index(offset(row, r), offset(col, cl),
+                                        literal(c.reduction_begin));
+                auto value = generate_expression(init->value, index, ctx);
+                string id = ctx->new_var_id();
+                ctx->add(decl_expr(type_for(type), id, value));
+                accumulators.push_back(make_id(id));
+            }
+        }
+
+        m_current_stmt = c.update.get();
+
+        range(c.reduction_begin + 1, c.reduction_end + 1, 1, [&](expression_ptr k)
+        {
+            for (int r = 0; r < rows; ++r)
+            {
+                for (int cl = 0; cl < cols; ++cl)
+                {
+                    auto acc = accumulators[r * cols + cl];
+                    auto index = stmt_index(offset(row, r), offset(col, cl), k);
+                    m_accumulator = c.accumulator.get();
+                    m_accumulator_value = acc;
+                    auto value = generate_expression(update->value, index, ctx);
+                    m_accumulator = nullptr;
+                    ctx->add(binop(op::assign, acc, value));
+                }
+            }
+        });
+
+        for (int r = 0; r < rows; ++r)
+        {
+            for (int cl = 0; cl < cols; ++cl)
+            {
+                auto acc = accumulators[r * cols + cl];
+                auto index = stmt_index(offset(row, r), offset(col, cl),
+                                        literal(c.reduction_end));
+                auto dest = generate_expression(update->destination, index, ctx);
+                ctx->add(binop(op::assign, dest, acc));
+            }
+        }
+    };
+
+    int row_begin = c.row_dim >= 0 ? c.row_begin : 0;
+    int col_begin = c.col_dim >= 0 ? c.col_begin : 0;
+    int full_rows_end = row_begin + full_rows;
+    int full_cols_end = col_begin + full_cols;
+
+    // Full blocks
+
+    auto blocks = [&](expression_ptr tile_begin, expression_ptr tile_end)
+    {
+        range(row_begin, full_rows_end, block_rows, [&](expression_ptr row)
+        {
+            if (tile_cols >= full_cols)
+            {
+                range(col_begin, full_cols_end, block_cols, [&](expression_ptr col)
+                {
+                    kernel(row, col, block_rows, block_cols);
+                });
+            }
+            else
+            {
+                loop(tile_begin, tile_end, block_cols, [&](expression_ptr col)
+                {
+                    kernel(row, col, block_rows, block_cols);
+                });
+            }
+        });
+    };
+
+    if (tile_cols >= full_cols)
+    {
+        blocks(nullptr, nullptr);
+    }
+    else
+    {
+        loop(literal(col_begin), literal(full_cols_end), tile_cols, [&](expression_ptr tile)
+        {
+            auto tile_end = call(make_id("min"), { binop(op::add, tile, literal(tile_cols)),
+                                                   literal(full_cols_end) });
+            blocks(tile, tile_end);
+        });
+    }
+
+    // Remaining elements, one at a time
+
+    range(full_rows_end, row_begin + row_count, 1, [&](expression_ptr row)
+    {
+        range(col_begin, col_begin + col_count, 1, [&](expression_ptr col)
+        {
+            kernel(row, col, 1, 1);
+        });
+    });
+
+    range(row_begin, full_rows_end, 1, [&](expression_ptr row)
+    {
+        range(full_cols_end, col_begin + col_count, 1, [&](expression_ptr col)
+        {
+            kernel(row, col, 1, 1);
+        });
+    });
+
+    m_current_stmt = nullptr;
+}
+
+// Combination of two values of same type by an associative operation.
+
+static expression_ptr combine(primitive_op kind, expression_ptr a, expression_ptr b)
+{
+    switch(kind)
+    {
+    case primitive_op::add:
+        return binop(op::add, a, b);
+    case primitive_op::multiply:
+        return binop(op::mult, a, b);
+    case primitive_op::min:
+        return call(make_id("min"), { a, b });
+    case primitive_op::max:
+        return call(make_id("max"), { a, b });
+    case primitive_op::bitwise_and:
+        return binop(op::bit_and, a, b);
+    case primitive_op::bitwise_or:
+        return binop(op::bit_or, a, b);
+    case primitive_op::bitwise_xor:
+        return binop(op::bit_xor, a, b);
+    default:
+        throw error("Unexpected reduction operation.");
+    }
+}
+
+// Computes all elements of a reduction or scan for given batch dimensions,
+// combining values in a different order than the statements.
+//
+// A reduction combines values in independent chains of 4 values
+// or SIMD vectors (if vectorizing), and in chunks distributed over threads
+// (if parallel and large enough), with chains and chunks combined at the end.
+// Only the last element along the reduction dimension is stored.
+//
+// A scan (if parallel and large enough) first combines values in each chunk
+// like a reduction, then combines the chunks in order,
+// then computes and stores all elements of each chunk
+// starting with the combination of preceding chunks.
+// Otherwise, it is computed sequentially, like the statements.
+
+void cpp_from_polyhedral::generate_accumulation
+(const polyhedral::reduction & r, const index_type & batch,
+ bool may_parallelize, bool is_scan, builder * ctx)
+{
+    auto init = dynamic_cast<polyhedral::assignment*>(r.init->expr.get());
+    auto update = dynamic_cast<polyhedral::assignment*>(r.update->expr.get());
+    assert_or_throw(init && update);
+    assert_or_throw(batch.size() == r.batch_dims.size());
+
+    auto combination = dynamic_cast<functional::primitive*>(update->value.get());
+    assert_or_throw(combination && combination->operands.size() == 2);
+
+    // Operand other than the previous element.
+
+    functional::expr_ptr term = combination->operands[0];
+    {
+        auto self = dynamic_cast<polyhedral::array_access*>(term.get());
+        if (self && self->array == r.accumulator)
+            term = combination->operands[1];
+    }
+
+    auto type = r.accumulator->type;
+    auto type_ptr = type_for(type);
+    int dim_count = r.update->domain.dimensions();
+
+    auto stmt_index = [&](expression_ptr k)
+    {
+        index_type index(dim_count);
+        for (int i = 0; i < (int) batch.size(); ++i)
+            index[r.batch_dims[i]] = batch[i];
+        index[r.reduction_dim] = k;
+        return index;
+    };
+
+    auto value_at = [&](expression_ptr k)
+    {
+        auto value = generate_expression(term, stmt_index(k), ctx);
+        return to_type(value, prim_type(term), type);
+    };
+
+    auto nested = [&](const std::function<void()> & body)
+    {
+        vector<statement_ptr> stmts;
+        ctx->push(&stmts);
+        body();
+        ctx->pop();
+        return block(stmts);
+    };
+
+    // Combines values at [begin, end) into 'acc', advancing 'k'.
+
+    bool vector_math = m_math == compiler::math_type::vector;
+    bool vectorize = m_vectorize && is_real(type) &&
+            (r.op == primitive_op::add || r.op == primitive_op::multiply ||
+             r.op == primitive_op::min || r.op == primitive_op::max) &&
+            is_vectorizable(term, type, vector_math) &&
+            can_select_conditionals(term, r.update.get());
+
+    auto accumulate = [&](expression_ptr begin, expression_ptr end, expression_ptr acc)
+    {
+        string k_id = ctx->new_var_id();
+        auto k = make_id(k_id);
+        ctx->add(decl_expr(int_type(), k_id, begin));
+
+        statement_ptr chains;
+
+        if (vectorize)
+        {
+            string vec_type = "arrp::simd::vec<" + type_name_for(type) + ">";
+            auto width = make_id(vec_type + "::width");
+            auto vec_type_ptr = make_shared<basic_type>(vec_type);
+
+            auto vector_value_at = [&](expression_ptr k) -> expression_ptr
+            {
+                m_select_conditionals = true;
+                auto value = generate_expression(term, stmt_index(k), ctx);
+                m_select_conditionals = false;
+                return vectorized(value, k_id, vec_type);
+            };
+
+            bool ok = true;
+            chains = nested([&]()
+            {
+                string v_id = ctx->new_var_id();
+                auto v = make_id(v_id);
+                auto first = vector_value_at(k);
+                ok &= first != nullptr;
+                ctx->add(decl_expr(vec_type_ptr, v_id, first));
+
+                auto loop = make_shared<for_statement>();
+                loop->initialization = binop(op::assign_add, k, width);
+                loop->condition = binop(op::lesser_or_equal, binop(op::add, k, width), end);
+                loop->update = binop(op::assign_add, k, width);
+                loop->body = nested([&]()
+                {
+                    ctx->current_block().induction_var = k_id;
+                    auto next = vector_value_at(k);
+                    ok &= next != nullptr;
+                    ctx->add(assign(v, combine(r.op, v, next)));
+                });
+                ctx->add(statement_ptr(loop));
+
+                string reduce_name;
+                switch(r.op)
+                {
+                case primitive_op::add: reduce_name = "reduce_add"; break;
+                case primitive_op::multiply: reduce_name = "reduce_mul"; break;
+                case primitive_op::min: reduce_name = "reduce_min"; break;
+                default: reduce_name = "reduce_max";
+                }
+
+                ctx->add(assign(acc, combine(r.op, acc, call(make_id(reduce_name), { v }))));
+            });
+
+            if (ok)
+            {
+                auto cond = binop(op::greater_or_equal, binop(op::sub, end, k), width);
+                ctx->add(make_shared<if_statement>(cond, chains, nullptr));
+            }
+            else
+            {
+                chains = nullptr;
+            }
+        }
+
+        if (!chains)
+        {
+            const int chain_count = 4;
+
+            chains = nested([&]()
+            {
+                vector<expression_ptr> partial;
+                for (int i = 0; i < chain_count; ++i)
+                {
+                    string id = ctx->new_var_id();
+                    auto value = value_at(i ? binop(op::add, k, literal(i)) : k);
+                    ctx->add(decl_expr(type_ptr, id, value));
+                    partial.push_back(make_id(id));
+                }
+
+                auto loop = make_shared<for_statement>();
+                loop->initialization = binop(op::assign_add, k, literal(chain_count));
+                loop->condition = binop(op::lesser_or_equal,
+                                        binop(op::add, k, literal(chain_count)), end);
+                loop->update = binop(op::assign_add, k, literal(chain_count));
+                loop->body = nested([&]()
+                {
+                    ctx->current_block().induction_var = k_id;
+                    for (int i = 0; i < chain_count; ++i)
+                    {
+                        auto value = value_at(i ? binop(op::add, k, literal(i)) : k);
+                        ctx->add(assign(partial[i], combine(r.op, partial[i], value)));
+                    }
+                });
+                ctx->add(statement_ptr(loop));
+
+                auto sum = combine(r.op, combine(r.op, partial[0], partial[1]),
+                                   combine(r.op, partial[2], partial[3]));
+                ctx->add(assign(acc, combine(r.op, acc, sum)));
+            });
+
+            auto cond = binop(op::greater_or_equal, binop(op::sub, end, k), literal(chain_count));
+            ctx->add(make_shared<if_statement>(cond, chains, nullptr));
+        }
+
+        // Remaining values
+
+        string j_id = ctx->new_var_id();
+        auto j = make_id(j_id);
+        auto loop = make_shared<for_statement>();
+        loop->initialization = decl_expr(int_type(), j_id, k);
+        loop->condition = binop(op::lesser, j, end);
+        loop->update = unop(op::pre_incr, j);
+        loop->body = nested([&]()
+        {
+            ctx->current_block().induction_var = j_id;
+            ctx->add(assign(acc, combine(r.op, acc, value_at(j))));
+        });
+        ctx->add(statement_ptr(loop));
+    };
+
+    auto store = [&](expression_ptr k, expression_ptr value)
+    {
+        auto dest = generate_expression(update->destination, stmt_index(k), ctx);
+        ctx->add(assign(dest, value));
+    };
+
+    // Scans values at [begin, end) starting with 'run', storing each result.
+
+    auto scan_range = [&](expression_ptr begin, expression_ptr end, expression_ptr run)
+    {
+        string k_id = ctx->new_var_id();
+        auto k = make_id(k_id);
+        auto loop = make_shared<for_statement>();
+        loop->initialization = decl_expr(int_type(), k_id, begin);
+        loop->condition = binop(op::lesser, k, end);
+        loop->update = unop(op::pre_incr, k);
+        loop->body = nested([&]()
+        {
+            ctx->current_block().induction_var = k_id;
+            ctx->add(assign(run, combine(r.op, run, value_at(k))));
+            store(k, run);
+        });
+        ctx->add(statement_ptr(loop));
+    };
+
+    // Initial value
+
+    string acc_id = ctx->new_var_id();
+    auto acc = make_id(acc_id);
+
+    m_current_stmt = r.init.get();
+    {
+        auto index = stmt_index(literal(r.reduction_begin));
+        auto value = generate_expression(init->value, index, ctx);
+        value = to_type(value, prim_type(init->value), type);
+        ctx->add(decl_expr(type_ptr, acc_id, value));
+        if (is_scan)
+            ctx->add(assign(generate_expression(init->destination, index, ctx), acc));
+    }
+
+    m_current_stmt = r.update.get();
+
+    int begin = r.reduction_begin + 1;
+    int end = r.reduction_end + 1;
+    int count = end - begin;
+
+    // Parallel chunks are large enough to amortize distribution over threads.
+    const int min_parallel_count = 16 * 1024;
+    const int max_chunk_count = 64;
+
+    if (may_parallelize && m_parallel_reductions && count >= min_parallel_count)
+    {
+        int chunk_size = (count + max_chunk_count - 1) / max_chunk_count;
+        int chunk_count = (count + chunk_size - 1) / chunk_size;
+
+        // Loop over chunks [b, e) distributed over threads.
+
+        auto chunk_loop = [&](const std::function<void(expression_ptr c,
+                                                       expression_ptr b,
+                                                       expression_ptr e)> & chunk_body)
+        {
+            string c_id = ctx->new_var_id();
+            auto c = make_id(c_id);
+
+            auto body = nested([&]()
+            {
+                ctx->current_block().induction_var = c_id;
+
+                string b_id = ctx->new_var_id();
+                auto b = make_id(b_id);
+                ctx->add(decl_expr(int_type(), b_id,
+                                   binop(op::add, literal(begin),
+                                         binop(op::mult, c, literal(chunk_size)))));
+
+                auto e = call(make_id("min"), { binop(op::add, b, literal(chunk_size)),
+                                                literal(end) });
+
+                chunk_body(c, b, e);
+            });
+
+            if (m_parallel_pool)
+            {
+                auto loop = make_shared<pool_for_statement>();
+                loop->pool = m_parallel_pool;
+                loop->iterator = c_id;
+                loop->begin = literal(0);
+                loop->end = literal(chunk_count);
+                loop->body = static_pointer_cast<block_statement>(body);
+                ctx->add(statement_ptr(loop));
+            }
+            else
+            {
+                auto loop = make_shared<for_statement>();
+                loop->initialization = decl_expr(int_type(), c_id, literal(0));
+                loop->condition = binop(op::lesser, c, literal(chunk_count));
+                loop->update = unop(op::pre_incr, c);
+                loop->body = body;
+                loop->is_parallel = true;
+                ctx->add(statement_ptr(loop));
+            }
+        };
+
+        string partials_id = ctx->new_var_id();
+        auto partials = make_id(partials_id);
+        ctx->add(make_shared<var_decl_expression>
+                 (make_shared<array_decl>(type_ptr, partials_id, vector<int>{ chunk_count })));
+
+        auto partial = [&](expression_ptr c) -> expression_ptr
+        {
+            return make_shared<array_access_expression>(partials, vector<expression_ptr>{ c });
+        };
+
+        // Combine values in each chunk.
 
-static expression_ptr to_complex64(expression_ptr e, primitive_type t)
-{
-    if (t == primitive_type::complex64)
-        return e;
+        chunk_loop([&](expression_ptr c, expression_ptr b, expression_ptr e)
+        {
+            string p_id = ctx->new_var_id();
+            auto p = make_id(p_id);
+            ctx->add(decl_expr(type_ptr, p_id, value_at(b)));
 
-    auto f = make_id("complex<double>");
+            accumulate(binop(op::add, b, literal(1)), e, p);
 
-    if (t == primitive_type::complex32)
-        return call(f, {e});
-    else
-        return call(f, {e, literal((double)0)});
-}
-#if 0
-static expression_ptr to_complex32(expression_ptr e, primitive_type t)
-{
-    if (t == primitive_type::complex32)
-        return e;
+            ctx->add(assign(partial(c), p));
+        });
 
-    auto f = make_id("complex<float>");
+        // Combine chunks in order, independent of number of threads.
+        // For a scan, replace each chunk by the combination of preceding values.
 
-    if (t == primitive_type::complex64)
-        return call(f, {e});
-    else
-        return call(f, {e, literal((double)0)});
-}
-#endif
+        string i_id = ctx->new_var_id();
+        auto i = make_id(i_id);
+        auto loop = make_shared<for_statement>();
+        loop->initialization = decl_expr(int_type(), i_id, literal(0));
+        loop->condition = binop(op::lesser, i, literal(chunk_count));
+        loop->update = unop(op::pre_incr, i);
+        loop->body = nested([&]()
+        {
+            if (is_scan)
+            {
+                string p_id = ctx->new_var_id();
+                auto p = make_id(p_id);
+                ctx->add(decl_expr(type_ptr, p_id, partial(i)));
+                ctx->add(assign(partial(i), acc));
+                ctx->add(assign(acc, combine(r.op, acc, p)));
+            }
+            else
+            {
+                ctx->add(assign(acc, combine(r.op, acc, partial(i))));
+            }
+        });
+        ctx->add(statement_ptr(loop));
 
-static expression_ptr to_real64(expression_ptr e, primitive_type t)
-{
-    if (t == primitive_type::real64)
-        return e;
-    else
-        return cast(double_type(), e);
-}
+        // Scan each chunk starting with combination of preceding values.
 
-static expression_ptr to_real32(expression_ptr e, primitive_type t)
-{
-    if (t == primitive_type::real32)
-        return e;
+        if (is_scan)
+        {
+            chunk_loop([&](expression_ptr c, expression_ptr b, expression_ptr e)
+            {
+                string run_id = ctx->new_var_id();
+                auto run = make_id(run_id);
+                ctx->add(decl_expr(type_ptr, run_id, partial(c)));
+                scan_range(b, e, run);
+            });
+        }
+    }
+    else if (is_scan)
+    {
+        scan_range(literal(begin), literal(end), acc);
+    }
     else
-        return cast(float_type(), e);
+    {
+        accumulate(literal(begin), literal(end), acc);
+    }
+
+    if (!is_scan)
+        store(literal(r.reduction_end), acc);
+
+    m_current_stmt = nullptr;
 }
 
-static expression_ptr to_type(expression_ptr e, primitive_type a, primitive_type r)
+// Expression that can be used more than once,
+// a temporary variable unless trivial.
+
+static expression_ptr reusable(expression_ptr e, primitive_type t, builder * ctx)
 {
-    if (a == r)
+    if (!e ||
+            dynamic_pointer_cast<id_expression>(e) ||
+            dynamic_pointer_cast<literal_expression<float>>(e) ||
+            dynamic_pointer_cast<literal_expression<double>>(e) ||
+            dynamic_pointer_cast<array_access_expression>(e))
         return e;
 
-    return cast(type_for(r), e);
+    string id = ctx->new_var_id();
+    ctx->add(decl_expr(type_for(t), id, e));
+    return make_id(id);
 }
 
-void cpp_from_polyhedral::generate_statement
-(const string & name, const index_type & index, builder* ctx)
+static expression_ptr member_call(expression_ptr object, const string & name)
 {
-    auto stmt_ref = std::find_if(m_model.statements.begin(), m_model.statements.end(),
-                                 [&](polyhedral::stmt_ptr s){ return s->name == name; });
-
-    if (stmt_ref == m_model.statements.end())
-        return;
-
-    generate_statement((*stmt_ref).get(), index, ctx);
+    return call(binop(op::member_of_reference, object, make_id(name)), {});
 }
 
-void cpp_from_polyhedral::generate_statement
-(polyhedral::statement *stmt, const index_type & index, builder* ctx)
+// Element of a plane of a buffer with split complex parts.
+
+static expression_ptr buffer_plane(expression_ptr element, int plane)
 {
-    m_current_stmt = stmt;
+    vector<expression_ptr> index { literal(plane) };
 
-    auto expr = generate_expression(stmt->expr, index, ctx);
+    if (auto access = dynamic_pointer_cast<array_access_expression>(element))
+    {
+        index.insert(index.end(), access->index.begin(), access->index.end());
+        return make_shared<array_access_expression>(access->id, index);
+    }
 
-    ctx->add(expr);
+    return make_shared<array_access_expression>(element, index);
 }
 
 expression_ptr cpp_from_polyhedral::generate_expression
@@ -121,6 +1426,9 @@ expression_ptr cpp_from_polyhedral::generate_expression
     }
     else if (auto access = dynamic_cast<polyhedral::array_access*>(expr.get()))
     {
+        if (access->array.get() == m_accumulator)
+            return m_accumulator_value;
+
         index_type target_index;
         for (auto & e : access->indexes)
             target_index.push_back(generate_expression(e, index, ctx));
@@ -170,6 +1478,9 @@ expression_ptr cpp_from_polyhedral::generate_expression
     }
     else if (auto call = dynamic_cast<polyhedral::external_call*>(expr.get()))
     {
+        if (m_block_io && m_current_stmt->is_input_or_output && m_current_stmt->is_infinite)
+            return generate_block_io(call, index, ctx);
+
         vector<expression_ptr> args;
         for (auto & arg : call->args)
             args.push_back(generate_expression(arg, index, ctx));
@@ -181,6 +1492,10 @@ expression_ptr cpp_from_polyhedral::generate_expression
     }
     else if (auto assign = dynamic_cast<polyhedral::assignment*>(expr.get()))
     {
+        if (m_complex != compiler::complex_type::standard &&
+                is_complex(prim_type(assign->destination)))
+            return generate_complex_assignment(assign, index, ctx);
+
         auto dest = generate_expression(assign->destination, index, ctx);
         auto value = generate_expression(assign->value, index, ctx);
         auto store = make_shared<bin_op_expression>(op::assign, dest, value);
@@ -197,6 +1512,54 @@ expression_ptr cpp_from_polyhedral::generate_expression
 expression_ptr cpp_from_polyhedral::generate_primitive
 (functional::primitive * expr, const index_type & index, builder * ctx)
 {
+    if (m_complex != compiler::complex_type::standard)
+    {
+        auto r_t = prim_type(expr);
+
+        if (is_complex(r_t) && has_fast_complex_lowering(expr))
+        {
+            auto part_t = complex_part_type(r_t);
+            auto parts = generate_complex_parts(expr, part_t, index, ctx);
+            if (!parts.imag)
+                parts.imag = to_type(literal(0), primitive_type::int32, part_t);
+            return call(make_id(type_name_for(r_t)), { parts.real, parts.imag });
+        }
+
+        if (expr->operands.size() == 1 && is_complex(prim_type(expr->operands[0])))
+        {
+            auto part_t = complex_part_type(prim_type(expr->operands[0]));
+
+            switch(expr->kind)
+            {
+            case primitive_op::real:
+            {
+                auto parts = generate_complex_parts(expr->operands[0], part_t, index, ctx);
+                return parts.real;
+            }
+            case primitive_op::imag:
+            {
+                auto parts = generate_complex_parts(expr->operands[0], part_t, index, ctx);
+                if (!parts.imag)
+                    return to_type(literal(0), primitive_type::int32, part_t);
+                return parts.imag;
+            }
+            case primitive_op::abs:
+            {
+                // Without scaling to avoid overflow.
+                auto parts = generate_complex_parts(expr->operands[0], part_t, index, ctx);
+                auto re = reusable(parts.real, part_t, ctx);
+                if (!parts.imag)
+                    return call(make_id("abs"), { re });
+                auto im = reusable(parts.imag, part_t, ctx);
+                auto sum = binop(op::add, binop(op::mult, re, re), binop(op::mult, im, im));
+                return call(make_id("sqrt"), { sum });
+            }
+            default:
+                break;
+            }
+        }
+    }
+
     switch(expr->kind)
     {
     case primitive_op::logic_and:
@@ -213,6 +1576,18 @@ expression_ptr cpp_from_polyhedral::generate_primitive
     }
     case primitive_op::conditional:
     {
+        if (m_select_conditionals || is_cheap_select(expr))
+        {
+            // Both arms are evaluated.
+            auto r_t = prim_type(expr);
+            auto condition_expr = generate_expression(expr->operands[0], index, ctx);
+            auto true_expr = generate_expression(expr->operands[1], index, ctx);
+            auto false_expr = generate_expression(expr->operands[2], index, ctx);
+            true_expr = to_type(true_expr, prim_type(expr->operands[1]), r_t);
+            false_expr = to_type(false_expr, prim_type(expr->operands[2]), r_t);
+            return make_shared<if_expression>(condition_expr, true_expr, false_expr);
+        }
+
         string id;
         auto type = type_for(prim_type(expr));
         ctx->add(make_shared<expr_statement>(ctx->new_var(type, id)));
@@ -363,7 +1738,7 @@ expression_ptr cpp_from_polyhedral::generate_primitive
     }
     case primitive_op::raise:
     {
-        return make_shared<call_expression>("pow", operands[0], operands[1]);
+        return generate_math_call(expr, "pow", operands);
     }
     case primitive_op::floor:
     {
@@ -397,24 +1772,24 @@ expression_ptr cpp_from_polyhedral::generate_primitive
     }
     case primitive_op::log:
     {
-        return make_shared<call_expression>("log", operands[0]);
+        return generate_math_call(expr, "log", operands);
     }
     case primitive_op::log2:
     {
-        return make_shared<call_expression>("log2", operands[0]);
+        return generate_math_call(expr, "log2", operands);
     }
     case primitive_op::log10:
     {
-        return make_shared<call_expression>("log10", operands[0]);
+        return generate_math_call(expr, "log10", operands);
     }
     case primitive_op::exp:
     {
-        return make_shared<call_expression>("exp", operands[0]);
+        return generate_math_call(expr, "exp", operands);
     }
     case primitive_op::exp2:
     {
         auto arg_t = prim_type(expr->operands[0]);
-        expression_ptr result = make_shared<call_expression>("exp2", operands[0]);
+        expression_ptr result = generate_math_call(expr, "exp2", operands);
         if (is_integer(arg_t))
             result = cast(type_for(arg_t), result);
         return result;
@@ -425,15 +1800,15 @@ expression_ptr cpp_from_polyhedral::generate_primitive
     }
     case primitive_op::sin:
     {
-        return make_shared<call_expression>("sin", operands[0]);
+        return generate_math_call(expr, "sin", operands);
     }
     case primitive_op::cos:
     {
-        return make_shared<call_expression>("cos", operands[0]);
+        return generate_math_call(expr, "cos", operands);
     }
     case primitive_op::tan:
     {
-        return make_shared<call_expression>("tan", operands[0]);
+        return generate_math_call(expr, "tan", operands);
     }
     case primitive_op::asin:
     {
@@ -545,8 +1920,258 @@ expression_ptr cpp_from_polyhedral::generate_primitive
     }
 }
 
+// Elementary function on real numbers in generated code,
+// from arrp/math.hpp unless standard implementation is requested.
+
+expression_ptr cpp_from_polyhedral::generate_math_call
+(functional::primitive * expr, const string & name, const vector<expression_ptr> & args)
+{
+    auto r_t = prim_type(expr);
+
+    bool is_real = r_t == primitive_type::real32 || r_t == primitive_type::real64;
+    for (auto & operand : expr->operands)
+    {
+        if (is_complex(prim_type(operand)))
+            is_real = false;
+    }
+
+    if (m_math == compiler::math_type::standard || !is_real)
+        return call(make_id(name), args);
+
+    // Explicit type converts integer arguments.
+    string qualified_name = "arrp::math::" + name + "<" + type_name_for(r_t) + ">";
+    return call(make_id(qualified_name), args);
+}
+
+bool cpp_from_polyhedral::has_fast_complex_lowering(functional::primitive * expr)
+{
+    switch(expr->kind)
+    {
+    case primitive_op::add:
+    case primitive_op::subtract:
+    case primitive_op::multiply:
+    case primitive_op::divide:
+    case primitive_op::negate:
+        return true;
+    case primitive_op::conditional:
+        return m_select_conditionals || is_cheap_select(expr);
+    default:
+        return false;
+    }
+}
+
+// Complex arithmetic on real and imaginary parts,
+// without special handling of infinity and NaN.
+// Parts are converted to the given type.
+
+cpp_from_polyhedral::complex_parts
+cpp_from_polyhedral::generate_complex_parts
+(functional::expr_ptr expr, primitive_type t, const index_type & index, builder * ctx)
+{
+    auto type = prim_type(expr);
+
+    if (!is_complex(type))
+    {
+        auto value = generate_expression(expr, index, ctx);
+        return { to_type(value, type, t), nullptr };
+    }
+
+    auto converted = [&](complex_parts parts, primitive_type part_t) -> complex_parts
+    {
+        return { to_type(parts.real, part_t, t), to_type(parts.imag, part_t, t) };
+    };
+
+    auto zero_if_null = [&](expression_ptr e) -> expression_ptr
+    {
+        return e ? e : to_type(literal(0), primitive_type::int32, t);
+    };
+
+    if (auto access = dynamic_cast<polyhedral::array_access*>(expr.get()))
+    {
+        index_type target_index;
+        for (auto & e : access->indexes)
+            target_index.push_back(generate_expression(e, index, ctx));
+
+        auto element = generate_buffer_element(access->array, target_index, ctx);
+
+        complex_parts parts;
+        if (m_buffers.at(access->array->name).is_split_complex)
+            parts = { buffer_plane(element, 0), buffer_plane(element, 1) };
+        else
+            parts = { member_call(element, "real"), member_call(element, "imag") };
+
+        return converted(parts, complex_part_type(type));
+    }
+    else if (auto c = dynamic_cast<functional::complex_const*>(expr.get()))
+    {
+        if (t == primitive_type::real32)
+            return { literal((float)c->value.real()), literal((float)c->value.imag()) };
+        else
+            return { literal(c->value.real()), literal(c->value.imag()) };
+    }
+    else if (auto prim = dynamic_cast<functional::primitive*>(expr.get()))
+    {
+        switch(prim->kind)
+        {
+        case primitive_op::add:
+        case primitive_op::subtract:
+        {
+            auto o = prim->kind == primitive_op::add ? op::add : op::sub;
+            auto a = generate_complex_parts(prim->operands[0], t, index, ctx);
+            auto b = generate_complex_parts(prim->operands[1], t, index, ctx);
+
+            complex_parts r;
+            r.real = binop(o, a.real, b.real);
+            if (a.imag && b.imag)
+                r.imag = binop(o, a.imag, b.imag);
+            else if (a.imag)
+                r.imag = a.imag;
+            else if (b.imag)
+                r.imag = o == op::add ? b.imag : unop(op::u_minus, b.imag);
+            return r;
+        }
+        case primitive_op::multiply:
+        {
+            auto a = generate_complex_parts(prim->operands[0], t, index, ctx);
+            auto b = generate_complex_parts(prim->operands[1], t, index, ctx);
+
+            if (!a.imag && !b.imag)
+                return { binop(op::mult, a.real, b.real), nullptr };
+
+            if (!a.imag || !b.imag)
+            {
+                if (!a.imag)
+                    std::swap(a, b);
+                // Multiply by real number b.
+                auto br = reusable(b.real, t, ctx);
+                return { binop(op::mult, a.real, br), binop(op::mult, a.imag, br) };
+            }
+
+            auto ar = reusable(a.real, t, ctx);
+            auto ai = reusable(a.imag, t, ctx);
+            auto br = reusable(b.real, t, ctx);
+            auto bi = reusable(b.imag, t, ctx);
+
+            return { binop(op::sub, binop(op::mult, ar, br), binop(op::mult, ai, bi)),
+                     binop(op::add, binop(op::mult, ar, bi), binop(op::mult, ai, br)) };
+        }
+        case primitive_op::divide:
+        {
+            auto a = generate_complex_parts(prim->operands[0], t, index, ctx);
+            auto b = generate_complex_parts(prim->operands[1], t, index, ctx);
+
+            if (!b.imag)
+            {
+                auto br = reusable(b.real, t, ctx);
+                return { binop(op::div, a.real, br), a.imag ? binop(op::div, a.imag, br) : nullptr };
+            }
+
+            // a * conj(b) / |b|^2, without scaling.
+            auto ar = reusable(a.real, t, ctx);
+            auto ai = reusable(a.imag, t, ctx);
+            auto br = reusable(b.real, t, ctx);
+            auto bi = reusable(b.imag, t, ctx);
+            auto d = reusable(binop(op::add, binop(op::mult, br, br), binop(op::mult, bi, bi)), t, ctx);
+
+            expression_ptr re = binop(op::mult, ar, br);
+            expression_ptr im = unop(op::u_minus, binop(op::mult, ar, bi));
+            if (ai)
+            {
+                re = binop(op::add, re, binop(op::mult, ai, bi));
+                im = binop(op::sub, binop(op::mult, ai, br), binop(op::mult, ar, bi));
+            }
+
+            return { binop(op::div, re, d), binop(op::div, im, d) };
+        }
+        case primitive_op::negate:
+        {
+            auto a = generate_complex_parts(prim->operands[0], t, index, ctx);
+            return { unop(op::u_minus, a.real), a.imag ? unop(op::u_minus, a.imag) : nullptr };
+        }
+        case primitive_op::to_complex32:
+        case primitive_op::to_complex64:
+        {
+            return generate_complex_parts(prim->operands[0], t, index, ctx);
+        }
+        case primitive_op::conditional:
+        {
+            if (!has_fast_complex_lowering(prim))
+                break;
+
+            auto cond = generate_expression(prim->operands[0], index, ctx);
+            cond = reusable(cond, primitive_type::boolean, ctx);
+            auto a = generate_complex_parts(prim->operands[1], t, index, ctx);
+            auto b = generate_complex_parts(prim->operands[2], t, index, ctx);
+
+            complex_parts r;
+            r.real = make_shared<if_expression>(cond, a.real, b.real);
+            if (a.imag || b.imag)
+                r.imag = make_shared<if_expression>(cond, zero_if_null(a.imag), zero_if_null(b.imag));
+            return r;
+        }
+        default:
+            break;
+        }
+    }
+
+    // Other operations in standard complex arithmetic.
+
+    auto value = generate_expression(expr, index, ctx);
+
+    string id = ctx->new_var_id();
+    ctx->add(decl_expr(type_for(type), id, value));
+
+    complex_parts parts { member_call(make_id(id), "real"), member_call(make_id(id), "imag") };
+    return converted(parts, complex_part_type(type));
+}
+
+expression_ptr cpp_from_polyhedral::generate_complex_assignment
+(polyhedral::assignment * assign, const index_type & index, builder * ctx)
+{
+    auto access = dynamic_cast<polyhedral::array_access*>(assign->destination.get());
+    assert(access);
+
+    auto type = prim_type(assign->destination);
+    auto t = complex_part_type(type);
+
+    auto value = generate_complex_parts(assign->value, t, index, ctx);
+    if (!value.imag)
+        value.imag = to_type(literal(0), primitive_type::int32, t);
+
+    index_type target_index;
+    for (auto & e : access->indexes)
+        target_index.push_back(generate_expression(e, index, ctx));
+
+    auto dest = generate_buffer_element(access->array, target_index, ctx);
+
+    if (!m_buffers.at(access->array->name).is_split_complex)
+    {
+        auto complex_value = call(make_id(type_name_for(type)), { value.real, value.imag });
+        return binop(op::assign, dest, complex_value);
+    }
+
+    // The imaginary part may depend on the real part stored before it.
+    string imag_id = ctx->new_var_id();
+    ctx->add(decl_expr(type_for(t), imag_id, value.imag));
+
+    ctx->add(binop(op::assign, buffer_plane(dest, 0), value.real));
+    return binop(op::assign, buffer_plane(dest, 1), make_id(imag_id));
+}
+
 expression_ptr cpp_from_polyhedral::generate_buffer_access
 (polyhedral::array_ptr array, const index_type & index, builder * ctx)
+{
+    auto element = generate_buffer_element(array, index, ctx);
+
+    if (!m_buffers.at(array->name).is_split_complex)
+        return element;
+
+    auto complex_type = make_id(type_name_for(array->type));
+    return call(complex_type, { buffer_plane(element, 0), buffer_plane(element, 1) });
+}
+
+expression_ptr cpp_from_polyhedral::generate_buffer_element
+(polyhedral::array_ptr array, const index_type & index, builder * ctx)
 {
     index_type buffer_index = index;
     string array_name = m_name_mapper(array->name);
@@ -556,7 +2181,11 @@ expression_ptr cpp_from_polyhedral::generate_buffer_access
     expression_ptr buffer = make_shared<id_expression>(array_name);
 
     if (index.empty())
+    {
+        if (buffer_info.lanes > 1 && m_lane)
+            return make_shared<array_access_expression>(buffer, index_type{ m_lane });
         return buffer;
+    }
 
     // Add buffer phase
 
@@ -568,15 +2197,36 @@ expression_ptr cpp_from_polyhedral::generate_buffer_access
 
         expression_ptr & i = buffer_index[0];
         i = make_shared<bin_op_expression>(op::add, i, phase);
+
+        // The phase follows the first pipeline stage writing the array,
+        // and later stages lag behind by a period per stage.
+        int stage_distance = m_current_stmt->pipeline_stage - array->pipeline_stage;
+        if (stage_distance > 0)
+        {
+            int size = buffer_info.dimension_size[0];
+            int lag = (stage_distance * buffer_info.period_offset) % size;
+            if (lag)
+                i = binop(op::add, i, literal(size - lag));
+        }
+
+        // The phase of a mirrored buffer includes the first index accessed in period.
+        if (buffer_info.is_mirrored && array->first_period_access != 0)
+            i = binop(op::add, i, literal(-array->first_period_access));
     }
 
+    // Accesses with an offset are known to be within buffer bounds.
+    bool needs_wrapping = !(m_in_period && buffer_info.is_mirrored);
+
     if (m_in_period)
     {
         int offset = 0;
 
         auto stmt_offset = m_current_stmt->array_access_offset.find(array.get());
         if (stmt_offset != m_current_stmt->array_access_offset.end())
+        {
             offset += stmt_offset->second;
+            needs_wrapping = false;
+        }
 
         if (offset != 0)
         {
@@ -596,13 +2246,19 @@ expression_ptr cpp_from_polyhedral::generate_buffer_access
 
         expression_ptr i = buffer_index[dim];
 
-        if (buffer_info.dimension_needs_wrapping[dim])
+        if (buffer_info.dimension_needs_wrapping[dim] && (dim > 0 || needs_wrapping))
         {
             bool size_is_power_of_two =
                     buffer_size == (int)std::pow(2, (int)std::log2(buffer_size));
 
             // FIXME: use modulo instead of remainder
-            if (size_is_power_of_two)
+            if (dim == 0 && buffer_info.is_mirrored)
+            {
+                // Number of rows is chosen at run time.
+                auto rows = make_shared<id_expression>(m_name_mapper(array->name + ".rows"));
+                i = make_shared<bin_op_expression>(op::rem, i, rows);
+            }
+            else if (size_is_power_of_two)
             {
                 assert(buffer_size > 0);
                 auto mask = literal(buffer_size-1);
@@ -618,6 +2274,9 @@ expression_ptr cpp_from_polyhedral::generate_buffer_access
         compressed_index.push_back(i);
     }
 
+    if (buffer_info.lanes > 1 && m_lane)
+        compressed_index.push_back(m_lane);
+
     if (compressed_index.empty())
         return buffer;
 
@@ -641,6 +2300,89 @@ expression_ptr cpp_from_polyhedral::generate_buffer_access
     return buffer_elem;
 }
 
+expression_ptr cpp_from_polyhedral::generate_block_io
+(polyhedral::external_call * io_call, const index_type & index, builder * ctx)
+{
+    // Transfer between array buffer and I/O block.
+    // The block is transferred by the program as a whole,
+    // at the start of prelude and period for inputs,
+    // and at the end for outputs.
+
+    const polyhedral::io_channel * channel = nullptr;
+    bool is_input = false;
+
+    for (auto & in : m_model.inputs)
+    {
+        if (in.statement.get() == m_current_stmt)
+        {
+            channel = &in;
+            is_input = true;
+        }
+    }
+    for (auto & out : m_model.outputs)
+    {
+        if (out.statement.get() == m_current_stmt)
+            channel = &out;
+    }
+
+    assert_or_throw(channel != nullptr);
+    assert_or_throw(io_call->args.size() == 1);
+    assert_or_throw(index.size() == 1);
+
+    auto element = generate_expression(io_call->args[0], index, ctx);
+
+    int offset = m_in_period ? channel->period_offset : channel->prelude_offset;
+    int count = io_element_count(*channel);
+
+    expression_ptr block_index = binop(op::sub, index[0], literal(offset));
+    if (count > 1)
+        block_index = binop(op::mult, block_index, literal(count));
+
+    auto block = make_id(m_name_mapper(channel->name + ".io"));
+
+    if (count == 1)
+    {
+        auto block_element = make_shared<array_access_expression>
+                (block, index_type({ block_index }));
+
+        if (is_input)
+            return assign(element, block_element);
+        else
+            return assign(block_element, element);
+    }
+    else
+    {
+        auto block_data = binop(op::add, block, block_index);
+        auto element_data = cast(pointer(type_for(channel->array->type)),
+                                 unop(op::address, element));
+
+        if (is_input)
+            return call(make_id("std::copy_n"), { block_data, literal(count), element_data });
+        else
+            return call(make_id("std::copy_n"), { element_data, literal(count), block_data });
+    }
+}
+
+expression_ptr cpp_from_polyhedral::generate_io_buffer_slice
+(const polyhedral::io_channel & channel, builder * ctx)
+{
+    // Address of first element transferred by I/O channel
+    // in prelude or current period.
+
+    m_current_stmt = channel.statement.get();
+
+    int offset = m_in_period ? channel.period_offset : channel.prelude_offset;
+
+    bool move_code = m_move_loop_invariant_code;
+    m_move_loop_invariant_code = false;
+
+    auto element = generate_buffer_access(channel.array, { literal(offset) }, ctx);
+
+    m_move_loop_invariant_code = move_code;
+
+    return cast(pointer(type_for(channel.array->type)), unop(op::address, element));
+}
+
 expression_ptr
 cpp_from_polyhedral::generate_buffer_phase
 (const string & id, builder * ctx)
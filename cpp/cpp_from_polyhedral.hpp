@@ -57,11 +57,66 @@ public:
                             const index_type & index,
                             builder*);
 
+    // Generates statement for a vector of iterations of the given loop iterator.
+    // Returns the vector element type, or empty string if not possible.
+    string generate_vector_statement(const string & name,
+                                     const index_type & index,
+                                     const string & iterator,
+                                     builder*);
+
+    // Generates a statement updating a linear recurrence (see polyhedral::model)
+    // for a block of iterations of the given loop iterator.
+    // Returns the element type, or empty string if not possible.
+    string generate_recurrence_block(const string & name,
+                                     const index_type & index,
+                                     const string & iterator,
+                                     builder*);
+
+    // Generates a kernel computing a contraction
+    // for given values of its batch dimensions.
+    void generate_contraction(const polyhedral::contraction &,
+                              const index_type & batch,
+                              builder*);
+
+    // Generates a kernel computing a reduction
+    // for given values of its batch dimensions,
+    // using multiple threads if 'may_parallelize' is true.
+    void generate_reduction(const polyhedral::reduction & r,
+                            const index_type & batch,
+                            bool may_parallelize,
+                            builder * ctx)
+    { generate_accumulation(r, batch, may_parallelize, false, ctx); }
+
+    // Same as above, for a scan (all elements are stored).
+    void generate_scan(const polyhedral::reduction & r,
+                       const index_type & batch,
+                       bool may_parallelize,
+                       builder * ctx)
+    { generate_accumulation(r, batch, may_parallelize, true, ctx); }
+
     void set_in_period(bool flag) { m_in_period = flag; }
     void set_move_loop_invariant_code(bool flag) { m_move_loop_invariant_code = flag; }
+    void set_block_io(bool flag) { m_block_io = flag; }
+    void set_select_cost(int cost) { m_select_cost = cost; }
+    void set_math(compiler::math_type math) { m_math = math; }
+    void set_complex(compiler::complex_type type) { m_complex = type; }
+    void set_cache_size(int64_t l2) { m_cache_size = l2; }
+    void set_vectorize(bool flag) { m_vectorize = flag; }
+    void set_parallel_reductions(bool flag) { m_parallel_reductions = flag; }
+    // Run parallel reductions using a thread pool instead of OpenMP.
+    void set_parallel_pool(expression_ptr pool) { m_parallel_pool = pool; }
+    void set_direct_io(const unordered_set<const polyhedral::statement*> & stmts)
+    { m_direct_io = stmts; }
+    // Compute each statement for this many program instances.
+    void set_lanes(int lanes) { m_lanes = lanes; }
+    // Counters of instances computed, by statement name.
+    void set_instance_counters(const unordered_map<string, expression_ptr> & counters)
+    { m_instance_counters = counters; }
 
     expression_ptr generate_buffer_phase(const string & id, builder *);
 
+    expression_ptr generate_io_buffer_slice(const polyhedral::io_channel &, builder *);
+
 private:
 
     expression_ptr generate_expression
@@ -70,9 +125,41 @@ private:
     expression_ptr generate_primitive
     (functional::primitive*, const index_type&, builder*);
 
+    void generate_accumulation
+    (const polyhedral::reduction &, const index_type & batch,
+     bool may_parallelize, bool is_scan, builder*);
+
+    bool is_cheap_select(functional::primitive*);
+
+    expression_ptr generate_math_call
+    (functional::primitive*, const string & name, const vector<expression_ptr> & args);
+
     expression_ptr generate_buffer_access
     (polyhedral::array_ptr, const index_type&, builder*);
 
+    // Buffer element without splitting complex parts.
+    expression_ptr generate_buffer_element
+    (polyhedral::array_ptr, const index_type&, builder*);
+
+    // Real and imaginary part of a complex number.
+    // Imaginary part is null for real numbers.
+    struct complex_parts
+    {
+        expression_ptr real;
+        expression_ptr imag;
+    };
+
+    bool has_fast_complex_lowering(functional::primitive*);
+
+    complex_parts generate_complex_parts
+    (functional::expr_ptr, primitive_type part_type, const index_type&, builder*);
+
+    expression_ptr generate_complex_assignment
+    (polyhedral::assignment*, const index_type&, builder*);
+
+    expression_ptr generate_block_io
+    (polyhedral::external_call*, const index_type&, builder*);
+
     index_type mapped_index( const index_type & index,
                              const polyhedral::affine_matrix &,
                              builder * );
@@ -92,6 +179,25 @@ private:
     unordered_map<string,buffer> m_buffers;
     bool m_in_period = false;
     bool m_move_loop_invariant_code = false;
+    bool m_block_io = false;
+    // Generate all conditionals as select expressions.
+    bool m_select_conditionals = false;
+    // Max cost of conditional arms generated as select expressions.
+    int m_select_cost = 0;
+    compiler::math_type m_math = compiler::math_type::standard;
+    compiler::complex_type m_complex = compiler::complex_type::standard;
+    int64_t m_cache_size = 256 * 1024;
+    bool m_vectorize = false;
+    bool m_parallel_reductions = false;
+    expression_ptr m_parallel_pool;
+    // Reads of this array return the given value (used by kernels).
+    polyhedral::array * m_accumulator = nullptr;
+    expression_ptr m_accumulator_value;
+    unordered_set<const polyhedral::statement*> m_direct_io;
+    int m_lanes = 1;
+    // Index of program instance computed, if any.
+    expression_ptr m_lane;
+    unordered_map<string, expression_ptr> m_instance_counters;
     polyhedral::statement * m_current_stmt = nullptr;
     name_mapper & m_name_mapper;
 };
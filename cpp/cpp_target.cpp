@@ -26,11 +26,16 @@ along with this program; if not, write to the Free Software Foundation, Inc.,
 #include "../compiler/report.hpp"
 #include "../polyhedral/storage_alloc.hpp"
 
+#include <isl/ast.h>
+
 #include <unordered_map>
+#include <unordered_set>
 #include <algorithm>
 #include <iostream>
 #include <cmath>
 #include <cstdint>
+#include <fstream>
+#include <cstdlib>
 
 using namespace std;
 
@@ -139,17 +144,29 @@ func_sig_ptr signature_for(const string & name)
 }
 #endif
 
+// Type of elements of buffer in generated code.
+static primitive_type buffer_element_type(const buffer & buf)
+{
+    if (buf.is_split_complex)
+        return complex_part_type(buf.type);
+    return buf.type;
+}
+
 variable_decl_ptr buffer_decl(const buffer & buf,
                               name_mapper & namer, int alignment = 0)
 {
     assert(!buf.dimension_size.empty());
 
-    auto elem_type = type_for(buf.type);
+    auto elem_type = type_for(buffer_element_type(buf));
 
     vector<int> compressed_size;
+    if (buf.is_split_complex)
+        compressed_size.push_back(2);
     for (auto & s : buf.dimension_size)
         if (s != 1)
             compressed_size.push_back(s);
+    if (buf.lanes > 1)
+        compressed_size.push_back(buf.lanes);
 
     if (compressed_size.empty())
     {
@@ -231,6 +248,18 @@ shared_ptr<custom_decl> io_period_count_decl(const polyhedral::io_channel & io)
     return decl;
 }
 
+shared_ptr<custom_decl> io_prelude_count_decl(const polyhedral::io_channel & io)
+{
+    ostringstream text;
+    text << "static constexpr int ";
+    text << (io.name + "_prelude_size = ");
+    text << io.prelude_count * io_element_count(io);
+
+    auto decl = make_shared<custom_decl>();
+    decl->text = text.str();
+    return decl;
+}
+
 shared_ptr<custom_decl> io_latency_decl(const vector<polyhedral::io_channel> & channels)
 {
     ostringstream text;
@@ -248,249 +277,1296 @@ shared_ptr<custom_decl> io_latency_decl(const vector<polyhedral::io_channel> & c
     return decl;
 }
 
-class_node * state_type_def(const polyhedral::model & model,
-                            unordered_map<string,buffer> & buffers,
-                            name_mapper & namer,
-                            int data_alignment)
-{
-    auto def = new class_node(class_class, "program");
-    def->template_parameters.push_back("IO");
+// Array type suffix of buffer, starting at given dimension, e.g. "[4][8]".
+// Dimensions of size 1 are omitted, as in buffer_decl.
 
-    def->sections.resize(2);
-    def->sections[0].access = public_access;
-    def->sections[1].access = private_access;
+static string array_extent_text(const buffer & buf, int first_dim)
+{
+    ostringstream text;
+    if (first_dim == 0 && buf.is_split_complex)
+        text << "[2]";
+    for (int dim = first_dim; dim < buf.dimension_size.size(); ++dim)
+    {
+        if (buf.dimension_size[dim] != 1)
+            text << '[' << buf.dimension_size[dim] << ']';
+    }
+    if (buf.lanes > 1)
+        text << '[' << buf.lanes << ']';
+    return text.str();
+}
 
-    auto io_type = make_shared<basic_type>("IO");
+// Text of a constant element in C++.
 
-    auto & public_sec = def->sections[0];
+static string constant_text(double v, primitive_type t)
+{
+    if (t == primitive_type::boolean)
+        return v != 0 ? "true" : "false";
 
+    if (!is_real(t))
     {
-        public_sec.members.push_back(make_shared<data_field>(decl(pointer(io_type), "io")));
-
-        auto init_func =
-                make_shared<func_decl>(make_shared<func_signature>("prelude"));
-        public_sec.members.push_back(init_func);
-        auto proc_func =
-                make_shared<func_decl>(make_shared<func_signature>("period"));
-        public_sec.members.push_back(proc_func);
+        string text = to_string(int64_t(v));
+        if (t == primitive_type::uint32)
+            text += 'u';
+        return text;
     }
 
-    auto & private_sec = def->sections[1];
+    if (std::isnan(v))
+        return "NAN";
+    if (std::isinf(v))
+        return v < 0 ? "-INFINITY" : "INFINITY";
 
-    for (auto array : model.arrays)
-    {
-        const auto & buf = buffers.at(array->name);
-        if (buf.on_stack)
-            continue;
-        auto field = make_shared<data_field>(buffer_decl(buf,namer,data_alignment));
-        private_sec.members.push_back(field);
-    }
+    ostringstream text;
+    text.precision(t == primitive_type::real32 ? 9 : 17);
+    text << v;
+
+    string s = text.str();
+    if (s.find_first_of(".e") == string::npos)
+        s += ".0";
+    if (t == primitive_type::real32)
+        s += 'f';
+    return s;
+}
 
-    for (auto array : model.arrays)
+// Values of a table in C++, eight per line.
+
+static string table_values_text(const vector<double> & values, primitive_type t)
+{
+    ostringstream text;
+
+    for (int i = 0; i < (int) values.size(); ++i)
     {
-        if (!buffers.at(array->name).has_phase)
-            continue;
-        auto int_t = make_shared<basic_type>("int");
-        auto field = decl(int_t, namer(array->name + "_ph"));
-        field->value = literal((int)0);
-        private_sec.members.push_back(make_shared<data_field>(field));
+        if (i % 8 == 0)
+            text << endl << "  ";
+        else
+            text << ' ';
+        text << constant_text(values[i], t) << ',';
     }
 
-    return def;
+    return text.str();
 }
 
-unordered_map<string,buffer>
-buffer_analysis(const polyhedral::model & model, const compiler::options & opt)
+// Declares a table of values of a constant array,
+// with the same type as an array buffer would have:
+// static const float a[4][8] = { ... };
+
+static shared_ptr<custom_decl> constant_table_decl(const polyhedral::array & array,
+                                                   const buffer & buf,
+                                                   name_mapper & namer)
 {
-    using polyhedral::array;
+    auto elem_type = type_for(buf.type);
 
-    std::vector<array*> buffers_on_stack;
-    std::vector<array*> buffers_in_memory;
+    ostringstream text;
+    text << "static const " << elem_type->name << " " << namer(buf.name)
+         << array_extent_text(buf, 0) << " = {"
+         << table_values_text(array.constant_values, buf.type)
+         << endl << "}";
 
-    unordered_map<string,buffer> buffers;
+    auto decl = make_shared<custom_decl>();
+    decl->text = text.str();
+    return decl;
+}
 
-    for (const auto & array : model.arrays)
-    {
-        buffer buf;
+// Contents of buffers kept between periods at the end of prelude,
+// if the prelude was computed during compilation.
+// Elements are placed as by generate_buffer_element outside of period.
+// Returns false if the prelude must be executed instead.
 
-        buf.name = array->name;
+static bool prelude_images(const polyhedral::model & model,
+                           const unordered_map<string,buffer> & buffers,
+                           unordered_map<string, vector<double>> & images)
+{
+    if (!model.prelude_is_computed)
+        return false;
 
-        buf.type = array->type;
+    auto fail = [](const string & name, const string & reason)
+    {
+        cerr << "Warning: Prelude is executed instead of copied from image,"
+             << " because buffer '" << name << "' " << reason << "."
+             << endl;
+        return false;
+    };
 
-        buf.period_offset = array->period;
+    for (const auto & array : model.arrays)
+    {
+        if (array->prelude_writes.empty())
+            continue;
 
-        // Compute buffer size
+        const auto & buf = buffers.at(array->name);
+        if (buf.on_stack || buf.is_constant)
+            continue;
+        if (buf.is_mirrored)
+            return fail(array->name, "is mirrored");
+        if (buf.is_split_complex)
+            return fail(array->name, "has split complex storage");
+        if (buf.lanes > 1)
+            return fail(array->name, "has multiple lanes");
 
-        for(int dim = 0; dim < array->buffer_size.size(); ++dim)
-        {
-            int size = array->buffer_size[dim];
+        vector<double> image(buf.size, 0);
 
-            if (size <= 1)
+        // Later writes replace earlier ones in wrapped buffers.
+        for (const auto & write : array->prelude_writes)
+        {
+            int64_t offset = 0;
+            for (int dim = 0; dim < (int) buf.dimension_size.size(); ++dim)
             {
-                buf.dimension_size.push_back(size);
-                buf.dimension_needs_wrapping.push_back(false);
-                continue;
+                int size = buf.dimension_size[dim];
+                if (size == 1)
+                    continue;
+                int i = write.index[dim];
+                if (buf.dimension_needs_wrapping[dim])
+                    i %= size;
+                if (i < 0 || i >= size)
+                    return fail(array->name, "is written out of bounds");
+                offset = offset * size + i;
             }
+            image[offset] = write.value;
+        }
 
-            bool may_need_wrapping = false;
+        images.emplace(array->name, std::move(image));
+    }
 
-            if (dim == 0 && array->is_infinite)
-            {
-                if (opt.buffer_data_shifting)
-                {
-                    int period_size = array->last_period_access - array->first_period_access + 1;
-                    int period_overlap_size = array->last_period_access
-                            - (array->first_period_access + array->period)
-                            + 1;
+    return true;
+}
 
-                    if (period_overlap_size > 0)
-                    {
-                        // Shift at most 10% of accessed items per period, asymptotically.
+// Declares a table of contents of a buffer at the end of prelude:
+// static const float a_prelude[32] = { ... };
 
-                        // to_shift = overlap
-                        // shifted_per_period = to_shift / num_periods
-                        // num_periods = to_shift / shifted_per_period
-                        //             = overlap / shifted_per_period
+static shared_ptr<custom_decl> prelude_image_decl(const buffer & buf,
+                                                  const vector<double> & image,
+                                                  name_mapper & namer)
+{
+    auto elem_type = type_for(buf.type);
 
-                        int num_periods = std::ceil(period_overlap_size / (0.1 * period_size));
-                        num_periods = max(1, num_periods);
+    ostringstream text;
+    text << "static const " << elem_type->name << " " << namer(buf.name + ".prelude")
+         << '[' << image.size() << "] = {"
+         << table_values_text(image, buf.type)
+         << endl << "}";
 
-                        buf.data_shift.period_count = num_periods;
-                        buf.data_shift.size = period_overlap_size;
-                        buf.data_shift.source = array->first_period_access + num_periods * array->period;
+    auto decl = make_shared<custom_decl>();
+    decl->text = text.str();
+    return decl;
+}
 
-                        buf.has_phase = true;
+// Copies prelude images into buffers, instead of executing prelude.
 
-                        if (verbose<polyhedral::storage_output>::enabled())
-                        {
-                            auto & out = arrp::report()["storage"][array->name]["shift"];
-                            out["size"] = buf.data_shift.size;
-                            out["source"] = buf.data_shift.source;
-                            out["period-count"] = buf.data_shift.period_count;
-                        }
-                    }
-                    else
-                    {
-                        buf.data_shift.period_count = 1;
-                    }
+static void copy_prelude_images(const polyhedral::model & model,
+                                const unordered_map<string,buffer> & buffers,
+                                const unordered_map<string, vector<double>> & images,
+                                builder * ctx,
+                                name_mapper & namer)
+{
+    for (const auto & array : model.arrays)
+    {
+        auto image = images.find(array->name);
+        if (image == images.end())
+            continue;
 
-                    size = array->last_period_access
-                            + buf.data_shift.period_count * buf.period_offset
-                            + 1;
-                }
-                else
-                {
-                    may_need_wrapping = true;
+        const auto & buf = buffers.at(array->name);
 
-                    // Round to the next power of two, to avoid modulo when indexing
-                    if (opt.data_size_power_of_two)
-                        size = (int) pow(2, ceil(log2(size)));
+        auto table = make_id(namer(buf.name + ".prelude"));
+        auto dest = make_id(namer(buf.name));
 
-                    buf.has_phase = array->period % size != 0;
-                }
-            }
-            else
-            {
-                may_need_wrapping = array->size[dim] > size;
+        // Buffers with all dimensions of size 1 are declared as scalars.
+        if (all_of(buf.dimension_size.begin(), buf.dimension_size.end(),
+                   [](int s){ return s == 1; }))
+        {
+            auto first = make_shared<array_access_expression>
+                    (table, vector<expression_ptr>{ literal(0) });
+            ctx->add(binop(op::assign, dest, first));
+            continue;
+        }
 
-                // Round to the next power of two, to avoid modulo when indexing
-                if (may_need_wrapping && opt.data_size_power_of_two)
-                    size = (int) pow(2, ceil(log2(size)));
-            }
+        auto dest_address = cast(pointer(type_for(buf.type)), dest);
+        auto end = binop(op::add, table, literal((int) image->second.size()));
+        ctx->add(call(make_id("std::copy"), { table, end, dest_address }));
+    }
+}
 
-            buf.dimension_size.push_back(size);
-            buf.dimension_needs_wrapping.push_back(may_need_wrapping);
-        }
+// Declares memory of a mirrored buffer, the number of rows it holds,
+// and a pointer to it with the same type as an array buffer would have:
+// arrp::mirrored_buffer a_mem { row bytes, min rows };
+// const int a_rows = a_mem.rows();
+// float (*a)[4] = (float(*)[4]) a_mem.data();
+// The number of rows depends on the page size of the host.
 
-        buf.size = volume(buf.dimension_size);
+static void add_mirrored_buffer(class_node & program,
+                                const buffer & buf,
+                                name_mapper & namer)
+{
+    auto & private_sec = program.sections[1];
 
-        buffers.emplace(array->name, buf);
+    string name = namer(buf.name);
+    string mem_name = namer(buf.name + ".mem");
 
-        if (array->inter_period_dependency)
-        {
-            buffers_in_memory.push_back(array.get());
-        }
-        else
-        {
-            buffers_on_stack.push_back(array.get());
-        }
+    {
+        int64_t rows = buf.dimension_size[0];
+        int64_t row_size = buf.size / rows * byte_size_for(buf.type);
+        ostringstream text;
+        text << "arrp::mirrored_buffer " << mem_name
+             << " { " << row_size << ", " << rows << " }";
+        auto mem = make_shared<custom_decl>();
+        mem->text = text.str();
+        private_sec.members.push_back(mem);
+    }
+    {
+        auto rows = make_shared<custom_decl>();
+        rows->text = "const int " + namer(buf.name + ".rows") + " = " + mem_name + ".rows()";
+        private_sec.members.push_back(rows);
     }
 
-    auto buffer_size_is_smaller =
-            [&](polyhedral::array * a, polyhedral::array * b) -> bool
-    { return buffers.at(a->name).size < buffers.at(b->name).size; };
+    string row_type = array_extent_text(buf, 1);
 
-    std::sort(buffers_on_stack.begin(), buffers_on_stack.end(), buffer_size_is_smaller);
+    string elem_type = type_name_for(buf.type);
+    string pointer_type = row_type.empty()
+            ? elem_type + " *"
+            : elem_type + " (*)" + row_type;
 
-    int64_t stack_size = 0;
+    ostringstream text;
+    if (row_type.empty())
+        text << elem_type << " * " << name;
+    else
+        text << elem_type << " (*" << name << ")" << row_type;
+    text << " = (" << pointer_type << ") " << mem_name << ".data()";
 
-    for(int idx = 0; idx < buffers_on_stack.size(); ++idx)
-    {
-        polyhedral::array *array = buffers_on_stack[idx];
-        buffer & b = buffers.at(array->name);
+    auto ptr = make_shared<custom_decl>();
+    ptr->text = text.str();
+    private_sec.members.push_back(ptr);
+}
 
-        int64_t elem_size = size_for(array->type);
+// Declares a reference to buffer memory at an address,
+// with the same type as an array buffer would have:
+// float (&a)[4][8] = *(float(*)[4][8]) (address);
 
-        int64_t mem_size = b.size * elem_size;
+static void add_buffer_view(class_node & program,
+                            const buffer & buf,
+                            const string & address,
+                            name_mapper & namer)
+{
+    string name = namer(buf.name);
+    string extent = array_extent_text(buf, 0);
+    string elem_type = type_name_for(buffer_element_type(buf));
 
-        // FIXME: use user option for max stack size
-        if (stack_size + mem_size < 1024)
-        {
-            b.on_stack = true;
-            stack_size += mem_size;
-        }
-        else
-        {
-            buffers_in_memory.push_back(array);
-        }
+    ostringstream text;
+    if (extent.empty())
+    {
+        text << elem_type << " & " << name
+             << " = *(" << elem_type << " *)";
     }
-
-    for(int idx = 0; idx < buffers_in_memory.size(); ++idx)
+    else
     {
-        polyhedral::array *array = buffers_in_memory[idx];
-        buffer & b = buffers.at(array->name);
-        b.on_stack = false;
+        text << elem_type << " (&" << name << ")" << extent
+             << " = *(" << elem_type << " (*)" << extent << ")";
     }
+    text << " (" << address << ")";
+
+    auto ref = make_shared<custom_decl>();
+    ref->text = text.str();
+    program.sections[1].members.push_back(ref);
+}
 
+// Same as above, for a local variable:
+// auto & a = *(float(*)[4][8]) storage;
 
-    return buffers;
+static variable_decl_ptr buffer_view_decl(const buffer & buf,
+                                          expression_ptr address,
+                                          name_mapper & namer)
+{
+    string extent = array_extent_text(buf, 0);
+    string elem_type = type_name_for(buffer_element_type(buf));
+
+    auto view_type = extent.empty()
+            ? pointer(type_for(buffer_element_type(buf)))
+            : btype(elem_type + " (*)" + extent);
+
+    auto value = unop(op::dereference, cast(view_type, address));
+
+    return decl(reference(auto_type()), namer(buf.name), value);
 }
 
+// Declarations of buffers on stack.
+// Buffers sharing storage are declared as views of it.
 
-static void advance_buffers(const polyhedral::model & model,
-                            unordered_map<string,buffer> & buffers,
-                            builder * ctx,
-                            name_mapper & namer,
-                            bool init)
+static vector<statement_ptr> stack_buffer_decls(const polyhedral::model & model,
+                                                const unordered_map<string,buffer> & buffers,
+                                                name_mapper & namer,
+                                                int alignment)
 {
-    assert_or_throw(!init);
+    vector<statement_ptr> decls;
+    unordered_set<string> declared_storage;
 
-    for (const auto & array : model.arrays)
+    for (auto array : model.arrays)
     {
-        const buffer & buf = buffers.at(array->name);
+        const auto & buf = buffers.at(array->name);
+        if (!buf.on_stack)
+            continue;
 
-        if (buf.has_phase)
+        if (buf.shared_storage.empty())
         {
-            //cout << "Buffer " << buf.name << " has phase." << endl;
+            decls.push_back(stmt(make_shared<var_decl_expression>
+                                 (buffer_decl(buf,namer,alignment))));
+            continue;
+        }
 
-            int buffer_size = buf.dimension_size[0];
+        string storage = namer(buf.shared_storage);
 
-            auto phase = make_shared<id_expression>(namer(array->name + "_ph"));
+        if (declared_storage.insert(storage).second)
+        {
+            auto storage_decl = make_shared<array_decl>
+                    (type_for(buf.type), storage, vector<int>{ int(buf.shared_storage_size) });
+            storage_decl->alignment = alignment;
+            decls.push_back(stmt(make_shared<var_decl_expression>(storage_decl)));
+        }
 
-            if (buf.data_shift.size)
-            {
-                //cout << "Buffer " << buf.name << " shifts data." << endl;
+        decls.push_back(stmt(make_shared<var_decl_expression>
+                             (buffer_view_decl(buf, make_id(storage), namer))));
+    }
 
-                auto phase_change = binop(op::assign_add, phase, literal(buf.period_offset));
-                ctx->add(phase_change);
+    return decls;
+}
 
-                int max_phase = buf.data_shift.period_count * buf.period_offset;
+// Declares the arena and a constructor which optionally
+// accepts memory for it from the caller.
 
-                auto shift_block = make_shared<block_statement>();
+static void add_arena(class_node & program,
+                      int64_t size, int alignment, bool huge_pages,
+                      const string & arena_name)
+{
+    auto & public_sec = program.sections[0];
 
-                auto buf_ptr = make_id("d");
+    {
+        auto decl = make_shared<custom_decl>();
+        decl->text = "static constexpr size_t arena_size = " + to_string(size);
+        public_sec.members.push_back(decl);
+    }
+    {
+        auto decl = make_shared<custom_decl>();
+        decl->text = "static constexpr size_t arena_alignment = " + to_string(alignment);
+        public_sec.members.push_back(decl);
+    }
+    {
+        auto decl = make_shared<custom_decl>();
+        decl->text = program.name + "(void * memory = nullptr): "
+                + arena_name + "(arena_size, arena_alignment, "
+                + (huge_pages ? "arrp::arena::huge_pages" : "arrp::arena::heap")
+                + ", memory) {}";
+        public_sec.members.push_back(decl);
+    }
+    {
+        auto decl = make_shared<custom_decl>();
+        decl->text = "arrp::arena " + arena_name;
+        program.sections[1].members.push_back(decl);
+    }
+}
 
-                {
+class_node * state_type_def(const string & name,
+                            const polyhedral::model & model,
+                            unordered_map<string,buffer> & buffers,
+                            name_mapper & namer,
+                            int data_alignment,
+                            bool block_io,
+                            bool has_process,
+                            const unordered_set<const polyhedral::statement*> & direct_io,
+                            compiler::arena_type arena,
+                            int64_t arena_size, int arena_alignment)
+{
+    auto def = new class_node(class_class, name);
+    def->template_parameters.push_back("IO");
+
+    def->sections.resize(2);
+    def->sections[0].access = public_access;
+    def->sections[1].access = private_access;
+
+    auto io_type = make_shared<basic_type>("IO");
+
+    auto & public_sec = def->sections[0];
+
+    {
+        public_sec.members.push_back(make_shared<data_field>(decl(pointer(io_type), "io")));
+
+        auto init_func =
+                make_shared<func_decl>(make_shared<func_signature>("prelude"));
+        public_sec.members.push_back(init_func);
+        auto proc_func =
+                make_shared<func_decl>(make_shared<func_signature>("period"));
+        public_sec.members.push_back(proc_func);
+        if (has_process)
+        {
+            auto count_param = decl(int_type(), "count");
+            auto batch_func = make_shared<func_decl>
+                    (make_shared<func_signature>("process", vector<variable_decl_ptr>{ count_param }));
+            public_sec.members.push_back(batch_func);
+        }
+    }
+
+    auto & private_sec = def->sections[1];
+
+    string arena_name;
+    if (arena != compiler::arena_type::none)
+    {
+        // Must be declared before references into it.
+        arena_name = namer(".arena");
+        add_arena(*def, arena_size, arena_alignment,
+                  arena == compiler::arena_type::huge_pages, arena_name);
+    }
+
+    unordered_set<string> declared_storage;
+
+    for (auto array : model.arrays)
+    {
+        const auto & buf = buffers.at(array->name);
+        if (buf.on_stack || buf.is_constant)
+            continue;
+        if (buf.is_mirrored)
+        {
+            add_mirrored_buffer(*def, buf, namer);
+            continue;
+        }
+        if (buf.arena_offset >= 0)
+        {
+            string address = arena_name + ".data() + " + to_string(buf.arena_offset);
+            add_buffer_view(*def, buf, address, namer);
+            continue;
+        }
+        if (!buf.shared_storage.empty())
+        {
+            string storage = namer(buf.shared_storage);
+            if (declared_storage.insert(storage).second)
+            {
+                auto storage_decl = make_shared<array_decl>
+                        (type_for(buf.type), storage, vector<int>{ int(buf.shared_storage_size) });
+                storage_decl->alignment = data_alignment;
+                private_sec.members.push_back(make_shared<data_field>(storage_decl));
+            }
+            add_buffer_view(*def, buf, storage, namer);
+            continue;
+        }
+        auto field = make_shared<data_field>(buffer_decl(buf,namer,data_alignment));
+        private_sec.members.push_back(field);
+    }
+
+    for (auto array : model.arrays)
+    {
+        const auto & buf = buffers.at(array->name);
+        if (!buf.has_phase)
+            continue;
+        auto int_t = make_shared<basic_type>("int");
+        auto field = decl(int_t, namer(array->name + "_ph"));
+        field->value = literal(buf.initial_phase);
+        if (buf.is_mirrored)
+        {
+            // Position of the first element accessed in period,
+            // in the number of rows chosen at run time.
+            auto rows = make_id(namer(buf.name + ".rows"));
+            auto first = literal(array->first_period_access);
+            auto phase = binop(op::rem, first, rows);
+            if (array->first_period_access < 0)
+                phase = binop(op::rem, binop(op::add, phase, rows), rows);
+            field->value = phase;
+        }
+        private_sec.members.push_back(make_shared<data_field>(field));
+    }
+
+    if (block_io)
+    {
+        vector<polyhedral::io_channel> channels = model.inputs;
+        channels.insert(channels.end(), model.outputs.begin(), model.outputs.end());
+
+        for (auto & channel : channels)
+        {
+            if (!channel.statement->is_infinite)
+                continue;
+            if (direct_io.count(channel.statement.get()))
+                continue;
+
+            int size = max(channel.prelude_count, channel.period_count)
+                    * io_element_count(channel);
+
+            auto block = make_shared<array_decl>
+                    (type_for(channel.array->type), namer(channel.name + ".io"), vector<int>{size});
+            block->alignment = data_alignment;
+
+            private_sec.members.push_back(make_shared<data_field>(block));
+        }
+    }
+
+    return def;
+}
+
+static void mirror_buffer(const polyhedral::array & array, buffer & buf)
+{
+    if (!array.is_infinite || !buf.dimension_needs_wrapping[0])
+        return;
+
+    int size = buf.dimension_size[0];
+
+    // Elements accessed in a period must fit into both copies,
+    // starting anywhere in the first copy.
+
+    int period_access_span = array.last_period_access - array.first_period_access + 1;
+    if (period_access_span > size)
+        return;
+
+    // The buffer is extended to a whole number of pages at run time,
+    // so the size is only a lower bound on the number of rows.
+    // Indexes wrap at the number of rows chosen at run time.
+
+    buf.is_mirrored = true;
+    buf.has_phase = true;
+
+    // Phase is kept as the position of the first element accessed in period.
+    buf.initial_phase = ((array.first_period_access % size) + size) % size;
+
+    if (verbose<polyhedral::storage_output>::enabled())
+    {
+        arrp::report()["storage"][array.name]["mirrored"] = true;
+    }
+}
+
+// Names of statements in order of execution in AST.
+
+static isl_bool collect_statement_name(isl_ast_node * node, void * data)
+{
+    if (isl_ast_node_get_type(node) != isl_ast_node_user)
+        return isl_bool_true;
+
+    auto expr = isl_ast_node_user_get_expr(node);
+    auto id_expr = isl_ast_expr_get_op_arg(expr, 0);
+    auto id = isl_ast_expr_get_id(id_expr);
+
+    auto names = reinterpret_cast<vector<string>*>(data);
+    names->push_back(isl_id_get_name(id));
+
+    isl_id_free(id);
+    isl_ast_expr_free(id_expr);
+    isl_ast_expr_free(expr);
+
+    return isl_bool_true;
+}
+
+// Size of data cache at given level in bytes:
+// as given by option, else as detected on host if requested,
+// else a common size. Generated code only depends on the host
+// if detection is requested explicitly.
+
+static int64_t cache_size(int level, int option, compiler::cache_size_source source)
+{
+    if (option > 0)
+        return option;
+
+    for (int index = 0; source == compiler::cache_size_source::host; ++index)
+    {
+        string dir = "/sys/devices/system/cpu/cpu0/cache/index" + to_string(index) + "/";
+
+        ifstream level_file(dir + "level");
+        if (!level_file)
+            break;
+
+        int cache_level = 0;
+        level_file >> cache_level;
+
+        string type;
+        ifstream(dir + "type") >> type;
+
+        if (cache_level != level || type == "Instruction")
+            continue;
+
+        string size_text;
+        ifstream(dir + "size") >> size_text;
+
+        int64_t size = atoll(size_text.c_str());
+        if (!size_text.empty() && size_text.back() == 'K')
+            size *= 1024;
+        else if (!size_text.empty() && size_text.back() == 'M')
+            size *= 1024 * 1024;
+
+        if (size > 0)
+            return size;
+    }
+
+    return level == 1 ? 32 * 1024 : 256 * 1024;
+}
+
+struct live_range
+{
+    int first = -1;
+    int last = -1;
+    int span() const { return last - first; }
+};
+
+// Positions of first and last statement accessing each array in period.
+
+static unordered_map<polyhedral::array*, live_range>
+period_live_ranges(const polyhedral::model & model, const polyhedral::ast_isl & ast)
+{
+    unordered_map<polyhedral::array*, live_range> ranges;
+
+    if (!ast.period)
+        return ranges;
+
+    vector<string> stmt_names;
+    isl_ast_node_foreach_descendant_top_down(ast.period, &collect_statement_name, &stmt_names);
+
+    unordered_map<string, polyhedral::statement*> stmts;
+    for (auto & stmt : model.statements)
+        stmts.emplace(stmt->name, stmt.get());
+
+    for (int pos = 0; pos < (int) stmt_names.size(); ++pos)
+    {
+        auto stmt = stmts.find(stmt_names[pos]);
+        if (stmt == stmts.end())
+            continue;
+
+        for (auto & access : stmt->second->array_accesses)
+        {
+            auto & range = ranges[access->array.get()];
+            if (range.first < 0)
+                range.first = pos;
+            range.last = pos;
+        }
+    }
+
+    return ranges;
+}
+
+unordered_map<string,buffer>
+buffer_analysis(const polyhedral::model & model,
+                const polyhedral::ast_isl & ast,
+                const compiler::options & opt)
+{
+    using polyhedral::array;
+
+    std::vector<array*> buffers_on_stack;
+    std::vector<array*> buffers_in_memory;
+
+    unordered_map<string,buffer> buffers;
+
+    // The host accesses buffers of streams directly with zero-copy I/O,
+    // so they must persist between calls.
+    unordered_set<polyhedral::array*> persistent_arrays;
+    if (opt.zero_copy_io)
+    {
+        for (auto & channel : model.inputs)
+            persistent_arrays.insert(channel.array.get());
+        for (auto & channel : model.outputs)
+            persistent_arrays.insert(channel.array.get());
+    }
+
+    for (const auto & array : model.arrays)
+    {
+        buffer buf;
+
+        buf.name = array->name;
+
+        buf.type = array->type;
+
+        buf.period_offset = array->period;
+
+        buf.is_constant = !array->constant_values.empty();
+
+        // Constant tables are shared by all program instances.
+        if (!buf.is_constant)
+            buf.lanes = opt.batch;
+
+        // Compute buffer size
+
+        for(int dim = 0; dim < array->buffer_size.size(); ++dim)
+        {
+            int size = array->buffer_size[dim];
+
+            if (size <= 1)
+            {
+                buf.dimension_size.push_back(size);
+                buf.dimension_needs_wrapping.push_back(false);
+                continue;
+            }
+
+            bool may_need_wrapping = false;
+
+            if (dim == 0 && array->is_infinite)
+            {
+                if (opt.buffer_data_shifting)
+                {
+                    int period_size = array->last_period_access - array->first_period_access + 1;
+                    int period_overlap_size = array->last_period_access
+                            - (array->first_period_access + array->period)
+                            + 1;
+
+                    if (period_overlap_size > 0)
+                    {
+                        // Shift at most 10% of accessed items per period, asymptotically.
+
+                        // to_shift = overlap
+                        // shifted_per_period = to_shift / num_periods
+                        // num_periods = to_shift / shifted_per_period
+                        //             = overlap / shifted_per_period
+
+                        int num_periods = std::ceil(period_overlap_size / (0.1 * period_size));
+                        num_periods = max(1, num_periods);
+
+                        buf.data_shift.period_count = num_periods;
+                        buf.data_shift.size = period_overlap_size;
+                        buf.data_shift.source = array->first_period_access + num_periods * array->period;
+
+                        buf.has_phase = true;
+
+                        if (verbose<polyhedral::storage_output>::enabled())
+                        {
+                            auto & out = arrp::report()["storage"][array->name]["shift"];
+                            out["size"] = buf.data_shift.size;
+                            out["source"] = buf.data_shift.source;
+                            out["period-count"] = buf.data_shift.period_count;
+                        }
+                    }
+                    else
+                    {
+                        buf.data_shift.period_count = 1;
+                    }
+
+                    size = array->last_period_access
+                            + buf.data_shift.period_count * buf.period_offset
+                            + 1;
+                }
+                else
+                {
+                    may_need_wrapping = true;
+
+                    // Round to the next power of two, to avoid modulo when indexing
+                    if (opt.data_size_power_of_two)
+                        size = (int) pow(2, ceil(log2(size)));
+
+                    buf.has_phase = array->period % size != 0;
+
+                    // The first pipeline stage writing the array
+                    // starts executing periods that many periods late.
+                    if (buf.has_phase && array->pipeline_stage > 0)
+                    {
+                        int lag = (array->pipeline_stage * array->period) % size;
+                        buf.initial_phase = (size - lag) % size;
+                    }
+                }
+            }
+            else
+            {
+                may_need_wrapping = array->size[dim] > size;
+
+                // Round to the next power of two, to avoid modulo when indexing
+                if (may_need_wrapping && opt.data_size_power_of_two)
+                    size = (int) pow(2, ceil(log2(size)));
+            }
+
+            buf.dimension_size.push_back(size);
+            buf.dimension_needs_wrapping.push_back(may_need_wrapping);
+        }
+
+        buf.size = volume(buf.dimension_size) * buf.lanes;
+
+        buffers.emplace(array->name, buf);
+    }
+
+    // Buffers in the same storage group share storage as large as the largest.
+    // The first one in the group decides placement of the storage.
+
+    unordered_map<string, polyhedral::array*> storage_owners;
+    unordered_map<polyhedral::array*, polyhedral::array*> storage_sharers;
+
+    for (const auto & array : model.arrays)
+    {
+        if (array->storage_group < 0)
+            continue;
+
+        auto & buf = buffers.at(array->name);
+        buf.shared_storage = "storage" + to_string(array->storage_group);
+
+        auto owner = storage_owners.emplace(buf.shared_storage, array.get()).first->second;
+        if (owner != array.get())
+            storage_sharers.emplace(array.get(), owner);
+
+        auto & owner_buf = buffers.at(owner->name);
+        owner_buf.shared_storage_size = max(owner_buf.shared_storage_size, buf.size);
+    }
+
+    for (auto & entry : storage_sharers)
+    {
+        buffers.at(entry.first->name).shared_storage_size =
+                buffers.at(entry.second->name).shared_storage_size;
+    }
+
+    for (const auto & array : model.arrays)
+    {
+        if (storage_sharers.count(array.get()))
+            continue;
+
+        if (buffers.at(array->name).is_constant)
+        {
+            buffers.at(array->name).on_stack = false;
+            continue;
+        }
+
+        if (array->inter_period_dependency || persistent_arrays.count(array.get()))
+        {
+            buffers_in_memory.push_back(array.get());
+        }
+        else
+        {
+            buffers_on_stack.push_back(array.get());
+        }
+    }
+
+    // Buffers without inter-period dependency become period-local scratch
+    // on the stack, as long as they fit into a part of L1 cache.
+    // Buffers accessed within a short part of the period are placed first,
+    // since their data is reused soonest.
+
+    int64_t l1_size = cache_size(1, opt.cache.l1_size, opt.cache.source);
+    int64_t l2_size = cache_size(2, opt.cache.l2_size, opt.cache.source);
+
+    int64_t scratch_budget = 1024;
+    if (opt.scratch_budget > 0)
+        scratch_budget = opt.scratch_budget;
+    else if (opt.cache.source == compiler::cache_size_source::host)
+        scratch_budget = l1_size / 2;
+
+    auto live_ranges = period_live_ranges(model, ast);
+
+    auto byte_size = [&](polyhedral::array * a) -> int64_t
+    {
+        const auto & b = buffers.at(a->name);
+        int64_t size = b.shared_storage.empty() ? b.size : b.shared_storage_size;
+        return size * byte_size_for(a->type);
+    };
+
+    // Live range of shared storage spans all buffers sharing it.
+
+    for (auto & entry : storage_sharers)
+    {
+        const auto & sharer = live_ranges[entry.first];
+        auto & owner = live_ranges[entry.second];
+        if (sharer.first < 0)
+            continue;
+        if (owner.first < 0 || sharer.first < owner.first)
+            owner.first = sharer.first;
+        owner.last = max(owner.last, sharer.last);
+    }
+
+    auto is_hotter =
+            [&](polyhedral::array * a, polyhedral::array * b) -> bool
+    {
+        int a_span = live_ranges[a].span();
+        int b_span = live_ranges[b].span();
+        if (a_span != b_span)
+            return a_span < b_span;
+        return byte_size(a) < byte_size(b);
+    };
+
+    std::stable_sort(buffers_on_stack.begin(), buffers_on_stack.end(), is_hotter);
+
+    int64_t stack_size = 0;
+
+    for(int idx = 0; idx < buffers_on_stack.size(); ++idx)
+    {
+        polyhedral::array *array = buffers_on_stack[idx];
+        buffer & b = buffers.at(array->name);
+
+        int64_t mem_size = byte_size(array);
+
+        if (stack_size + mem_size <= scratch_budget)
+        {
+            b.on_stack = true;
+            stack_size += mem_size;
+        }
+        else
+        {
+            buffers_in_memory.push_back(array);
+        }
+
+        if (verbose<polyhedral::storage_output>::enabled())
+        {
+            const auto & range = live_ranges[array];
+            arrp::report()["storage"][array->name]["live-range"] = { range.first, range.last };
+        }
+    }
+
+    int64_t memory_size = 0;
+
+    for(int idx = 0; idx < buffers_in_memory.size(); ++idx)
+    {
+        polyhedral::array *array = buffers_in_memory[idx];
+        buffer & b = buffers.at(array->name);
+        b.on_stack = false;
+
+        if (opt.storage == compiler::storage_type::mirrored && b.shared_storage.empty())
+            mirror_buffer(*array, b);
+
+        memory_size += byte_size(array);
+    }
+
+    for (auto & entry : storage_sharers)
+    {
+        buffers.at(entry.first->name).on_stack =
+                buffers.at(entry.second->name).on_stack;
+    }
+
+    // Complex buffers are split into planes of real and imaginary parts,
+    // unless accessed by I/O or stored in a special way.
+
+    if (opt.complex == compiler::complex_type::split)
+    {
+        unordered_set<polyhedral::array*> io_arrays;
+        for (auto & channel : model.inputs)
+            io_arrays.insert(channel.array.get());
+        for (auto & channel : model.outputs)
+            io_arrays.insert(channel.array.get());
+        for (auto & stmt : model.statements)
+        {
+            if (!stmt->is_input_or_output)
+                continue;
+            for (auto & access : stmt->array_accesses)
+                io_arrays.insert(access->array.get());
+        }
+
+        for (const auto & array : model.arrays)
+        {
+            auto & b = buffers.at(array->name);
+            if (!is_complex(b.type) || b.is_mirrored || b.data_shift.size > 0 ||
+                    !b.shared_storage.empty() || io_arrays.count(array.get()))
+                continue;
+            b.is_split_complex = true;
+        }
+    }
+
+    if (verbose<polyhedral::storage_output>::enabled())
+    {
+        auto & out = arrp::report()["storage"];
+
+        for (const auto & array : model.arrays)
+        {
+            const auto & b = buffers.at(array->name);
+            out[array->name]["placement"] =
+                    b.is_constant ? "constant" : (b.on_stack ? "stack" : "memory");
+            if (b.is_split_complex)
+                out[array->name]["split-complex"] = true;
+        }
+
+        auto & cache = out["cache"];
+        cache["l1"] = l1_size;
+        cache["l2"] = l2_size;
+        cache["scratch-budget"] = scratch_budget;
+        cache["scratch-size"] = stack_size;
+        cache["working-set"] = stack_size + memory_size;
+        cache["fits-l2"] = stack_size + memory_size <= l2_size;
+    }
+
+    return buffers;
+}
+
+
+// Places persistent buffers into a single arena,
+// in order of first access in period, then in prelude,
+// so that buffers used together are close in memory.
+// Each buffer starts at a cache line boundary.
+// Returns arena size in bytes.
+
+static int64_t arena_layout(const polyhedral::model & model,
+                            const polyhedral::ast_isl & ast,
+                            unordered_map<string,buffer> & buffers,
+                            int alignment)
+{
+    vector<string> stmt_names;
+    if (ast.period)
+        isl_ast_node_foreach_descendant_top_down(ast.period, &collect_statement_name, &stmt_names);
+    if (ast.prelude)
+        isl_ast_node_foreach_descendant_top_down(ast.prelude, &collect_statement_name, &stmt_names);
+
+    unordered_map<string, polyhedral::statement*> stmts;
+    for (auto & stmt : model.statements)
+        stmts.emplace(stmt->name, stmt.get());
+
+    vector<polyhedral::array*> order;
+    unordered_set<polyhedral::array*> placed;
+
+    auto place = [&](polyhedral::array * array)
+    {
+        if (placed.count(array))
+            return;
+        placed.insert(array);
+        order.push_back(array);
+    };
+
+    for (auto & name : stmt_names)
+    {
+        auto stmt = stmts.find(name);
+        if (stmt == stmts.end())
+            continue;
+        for (auto & access : stmt->second->array_accesses)
+            place(access->array.get());
+    }
+
+    for (auto & array : model.arrays)
+        place(array.get());
+
+    int64_t offset = 0;
+
+    unordered_map<string, int64_t> storage_offsets;
+
+    for (auto array : order)
+    {
+        auto & buf = buffers.at(array->name);
+        if (buf.on_stack || buf.is_mirrored || buf.is_constant)
+            continue;
+
+        int64_t size = buf.size;
+
+        if (!buf.shared_storage.empty())
+        {
+            auto storage = storage_offsets.find(buf.shared_storage);
+            if (storage != storage_offsets.end())
+            {
+                buf.arena_offset = storage->second;
+                continue;
+            }
+            storage_offsets.emplace(buf.shared_storage, offset);
+            size = buf.shared_storage_size;
+        }
+
+        buf.arena_offset = offset;
+
+        size *= byte_size_for(buf.type);
+        offset += (size + alignment - 1) / alignment * alignment;
+    }
+
+    if (verbose<polyhedral::storage_output>::enabled())
+    {
+        auto & out = arrp::report()["storage"]["arena"];
+        out["size"] = offset;
+        for (auto array : order)
+        {
+            auto & buf = buffers.at(array->name);
+            if (buf.arena_offset >= 0)
+                out["offsets"][array->name] = buf.arena_offset;
+        }
+    }
+
+    return offset;
+}
+
+
+static bool io_buffer_is_contiguous(const polyhedral::io_channel & channel,
+                                    const buffer & buf)
+{
+    // Whether elements transferred by the channel in the prelude
+    // and in each period are contiguous in the buffer,
+    // and remain valid while the host accesses them.
+
+    const auto & array = channel.array;
+
+    if (buf.on_stack)
+        return false;
+
+    for(int d = 1; d < array->size.size(); ++d)
+    {
+        if (buf.dimension_size[d] != array->size[d])
+            return false;
+    }
+
+    int size = buf.dimension_size[0];
+
+    // Buffers with data shifting are not wrapped,
+    // so elements are always contiguous.
+    if (!buf.dimension_needs_wrapping[0] && size > 1)
+        return true;
+
+    int period_access_span = array->last_period_access - array->first_period_access + 1;
+
+    if (period_access_span > size)
+        return false;
+
+    if (channel.prelude_count > 0 && channel.prelude_access_end > size)
+        return false;
+
+    // Mirrored buffers are contiguous across the wrap point,
+    // wherever it is in the number of rows chosen at run time.
+    if (buf.is_mirrored)
+        return true;
+
+    auto wrap = [size](int i) { return ((i % size) + size) % size; };
+
+    if (wrap(channel.prelude_offset) + channel.prelude_count > size)
+        return false;
+
+    int phase = 0;
+    for(int p = 0; p < size; ++p)
+    {
+        if (wrap(channel.period_offset + phase) + channel.period_count > size)
+            return false;
+
+        if (!buf.has_phase)
+            break;
+
+        phase = wrap(phase + buf.period_offset);
+        if (phase == 0)
+            break;
+    }
+
+    return true;
+}
+
+static unordered_set<const polyhedral::statement*>
+direct_io_statements(const polyhedral::model & model,
+                     const unordered_map<string,buffer> & buffers)
+{
+    unordered_set<const polyhedral::statement*> stmts;
+
+    vector<polyhedral::io_channel> channels = model.inputs;
+    channels.insert(channels.end(), model.outputs.begin(), model.outputs.end());
+
+    for (const auto & channel : channels)
+    {
+        if (!channel.statement->is_infinite)
+            continue;
+
+        const auto & buf = buffers.at(channel.array->name);
+
+        bool is_direct = io_buffer_is_contiguous(channel, buf);
+
+        if (verbose<polyhedral::storage_output>::enabled())
+        {
+            arrp::report()["storage"][channel.array->name]["zero-copy-io"] = is_direct;
+        }
+
+        if (is_direct)
+            stmts.insert(channel.statement.get());
+    }
+
+    return stmts;
+}
+
+static void add_io_buffer_access(class_node & program,
+                                 const polyhedral::model & model,
+                                 const unordered_set<const polyhedral::statement*> & direct_io,
+                                 cpp_from_polyhedral & poly,
+                                 builder * ctx,
+                                 name_mapper & namer)
+{
+    auto add_channel = [&](const polyhedral::io_channel & channel, bool is_input)
+    {
+        if (!channel.statement->is_infinite)
+            return;
+
+        string type_name = type_name_for(channel.array->type);
+        string data;
+
+        if (direct_io.count(channel.statement.get()))
+        {
+            // Initially point to data transferred in prelude, if any,
+            // else in first period.
+            poly.set_in_period(channel.prelude_count == 0);
+            auto slice = poly.generate_io_buffer_slice(channel, ctx);
+            poly.set_in_period(false);
+
+            data = namer(channel.name + ".io.ptr");
+            auto field = decl(pointer(type_for(channel.array->type)), data, slice);
+            program.sections[1].members.push_back(make_shared<data_field>(field));
+        }
+        else
+        {
+            data = namer(channel.name + ".io");
+        }
+
+        auto accessor = make_shared<custom_decl>();
+        accessor->text =
+                type_name + " * " + (is_input ? "input_" : "output_") + channel.name + "_buffer()"
+                + " { return " + data + "; }";
+        program.sections[0].members.push_back(accessor);
+    };
+
+    for (const auto & channel : model.inputs)
+        add_channel(channel, true);
+    for (const auto & channel : model.outputs)
+        add_channel(channel, false);
+}
+
+static void update_io_buffer_access(const vector<polyhedral::io_channel> & channels,
+                                    const unordered_set<const polyhedral::statement*> & direct_io,
+                                    bool in_period,
+                                    cpp_from_polyhedral & poly,
+                                    builder * ctx,
+                                    name_mapper & namer)
+{
+    poly.set_in_period(in_period);
+
+    for (const auto & channel : channels)
+    {
+        if (!direct_io.count(channel.statement.get()))
+            continue;
+
+        int count = in_period ? channel.period_count : channel.prelude_count;
+        if (count == 0)
+            continue;
+
+        auto data = make_id(namer(channel.name + ".io.ptr"));
+        ctx->add(assign(data, poly.generate_io_buffer_slice(channel, ctx)));
+    }
+}
+
+static void transfer_io_blocks(const vector<polyhedral::io_channel> & channels,
+                               bool is_input, bool in_period,
+                               builder * ctx,
+                               name_mapper & namer)
+{
+    for (const auto & channel : channels)
+    {
+        if (!channel.statement->is_infinite)
+            continue;
+
+        int count = in_period ? channel.period_count : channel.prelude_count;
+        count *= io_element_count(channel);
+
+        if (count == 0)
+            continue;
+
+        string func_name = (is_input ? "input_" : "output_") + channel.name;
+        auto func = binop(op::member_of_pointer, make_id("io"), make_id(func_name));
+        auto block = make_id(namer(channel.name + ".io"));
+
+        ctx->add(call(func, { block, literal(count) }));
+    }
+}
+
+static void advance_buffers(const polyhedral::model & model,
+                            unordered_map<string,buffer> & buffers,
+                            builder * ctx,
+                            name_mapper & namer,
+                            bool init)
+{
+    assert_or_throw(!init);
+
+    for (const auto & array : model.arrays)
+    {
+        const buffer & buf = buffers.at(array->name);
+
+        if (buf.has_phase)
+        {
+            //cout << "Buffer " << buf.name << " has phase." << endl;
+
+            int buffer_size = buf.dimension_size[0];
+
+            auto phase = make_shared<id_expression>(namer(array->name + "_ph"));
+
+            if (buf.data_shift.size)
+            {
+                //cout << "Buffer " << buf.name << " shifts data." << endl;
+
+                auto phase_change = binop(op::assign_add, phase, literal(buf.period_offset));
+                ctx->add(phase_change);
+
+                int max_phase = buf.data_shift.period_count * buf.period_offset;
+
+                auto shift_block = make_shared<block_statement>();
+
+                auto buf_ptr = make_id("d");
+
+                {
                     auto buf_address = cast(pointer(type_for(buf.type)), make_id(buf.name));
                     auto buf_ptr_decl = decl_expr(auto_type(), *buf_ptr, buf_address);
                     shift_block->statements.push_back(stmt(buf_ptr_decl));
@@ -500,52 +1576,497 @@ static void advance_buffers(const polyhedral::model & model,
                     extent[0] = 1;
                     int64_t factor = volume(extent);
 
-                    int64_t source_address = buf.data_shift.source * factor;
-                    int64_t end_address = (buf.data_shift.source + buf.data_shift.size) * factor;
-                    int64_t dest_address = (buf.data_shift.source - buf.data_shift.period_count * buf.period_offset) * factor;
+                    int64_t source_address = buf.data_shift.source * factor;
+                    int64_t end_address = (buf.data_shift.source + buf.data_shift.size) * factor;
+                    int64_t dest_address = (buf.data_shift.source - buf.data_shift.period_count * buf.period_offset) * factor;
+
+                    auto source = binop(op::add, buf_ptr, literal(source_address));
+                    auto end = binop(op::add, buf_ptr, literal(end_address));
+                    auto dest = binop(op::add, buf_ptr, literal(dest_address));
+
+                    auto data_shift = call(make_id("std::copy"), { source, end, dest });
+                    shift_block->statements.push_back(stmt(data_shift));
+                }
+                {
+                    auto phase_reset = binop(op::assign, phase, literal(0));
+                    shift_block->statements.push_back(stmt(phase_reset));
+                }
+
+                auto time_to_shift = binop(op::greater_or_equal, phase, literal(max_phase));
+                auto conditional_shift = make_shared<if_statement>(time_to_shift, shift_block, nullptr);
+
+                ctx->add(conditional_shift);
+            }
+            else
+            {
+                auto next_phase = binop(op::add, phase, literal(buf.period_offset));
+
+                assert(buffer_size > 0);
+                bool size_is_power_of_two =
+                        buffer_size == (int)std::pow(2, (int)std::log2(buffer_size));
+
+                if (buf.is_mirrored)
+                {
+                    auto rows = make_id(namer(buf.name + ".rows"));
+                    next_phase = binop(op::rem, next_phase, rows);
+                }
+                else if (size_is_power_of_two)
+                {
+                    auto mask = literal(buffer_size-1);
+                    next_phase = binop(op::bit_and, next_phase, mask);
+                }
+                else
+                {
+                    next_phase = binop(op::rem, next_phase, literal(buffer_size));
+                }
+
+                auto phase_change = binop(op::assign, phase, next_phase);
+
+                ctx->add(phase_change);
+            }
+        }
+    }
+}
+// Adds functions to save and restore state of program kept between periods,
+// as a flat image of the following fields, without padding:
+// - Layout version (uint64_t).
+// - Buffers of arrays with inter-period dependency.
+//   Mirrored buffers are stored starting at their phase,
+//   and restart at phase 0 when loaded, because their number of rows
+//   depends on the host.
+// - Buffer phases (int), except of mirrored buffers.
+// - Pipeline fill and drain (int), if pipelined.
+// - Element offsets of pointers into buffers for direct I/O (int64_t).
+// The layout version is a hash of the layout.
+
+static void add_state_access(class_node & program,
+                             namespace_node & nmspc,
+                             const polyhedral::model & model,
+                             const unordered_map<string,buffer> & buffers,
+                             const unordered_set<const polyhedral::statement*> & direct_io,
+                             bool pipelined,
+                             name_mapper & namer)
+{
+    struct field
+    {
+        string name;
+        string type;
+        int64_t size;
+        expression_ptr address;
+        // Buffer pointed into, for direct I/O pointers.
+        expression_ptr base;
+    };
+
+    vector<field> fields;
+
+    for (const auto & array : model.arrays)
+    {
+        const auto & buf = buffers.at(array->name);
+        if (buf.on_stack || buf.is_constant || !array->inter_period_dependency)
+            continue;
+
+        auto name = make_id(namer(buf.name));
+        expression_ptr address = unop(op::address, name);
+        if (buf.is_mirrored)
+            address = binop(op::add, name, make_id(namer(array->name + "_ph")));
+        fields.push_back({ buf.name, type_name_for(buf.type),
+                           buf.size * byte_size_for(buf.type), address, nullptr });
+    }
+
+    for (const auto & array : model.arrays)
+    {
+        const auto & buf = buffers.at(array->name);
+        if (!buf.has_phase || buf.is_mirrored)
+            continue;
+        string name = namer(array->name + "_ph");
+        fields.push_back({ array->name + "_ph", "int", 4,
+                           unop(op::address, make_id(name)), nullptr });
+    }
+
+    if (pipelined)
+    {
+        for (string field_name : { ".pipeline_fill", ".pipeline_drain" })
+        {
+            string name = namer(field_name);
+            fields.push_back({ field_name, "int", 4,
+                               unop(op::address, make_id(name)), nullptr });
+        }
+    }
+
+    vector<polyhedral::io_channel> channels = model.inputs;
+    channels.insert(channels.end(), model.outputs.begin(), model.outputs.end());
+
+    for (const auto & channel : channels)
+    {
+        if (!channel.statement->is_infinite || !direct_io.count(channel.statement.get()))
+            continue;
+        const auto & buf = buffers.at(channel.array->name);
+        expression_ptr base = make_id(namer(buf.name));
+        if (buf.is_mirrored)
+            base = binop(op::add, base, make_id(namer(channel.array->name + "_ph")));
+        base = cast(pointer(type_for(buf.type)), base);
+        fields.push_back({ channel.name + ".io.ptr", "int64_t", 8,
+                           make_id(namer(channel.name + ".io.ptr")), base });
+    }
+
+    // Layout version: FNV-1a hash of layout description.
+
+    int64_t size = 8;
+    ostringstream layout;
+    layout << "arrp-state-1;";
+    for (const auto & f : fields)
+    {
+        layout << f.name << ':' << f.type << ':' << f.size << ';';
+        size += f.size;
+    }
+
+    uint64_t version = 14695981039346656037ull;
+    for (unsigned char c : layout.str())
+    {
+        version ^= c;
+        version *= 1099511628211ull;
+    }
+
+    if (verbose<polyhedral::storage_output>::enabled())
+    {
+        auto & out = arrp::report()["storage"]["state"];
+        ostringstream version_text;
+        version_text << "0x" << std::hex << version;
+        out["version"] = version_text.str();
+        out["size"] = size;
+
+        int64_t offset = 8;
+        for (const auto & f : fields)
+        {
+            arrp::json entry;
+            entry["name"] = f.name;
+            entry["type"] = f.type;
+            entry["offset"] = offset;
+            entry["size"] = f.size;
+            out["fields"].push_back(entry);
+            offset += f.size;
+        }
+    }
+
+    {
+        auto decl = make_shared<custom_decl>();
+        decl->text = "static constexpr uint64_t state_version = " + to_string(version) + "u";
+        program.sections[0].members.push_back(decl);
+    }
+    {
+        auto decl = make_shared<custom_decl>();
+        decl->text = "static constexpr size_t state_size() { return " + to_string(size) + "; }";
+        program.sections[0].members.push_back(decl);
+    }
+
+    auto byte_ptr = [](bool is_const)
+    {
+        auto t = make_shared<basic_type>("char");
+        t->is_const = is_const;
+        return pointer(t);
+    };
+
+    auto copy_bytes = [](expression_ptr dest, expression_ptr src, int64_t size)
+    {
+        return stmt(call(make_id("std::memcpy"), { dest, src, literal(size) }));
+    };
+
+    for (bool is_save : { true, false })
+    {
+        string name = is_save ? "save_state" : "load_state";
+
+        auto void_t = make_shared<basic_type>("void");
+        void_t->is_const = !is_save;
+        auto param = decl(pointer(void_t), is_save ? "dest" : "src");
+        auto return_t = make_shared<basic_type>(is_save ? "void" : "bool");
+
+        program.sections[0].members.push_back(make_shared<func_decl>
+            (make_shared<func_signature>(name, vector<variable_decl_ptr>{ param }, return_t)));
+
+        auto sig = make_shared<func_signature>
+                (program.name + "<IO>::" + name, vector<variable_decl_ptr>{ param }, return_t,
+                 explicit_inline);
+        sig->template_parameters.push_back("IO");
+
+        auto func = make_shared<func_def>(sig);
+        auto & body = func->body.statements;
+
+        auto data = make_id("d");
+        body.push_back(stmt(decl_expr(byte_ptr(!is_save), *data,
+                                      cast(byte_ptr(!is_save), make_id(param->name)))));
 
-                    auto source = binop(op::add, buf_ptr, literal(source_address));
-                    auto end = binop(op::add, buf_ptr, literal(end_address));
-                    auto dest = binop(op::add, buf_ptr, literal(dest_address));
+        auto version_id = make_id("version");
+        body.push_back(stmt(decl_expr(make_shared<basic_type>("uint64_t"), *version_id,
+                                      is_save ? make_id("state_version") : nullptr)));
+        if (is_save)
+        {
+            body.push_back(copy_bytes(data, unop(op::address, version_id), 8));
+        }
+        else
+        {
+            body.push_back(copy_bytes(unop(op::address, version_id), data, 8));
+            auto mismatch = binop(op::not_equal, version_id, make_id("state_version"));
+            auto fail = make_shared<return_statement>(make_id("false"));
+            body.push_back(make_shared<if_statement>(mismatch, fail, nullptr));
 
-                    auto data_shift = call(make_id("std::copy"), { source, end, dest });
-                    shift_block->statements.push_back(stmt(data_shift));
-                }
-                {
-                    auto phase_reset = binop(op::assign, phase, literal(0));
-                    shift_block->statements.push_back(stmt(phase_reset));
-                }
+            for (const auto & array : model.arrays)
+            {
+                if (buffers.at(array->name).is_mirrored)
+                    body.push_back(stmt(assign(make_id(namer(array->name + "_ph")), literal(0))));
+            }
+        }
 
-                auto time_to_shift = binop(op::greater_or_equal, phase, literal(max_phase));
-                auto conditional_shift = make_shared<if_statement>(time_to_shift, shift_block, nullptr);
+        int64_t offset = 8;
+        for (const auto & f : fields)
+        {
+            auto location = binop(op::add, data, literal(offset));
+            offset += f.size;
 
-                ctx->add(conditional_shift);
+            if (!f.base)
+            {
+                if (is_save)
+                    body.push_back(copy_bytes(location, f.address, f.size));
+                else
+                    body.push_back(copy_bytes(f.address, location, f.size));
+                continue;
+            }
+
+            // Pointers are stored as offsets from start of buffer.
+            auto element_offset = make_id("offset");
+            vector<statement_ptr> stmts;
+            if (is_save)
+            {
+                auto value = binop(op::sub, f.address, f.base);
+                stmts.push_back(stmt(decl_expr(make_shared<basic_type>("int64_t"),
+                                               *element_offset, value)));
+                stmts.push_back(copy_bytes(location, unop(op::address, element_offset), 8));
             }
             else
             {
-                auto next_phase = binop(op::add, phase, literal(buf.period_offset));
+                stmts.push_back(stmt(decl_expr(make_shared<basic_type>("int64_t"),
+                                               *element_offset)));
+                stmts.push_back(copy_bytes(unop(op::address, element_offset), location, 8));
+                stmts.push_back(stmt(assign(f.address,
+                                            binop(op::add, f.base, element_offset))));
+            }
+            body.push_back(block(stmts));
+        }
 
-                assert(buffer_size > 0);
-                bool size_is_power_of_two =
-                        buffer_size == (int)std::pow(2, (int)std::log2(buffer_size));
+        if (!is_save)
+            body.push_back(make_shared<return_statement>(make_id("true")));
 
-                if (size_is_power_of_two)
-                {
-                    auto mask = literal(buffer_size-1);
-                    next_phase = binop(op::bit_and, next_phase, mask);
-                }
-                else
-                {
-                    next_phase = binop(op::rem, next_phase, literal(buffer_size));
-                }
+        nmspc.members.push_back(func);
+    }
+}
 
-                auto phase_change = binop(op::assign, phase, next_phase);
+// Source file and line of definition computed by statement.
 
-                ctx->add(phase_change);
-            }
+static string source_line_text(const polyhedral::statement & stmt)
+{
+    auto location = stmt.location;
+
+    ostringstream text;
+    if (!location.path().empty())
+        text << location.path();
+    else if (location.module)
+        text << location.module->name;
+    else
+        text << "?";
+
+    if (location.range.start.line)
+        text << ':' << location.range.start.line;
+
+    return text.str();
+}
+
+static string string_literal_text(const string & value)
+{
+    string text = "\"";
+    for (char c : value)
+    {
+        if (c == '"' || c == '\\')
+            text += '\\';
+        text += c;
+    }
+    text += '"';
+    return text;
+}
+
+// Adds counters of time spent and instances computed for each statement,
+// and function profile() which reads them along with locations of
+// source definitions computed by statements.
+
+static void add_profile(class_node & program,
+                        namespace_node & nmspc,
+                        const polyhedral::model & model,
+                        cpp_from_isl & isl,
+                        cpp_from_polyhedral & poly,
+                        name_mapper & namer)
+{
+    int size = model.statements.size();
+
+    auto counters = make_id(namer(".profile"));
+    string sites_name = namer(".profile_sites");
+
+    auto counter_field = [=](int index, const string & field)
+    {
+        auto counter = make_shared<array_access_expression>
+                (counters, vector<expression_ptr>{ literal(index) });
+        return binop(op::member_of_reference, counter, make_id(field));
+    };
+
+    unordered_map<string, int> sites;
+    unordered_map<string, expression_ptr> instance_counters;
+
+    ostringstream table;
+    table << "static const arrp::profile_site " << sites_name
+          << "[" << std::max(size, 1) << "] = {";
+
+    auto & out = arrp::report()["cpp"]["profile"];
+
+    for (int i = 0; i < size; ++i)
+    {
+        const auto & stmt = *model.statements[i];
+        string location = source_line_text(stmt);
+
+        sites[stmt.name] = i;
+        instance_counters[stmt.name] = counter_field(i, "count");
+
+        table << endl << "  { " << string_literal_text(stmt.name)
+              << ", " << string_literal_text(location) << " },";
+
+        arrp::json entry;
+        entry["statement"] = stmt.name;
+        entry["location"] = location;
+        out.push_back(entry);
+    }
+
+    table << endl << "}";
+
+    {
+        auto decl = make_shared<custom_decl>();
+        decl->text = table.str();
+        nmspc.members.push_back(decl);
+    }
+
+    program.sections[1].members.push_back(make_shared<data_field>
+        (make_shared<array_decl>(btype("arrp::profile_counter"), counters->name,
+                                 vector<int>{ std::max(size, 1) })));
+
+    {
+        auto decl = make_shared<custom_decl>();
+        decl->text = "std::vector<arrp::profile_entry> profile() const"
+                     " { return arrp::profile_entries(" + sites_name + ", "
+                + counters->name + ", " + to_string(size) + "); }";
+        program.sections[0].members.push_back(decl);
+    }
+
+    poly.set_instance_counters(instance_counters);
+
+    string start_name = namer(".profile_start");
+
+    auto timer_func = [=](const string & stmt_name, statement_ptr body) -> statement_ptr
+    {
+        auto site = sites.find(stmt_name);
+        if (site == sites.end())
+            return body;
+
+        auto clock = call(make_id("arrp::profile_clock"), {});
+        auto start = make_id(start_name);
+
+        vector<statement_ptr> stmts;
+        stmts.push_back(stmt(decl_expr(btype("uint64_t"), *start, clock)));
+        stmts.push_back(body);
+        stmts.push_back(stmt(binop(op::assign_add, counter_field(site->second, "time"),
+                                   binop(op::sub, clock, start))));
+        return block(stmts);
+    };
+
+    isl.set_timer_func(timer_func);
+}
+
+// Executes pipeline stages concurrently, each in its own chunk of the pool.
+// Stage s only starts executing after s periods,
+// and stops executing after s periods of draining.
+
+static void generate_pipeline(const polyhedral::ast_isl & ast,
+                              cpp_from_isl & isl,
+                              const string & pool_name,
+                              const string & fill_name,
+                              const string & drain_name,
+                              const string & stage_name,
+                              builder * ctx)
+{
+    int stage_count = ast.period_stages.size();
+
+    auto stage_id = make_id(stage_name);
+    auto fill = make_id(fill_name);
+    auto drain = make_id(drain_name);
+
+    auto body = make_shared<block_statement>();
+
+    for (int stage = 0; stage < stage_count; ++stage)
+    {
+        vector<statement_ptr> stmts;
+
+        ctx->push(&stmts);
+        isl.generate(ast.period_stages[stage]);
+        ctx->pop();
+
+        if (stmts.empty())
+            continue;
+
+        expression_ptr cond = binop(op::equal, stage_id, literal(stage));
+        if (stage > 0)
+        {
+            auto is_filled = binop(op::greater_or_equal, fill, literal(stage));
+            cond = binop(op::logic_and, cond, is_filled);
         }
+        if (stage < stage_count - 1)
+        {
+            auto is_not_drained = binop(op::lesser_or_equal, drain, literal(stage));
+            cond = binop(op::logic_and, cond, is_not_drained);
+        }
+
+        body->statements.push_back(make_shared<if_statement>(cond, block(stmts), nullptr));
     }
+
+    auto loop = make_shared<pool_for_statement>();
+    loop->pool = make_id(pool_name);
+    loop->iterator = stage_name;
+    loop->begin = literal(0);
+    loop->end = literal(stage_count);
+    loop->body = body;
+
+    ctx->add(loop);
+}
+
+// Transfers blocks of streams only while condition holds.
+
+static void transfer_io_blocks_if(expression_ptr condition,
+                                  const vector<polyhedral::io_channel> & channels,
+                                  bool is_input, bool in_period,
+                                  builder * ctx,
+                                  name_mapper & namer)
+{
+    vector<statement_ptr> stmts;
+
+    ctx->push(&stmts);
+    transfer_io_blocks(channels, is_input, in_period, ctx, namer);
+    ctx->pop();
+
+    if (!stmts.empty())
+        ctx->add(make_shared<if_statement>(condition, block(stmts), nullptr));
+}
+
+static void advance_pipeline(int stage_count, const string & fill_name, builder * ctx)
+{
+    auto fill = make_id(fill_name);
+    auto is_filling = binop(op::lesser, fill, literal(stage_count - 1));
+    auto next = stmt(binop(op::assign_add, fill, literal(1)));
+    ctx->add(make_shared<if_statement>(is_filling, next, nullptr));
 }
+
 #if 0
 void add_remainder_function(cpp_gen::module &module, namespace_node & nmspc)
 {
@@ -654,18 +2175,29 @@ static void report_buffer_sizes(const unordered_map<string,buffer> & buffers)
 
     int64_t total_mem = 0;
 
+    unordered_set<string> shared_storage;
+
     for (const auto & entry : buffers)
     {
         const auto & buffer = entry.second;
         const auto & shape = buffer.dimension_size;
         shapes[buffer.name] = shape;
 
-        int64_t flat_size = volume(shape);
+        int64_t flat_size = volume(shape) * buffer.lanes;
 
         sizes[buffer.name] = flat_size;
 
         out[buffer.name]["shape"] = shape;
 
+        // Shared storage is counted once.
+        if (!buffer.shared_storage.empty())
+        {
+            out[buffer.name]["shared-storage"] = buffer.shared_storage;
+            if (!shared_storage.insert(buffer.shared_storage).second)
+                continue;
+            flat_size = buffer.shared_storage_size;
+        }
+
         total_mem += flat_size * size_t(cpp_gen::size_for(buffer.type));
     }
 
@@ -678,13 +2210,43 @@ void generate(const string & name,
               std::ostream & src_stream,
               const compiler::options & opt)
 {
-    unordered_map<string,buffer> buffers = buffer_analysis(model, opt);
+    unordered_map<string,buffer> buffers = buffer_analysis(model, ast, opt);
+
+    // Program computing a batch of instances has a different interface.
+    string program_name = opt.batch > 1 ? "program_batch" : "program";
+    arrp::report()["cpp"]["program"] = program_name;
+    arrp::report()["cpp"]["lanes"] = opt.batch;
+    arrp::report()["cpp"]["stats"] = opt.period_stats;
+    arrp::report()["cpp"]["zero_copy_io"] = opt.zero_copy_io;
+
+    unordered_map<string, vector<double>> images;
+    bool prelude_is_image = prelude_images(model, buffers, images);
+
+    // Cache line size, or larger data alignment.
+    int arena_alignment = max(64, opt.data_alignment);
+    int64_t arena_size = 0;
+    if (opt.arena != compiler::arena_type::none)
+        arena_size = arena_layout(model, ast, buffers, arena_alignment);
 
     if (verbose<polyhedral::storage_output>::enabled())
     {
         report_buffer_sizes(buffers);
     }
 
+    bool pipelined = model.pipeline_stage_count > 1;
+    // Pipeline stages do not call I/O functions (see compiler).
+    bool block_io = opt.block_io || opt.zero_copy_io || pipelined;
+    bool io_calls_for_blocks = block_io && !opt.zero_copy_io;
+    // Stages of a pipeline occupy the thread pool.
+    bool use_thread_pool = opt.parallel && !pipelined &&
+            opt.parallel_runtime == compiler::parallel_runtime_type::pool;
+    // With zero-copy I/O, the host accesses I/O buffers between periods.
+    bool has_process = !opt.zero_copy_io;
+
+    unordered_set<const polyhedral::statement*> direct_io;
+    if (opt.zero_copy_io)
+        direct_io = direct_io_statements(model, buffers);
+
     cpp_gen::name_mapper name_mapper;
     module m;
     builder b(&m);
@@ -692,13 +2254,39 @@ void generate(const string & name,
     cpp_from_isl isl(&b);
     cpp_from_polyhedral poly(model, buffers, name_mapper);
     poly.set_move_loop_invariant_code(opt.loop_invariant_code_motion);
+    poly.set_select_cost(opt.select_cost);
+    poly.set_math(opt.math);
+    poly.set_complex(opt.complex);
+    poly.set_cache_size(cache_size(2, opt.cache.l2_size, opt.cache.source));
+    poly.set_vectorize(opt.vectorize);
+    // Stages of a pipeline already occupy all threads.
+    poly.set_parallel_reductions(opt.parallel && !pipelined);
+    poly.set_block_io(block_io);
+    poly.set_direct_io(direct_io);
+    poly.set_lanes(opt.batch);
 
     m.members.push_back(make_shared<include_dir>("cstdint"));
     m.members.push_back(make_shared<include_dir>("cmath"));
+    m.members.push_back(make_shared<include_dir>("cstring"));
     m.members.push_back(make_shared<include_dir>("algorithm"));
     m.members.push_back(make_shared<include_dir>("complex"));
     m.members.push_back(make_shared<include_dir>("unordered_map"));
     m.members.push_back(make_shared<include_dir>("arrp/arrp.hpp"));
+    if (use_thread_pool || pipelined)
+        m.members.push_back(make_shared<include_dir>("arrp/thread_pool.hpp"));
+    if (any_of(buffers.begin(), buffers.end(),
+               [](const pair<const string,buffer> & b){ return b.second.is_mirrored; }))
+        m.members.push_back(make_shared<include_dir>("arrp/mirrored_buffer.hpp"));
+    if (opt.arena != compiler::arena_type::none)
+        m.members.push_back(make_shared<include_dir>("arrp/arena.hpp"));
+    if (opt.vectorize)
+        m.members.push_back(make_shared<include_dir>("arrp/simd.hpp"));
+    if (opt.math != compiler::math_type::standard)
+        m.members.push_back(make_shared<include_dir>("arrp/math.hpp"));
+    if (opt.instrument)
+        m.members.push_back(make_shared<include_dir>("arrp/profile.hpp"));
+    if (opt.period_stats)
+        m.members.push_back(make_shared<include_dir>("arrp/stats.hpp"));
 
     m.members.push_back(make_shared<using_decl>("namespace std"));
 
@@ -717,18 +2305,101 @@ void generate(const string & name,
     {
         traits->sections[0].members.push_back(io_decl(io));
         traits->sections[0].members.push_back(io_period_count_decl(io));
+        if (block_io && io.statement->is_infinite)
+            traits->sections[0].members.push_back(io_prelude_count_decl(io));
     }
     for (auto & io : model.outputs)
     {
         traits->sections[0].members.push_back(io_decl(io));
         traits->sections[0].members.push_back(io_period_count_decl(io));
+        if (block_io && io.statement->is_infinite)
+            traits->sections[0].members.push_back(io_prelude_count_decl(io));
     }
 
     nmspc->members.push_back(traits);
 
+    for (auto & array : model.arrays)
+    {
+        const auto & buf = buffers.at(array->name);
+        if (buf.is_constant)
+            nmspc->members.push_back(constant_table_decl(*array, buf, name_mapper));
+    }
+
+    if (prelude_is_image)
+    {
+        for (auto & array : model.arrays)
+        {
+            auto image = images.find(array->name);
+            if (image != images.end())
+                nmspc->members.push_back(prelude_image_decl(buffers.at(array->name),
+                                                            image->second, name_mapper));
+        }
+    }
+
     // FIXME: rather include header:
-    nmspc->members.push_back
-            (namespace_member_ptr(state_type_def(model, buffers, name_mapper, opt.data_alignment)));
+    {
+        auto program = state_type_def(program_name, model, buffers, name_mapper,
+                                      opt.data_alignment, block_io, has_process,
+                                      direct_io,
+                                      opt.arena, arena_size, arena_alignment);
+
+        if (opt.zero_copy_io)
+            add_io_buffer_access(*program, model, direct_io, poly, &b, name_mapper);
+
+        if (use_thread_pool || pipelined)
+        {
+            auto pool_name = name_mapper(".pool");
+            if (opt.pin_threads)
+            {
+                auto pool_type = make_shared<basic_type>("arrp::thread_pool");
+                program->sections[1].members.push_back
+                        (make_shared<data_field>(decl(pool_type, pool_name)));
+            }
+            else
+            {
+                auto pool = make_shared<custom_decl>();
+                pool->text = "arrp::thread_pool " + pool_name + " { 0, false }";
+                program->sections[1].members.push_back(pool);
+            }
+            if (use_thread_pool)
+            {
+                isl.set_parallel_pool(make_id(pool_name));
+                poly.set_parallel_pool(make_id(pool_name));
+            }
+        }
+
+        if (pipelined)
+        {
+            auto fill = decl(make_shared<basic_type>("int"), name_mapper(".pipeline_fill"));
+            fill->value = literal(0);
+            program->sections[1].members.push_back(make_shared<data_field>(fill));
+
+            auto drain = decl(make_shared<basic_type>("int"), name_mapper(".pipeline_drain"));
+            drain->value = literal(0);
+            program->sections[1].members.push_back(make_shared<data_field>(drain));
+
+            auto drain_func = make_shared<func_decl>(make_shared<func_signature>("drain"));
+            program->sections[0].members.push_back(drain_func);
+        }
+
+        if (opt.instrument)
+            add_profile(*program, *nmspc, model, isl, poly, name_mapper);
+
+        if (opt.period_stats)
+        {
+            auto stats_name = name_mapper(".stats");
+            program->sections[1].members.push_back
+                    (make_shared<data_field>(decl(btype("arrp::period_stats"), stats_name)));
+
+            auto decl = make_shared<custom_decl>();
+            decl->text = "arrp::period_stats & stats() { return " + stats_name + "; }";
+            program->sections[0].members.push_back(decl);
+        }
+
+        nmspc->members.push_back(namespace_member_ptr(program));
+
+        add_state_access(*program, *nmspc, model, buffers, direct_io, pipelined, name_mapper);
+    }
 
     // FIXME: not of much use with infinite I/O
     //add_output_getter_func(m, *nmspc, model.arrays.back());
@@ -749,8 +2420,53 @@ void generate(const string & name,
     isl.set_stmt_func(stmt_func);
     isl.set_id_func(id_func);
 
+    if (opt.vectorize)
+    {
+        auto vector_stmt_func = [&]
+                ( const string & name,
+                const vector<expression_ptr> & index,
+                const string & iterator,
+                builder * ctx)
+        {
+            return poly.generate_vector_statement(name, index, iterator, ctx);
+        };
+
+        isl.set_vector_stmt_func(vector_stmt_func);
+
+        auto recurrence_stmt_func = [&]
+                ( const string & name,
+                const vector<expression_ptr> & index,
+                const string & iterator,
+                builder * ctx)
+        {
+            return poly.generate_recurrence_block(name, index, iterator, ctx);
+        };
+
+        isl.set_recurrence_stmt_func(recurrence_stmt_func);
+    }
+
+    {
+        auto kernel_func = [&]
+                ( const polyhedral::ast_node_info & info,
+                const vector<expression_ptr> & batch,
+                bool in_parallel_loop,
+                builder * ctx)
+        {
+            if (info.contraction >= 0)
+                poly.generate_contraction(model.contractions[info.contraction], batch, ctx);
+            else if (info.reduction >= 0)
+                poly.generate_reduction(model.reductions[info.reduction], batch,
+                                        !in_parallel_loop, ctx);
+            else if (info.scan >= 0)
+                poly.generate_scan(model.scans[info.scan], batch,
+                                   !in_parallel_loop, ctx);
+        };
+
+        isl.set_kernel_func(kernel_func);
+    }
+
     {
-        auto sig = make_shared<func_signature>("program<IO>::prelude", explicit_inline);
+        auto sig = make_shared<func_signature>(program_name + "<IO>::prelude", explicit_inline);
         sig->template_parameters.push_back("IO");
 
         auto func = make_shared<func_def>(sig);
@@ -761,15 +2477,30 @@ void generate(const string & name,
 
             b.push(&func->body.statements);
 
-            for (auto array : model.arrays)
+            if (prelude_is_image)
             {
-                const auto & buf = buffers.at(array->name);
-                if (buf.on_stack)
-                    b.add(make_shared<var_decl_expression>
-                          (buffer_decl(buf,name_mapper,opt.data_alignment)));
+                copy_prelude_images(model, buffers, images, &b, name_mapper);
             }
+            else
+            {
+                for (auto & decl : stack_buffer_decls(model, buffers, name_mapper, opt.data_alignment))
+                    b.add(decl);
+
+                if (io_calls_for_blocks)
+                    transfer_io_blocks(model.inputs, true, false, &b, name_mapper);
+
+                isl.generate(ast.prelude);
 
-            isl.generate(ast.prelude);
+                if (io_calls_for_blocks)
+                    transfer_io_blocks(model.outputs, false, false, &b, name_mapper);
+            }
+
+            if (opt.zero_copy_io)
+            {
+                update_io_buffer_access(model.outputs, direct_io, false, poly, &b, name_mapper);
+                update_io_buffer_access(model.inputs, direct_io, true, poly, &b, name_mapper);
+                poly.set_in_period(false);
+            }
 
             //advance_buffers(model, buffers, &b, name_mapper, true);
 
@@ -779,8 +2510,61 @@ void generate(const string & name,
         nmspc->members.push_back(func);
     }
 
+    // Generates one period into the current block of the builder.
+
+    auto generate_period = [&]()
+    {
+        if (opt.period_stats)
+            b.add(stmt(call(binop(op::member_of_reference, make_id(name_mapper(".stats")),
+                                  make_id("begin")), {})));
+
+        if (pipelined)
+        {
+            auto fill = make_id(name_mapper(".pipeline_fill"));
+            auto drain = make_id(name_mapper(".pipeline_drain"));
+
+            // No input is left while draining,
+            // and no output is computed while filling.
+
+            transfer_io_blocks_if(binop(op::equal, drain, literal(0)),
+                                  model.inputs, true, true, &b, name_mapper);
+
+            generate_pipeline(ast, isl, name_mapper(".pool"),
+                              fill->name, drain->name,
+                              name_mapper(".stage"), &b);
+
+            auto is_filled = binop(op::equal, fill, literal(model.pipeline_stage_count - 1));
+            transfer_io_blocks_if(is_filled, model.outputs, false, true, &b, name_mapper);
+        }
+        else
+        {
+            if (io_calls_for_blocks)
+                transfer_io_blocks(model.inputs, true, true, &b, name_mapper);
+
+            isl.generate(ast.period);
+
+            if (io_calls_for_blocks)
+                transfer_io_blocks(model.outputs, false, true, &b, name_mapper);
+        }
+
+        if (opt.zero_copy_io)
+            update_io_buffer_access(model.outputs, direct_io, true, poly, &b, name_mapper);
+
+        advance_buffers(model, buffers, &b, name_mapper, false);
+
+        if (pipelined)
+            advance_pipeline(model.pipeline_stage_count, name_mapper(".pipeline_fill"), &b);
+
+        if (opt.zero_copy_io)
+            update_io_buffer_access(model.inputs, direct_io, true, poly, &b, name_mapper);
+
+        if (opt.period_stats)
+            b.add(stmt(call(binop(op::member_of_reference, make_id(name_mapper(".stats")),
+                                  make_id("end")), {})));
+    };
+
     {
-        auto sig = make_shared<func_signature>("program<IO>::period", explicit_inline);
+        auto sig = make_shared<func_signature>(program_name + "<IO>::period", explicit_inline);
         sig->template_parameters.push_back("IO");
 
         auto func = make_shared<func_def>(sig);
@@ -792,19 +2576,117 @@ void generate(const string & name,
 
             b.push(&func->body.statements);
 
+            for (auto & decl : stack_buffer_decls(model, buffers, name_mapper, opt.data_alignment))
+                b.add(decl);
+
+            generate_period();
+
+            b.pop();
+        }
+
+        nmspc->members.push_back(func);
+    }
+
+    if (pipelined)
+    {
+        // Completes periods still in the pipeline when input ends.
+
+        auto sig = make_shared<func_signature>(program_name + "<IO>::drain", explicit_inline);
+        sig->template_parameters.push_back("IO");
+
+        auto func = make_shared<func_def>(sig);
+
+        auto drain = make_id(name_mapper(".pipeline_drain"));
+        auto iter = make_id(name_mapper(".drain_period"));
+
+        auto loop = make_shared<for_statement>();
+        loop->initialization = decl_expr(int_type(), *iter, binop(op::add, drain, literal(1)));
+        loop->condition = binop(op::lesser, iter, literal(model.pipeline_stage_count));
+        loop->update = unop(op::pre_incr, iter);
+        loop->body = block({ stmt(assign(drain, iter)),
+                             stmt(call(make_id("period"), {})) });
+
+        func->body.statements.push_back(loop);
+
+        nmspc->members.push_back(func);
+    }
+
+    if (has_process)
+    {
+        auto count_param = decl(int_type(), "count");
+        auto sig = make_shared<func_signature>(program_name + "<IO>::process",
+                                               vector<variable_decl_ptr>{ count_param },
+                                               explicit_inline);
+        sig->template_parameters.push_back("IO");
+
+        auto func = make_shared<func_def>(sig);
+
+        if (ast.period)
+        {
+            auto & body = func->body.statements;
+
+            // Stack buffers do not carry data between periods,
+            // so they are declared once for all periods.
+
+            for (auto & decl : stack_buffer_decls(model, buffers, name_mapper, opt.data_alignment))
+                body.push_back(decl);
+
+            // Phases are kept in local variables which shadow the members,
+            // and are stored back after the last period,
+            // or when a period is left by an exception, e.g. at end of input.
+
+            vector<string> phases;
             for (auto array : model.arrays)
             {
-                const auto & buf = buffers.at(array->name);
-                if (buf.on_stack)
-                    b.add(make_shared<var_decl_expression>
-                          (buffer_decl(buf,name_mapper,opt.data_alignment)));
+                if (buffers.at(array->name).has_phase)
+                    phases.push_back(name_mapper(array->name + "_ph"));
             }
 
-            isl.generate(ast.period);
+            for (auto & phase : phases)
+            {
+                auto member = binop(op::member_of_pointer, make_id("this"), make_id(phase));
+                body.push_back(stmt(decl_expr(int_type(), phase, member)));
+            }
 
-            advance_buffers(model, buffers, &b, name_mapper, false);
+            // Loop-invariant code is moved at most to the start of a period.
 
+            vector<statement_ptr> period_stmts;
+
+            b.set_current_function(sig.get());
+            poly.set_in_period(true);
+
+            b.push(&period_stmts);
+            generate_period();
             b.pop();
+
+            auto iter = make_id(name_mapper(".period"));
+
+            auto loop = make_shared<for_statement>();
+            loop->initialization = decl_expr(int_type(), *iter, literal(0));
+            loop->condition = binop(op::lesser, iter, make_id("count"));
+            loop->update = unop(op::pre_incr, iter);
+            loop->body = block(period_stmts);
+
+            vector<statement_ptr> store_phases;
+            for (auto & phase : phases)
+            {
+                auto member = binop(op::member_of_pointer, make_id("this"), make_id(phase));
+                store_phases.push_back(stmt(assign(member, make_id(phase))));
+            }
+
+            if (phases.empty())
+            {
+                body.push_back(loop);
+            }
+            else
+            {
+                auto try_stmt = make_shared<try_statement>();
+                try_stmt->body = make_shared<block_statement>(vector<statement_ptr>{ loop });
+                try_stmt->handler = make_shared<block_statement>(store_phases);
+                body.push_back(try_stmt);
+            }
+
+            body.insert(body.end(), store_phases.begin(), store_phases.end());
         }
 
         nmspc->members.push_back(func);
@@ -44,6 +44,31 @@ struct buffer
     int period_offset = 0;
 
     bool has_phase = false;
+    int initial_phase = 0;
+
+    // Mapped twice in a row in virtual memory,
+    // so indexes in period do not wrap.
+    bool is_mirrored = false;
+
+    // Real and imaginary parts of complex elements
+    // are stored in separate planes: T a[2][...].
+    bool is_split_complex = false;
+
+    // Computed during compilation and declared
+    // as a static table shared by all program instances.
+    bool is_constant = false;
+
+    // Number of program instances with a value of each element,
+    // stored in the innermost dimension: T a[...][lanes].
+    int lanes = 1;
+
+    // Byte offset in the program's arena, if placed in it.
+    int64_t arena_offset = -1;
+
+    // Storage shared with other buffers, if any,
+    // and its size in elements.
+    string shared_storage;
+    int64_t shared_storage_size = 0;
 
     struct
     {
@@ -57,6 +82,7 @@ struct buffer
     vector<int> dimension_size;
     vector<bool> dimension_needs_wrapping;
 
+    // Number of elements, in all lanes.
     int64_t size;
 };
 
@@ -135,6 +161,58 @@ inline int size_for(primitive_type pt)
     }
 }
 
+// Size of element in generated code, in bytes.
+inline int byte_size_for(primitive_type pt)
+{
+    switch(pt)
+    {
+    case primitive_type::boolean:
+    case primitive_type::int8:
+    case primitive_type::uint8:
+        return 1;
+    case primitive_type::int16:
+    case primitive_type::uint16:
+        return 2;
+    case primitive_type::int32:
+    case primitive_type::uint32:
+    case primitive_type::real32:
+        return 4;
+    case primitive_type::int64:
+    case primitive_type::uint64:
+    case primitive_type::real64:
+    case primitive_type::complex32:
+        return 8;
+    case primitive_type::complex64:
+        return 16;
+    default:
+        throw error("Unexpected primitive type.");
+    }
+}
+
+// Type of real and imaginary part of complex type.
+inline primitive_type complex_part_type(primitive_type pt)
+{
+    switch(pt)
+    {
+    case primitive_type::complex32:
+        return primitive_type::real32;
+    case primitive_type::complex64:
+        return primitive_type::real64;
+    default:
+        throw error("Unexpected primitive type.");
+    }
+}
+
+// Number of elements transferred by one instance of
+// a non-atomic I/O statement.
+inline int io_element_count(const polyhedral::io_channel & io)
+{
+    int count = 1;
+    for(int d = 1; d < io.array->size.size(); ++d)
+        count *= io.array->size[d];
+    return count;
+}
+
 void generate(const string & name,
               const polyhedral::model & model,
               const polyhedral::ast_isl & ast,
@@ -0,0 +1,452 @@
+#pragma once
+
+#include "simd.hpp"
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <algorithm>
+
+namespace arrp {
+namespace math {
+
+// Fast approximations of elementary functions for float and double,
+// and for simd::vec<float> and simd::vec<double>.
+// Except for pow, they do not branch on the argument,
+// so loops calling them can be vectorized.
+//
+// Max error in units in the last place (ULP), with round-to-nearest
+// and without -ffast-math, for normal arguments and results:
+//
+//   exp, exp2:         2 ULP
+//   log:               2 ULP
+//   log2, log10:       4 ULP
+//   sin, cos:          3 ULP for |x| < 8192 (float), |x| < 2^28 (double)
+//   tan:               4 ULP in the same range
+//   pow(x, y):         2 (1 + |y log2(x)|) ULP for x > 0; else uses std::pow.
+//
+// Outside the given range for sin, cos and tan, the error grows with |x|.
+// Infinite and NaN arguments give the same results as std functions.
+
+namespace detail {
+
+using std::min;
+using std::max;
+
+template <typename V> struct element { using type = V; };
+template <typename T> struct element<simd::vec<T>> { using type = T; };
+
+template <typename T> struct real_bits;
+
+template <> struct real_bits<float>
+{
+    using type = std::int32_t;
+    static constexpr int mantissa = 23;
+    static constexpr int bias = 127;
+};
+
+template <> struct real_bits<double>
+{
+    using type = std::int64_t;
+    static constexpr int mantissa = 52;
+    static constexpr int bias = 1023;
+};
+
+inline float select(bool m, float a, float b) { return m ? a : b; }
+inline double select(bool m, double a, double b) { return m ? a : b; }
+
+// Nearest integer, for |x| < 2^(mantissa - 1).
+
+template <typename V>
+V nearest(V x)
+{
+    using T = typename element<V>::type;
+    const T magic = T(1.5) * T(std::int64_t(1) << real_bits<T>::mantissa);
+    return (x + V(magic)) - V(magic);
+}
+
+// 2^n for integer n in range of normal numbers.
+
+template <typename T>
+T pow2i(T n)
+{
+    using bits_type = typename real_bits<T>::type;
+    bits_type bits = bits_type(bits_type(n) + real_bits<T>::bias) << real_bits<T>::mantissa;
+    T y;
+    std::memcpy(&y, &bits, sizeof(T));
+    return y;
+}
+
+template <typename T>
+simd::vec<T> pow2i(simd::vec<T> n)
+{
+    using namespace simd;
+    // n + magic has the bits of magic plus n, as in nearest().
+    const T magic = T(1.5) * T(std::int64_t(1) << real_bits<T>::mantissa);
+    ivec<T> bits = as_int(n + vec<T>(magic)) - as_int(vec<T>(magic)) + ivec<T>(real_bits<T>::bias);
+    return as_real(shift_left(bits, real_bits<T>::mantissa));
+}
+
+// x * 2^n for integer n, covering the full range of results.
+
+template <typename V>
+V scale(V x, V n)
+{
+    using T = typename element<V>::type;
+    V h = nearest(n * V(T(0.5)));
+    return (x * pow2i(h)) * pow2i(n - h);
+}
+
+// Exponent e and mantissa m of x > 0, so that x = m * 2^e
+// and sqrt(1/2) <= m < sqrt(2).
+
+template <typename T>
+T exponent(T x, T & m)
+{
+    using bits_type = typename real_bits<T>::type;
+    const int mantissa = real_bits<T>::mantissa;
+    const bits_type mantissa_mask = (bits_type(1) << mantissa) - 1;
+
+    // Subnormals
+    bool is_subnormal = x < std::numeric_limits<T>::min();
+    x = select(is_subnormal, x * T(bits_type(1) << mantissa), x);
+    T e_offset = select(is_subnormal, T(-mantissa), T(0));
+
+    bits_type bits;
+    std::memcpy(&bits, &x, sizeof(T));
+
+    T e = T(((bits >> mantissa) & ((bits_type(1) << (sizeof(T) * 8 - 1 - mantissa)) - 1))
+            - real_bits<T>::bias) + e_offset;
+
+    bits = (bits & mantissa_mask) | (bits_type(real_bits<T>::bias) << mantissa);
+    std::memcpy(&m, &bits, sizeof(T));
+
+    bool high = m > T(1.41421356237309504880);
+    m = select(high, m * T(0.5), m);
+    e = select(high, e + T(1), e);
+
+    return e;
+}
+
+template <typename T>
+simd::vec<T> exponent(simd::vec<T> x, simd::vec<T> & m)
+{
+    using namespace simd;
+    using V = vec<T>;
+    using I = ivec<T>;
+    using bits_type = typename real_bits<T>::type;
+    const int mantissa = real_bits<T>::mantissa;
+    const bits_type mantissa_mask = (bits_type(1) << mantissa) - 1;
+    const T mantissa_scale = T(bits_type(1) << mantissa);
+
+    // Subnormals
+    auto is_subnormal = x < V(std::numeric_limits<T>::min());
+    x = select(is_subnormal, x * V(mantissa_scale), x);
+    V e_offset = select(is_subnormal, V(T(-mantissa)), V(T(0)));
+
+    I bits = as_int(x);
+
+    // The sign bit of x > 0 is zero, so this is the biased exponent.
+    // It is converted to real by placing it into the mantissa of 2^mantissa.
+    I biased = shift_right(bits, mantissa);
+    V e = (as_real(biased | as_int(V(mantissa_scale))) - V(mantissa_scale))
+            - V(T(real_bits<T>::bias)) + e_offset;
+
+    m = as_real((bits & I(mantissa_mask)) | I(bits_type(real_bits<T>::bias) << mantissa));
+
+    auto high = m > V(T(1.41421356237309504880));
+    m = select(high, m * V(T(0.5)), m);
+    e = select(high, e + V(T(1)), e);
+
+    return e;
+}
+
+// Polynomial with coefficients c, from highest power.
+
+template <typename V, typename T, int N>
+V horner(V x, const T (&c)[N])
+{
+    V p = V(c[0]);
+    for (int i = 1; i < N; ++i)
+        p = p * x + V(c[i]);
+    return p;
+}
+
+// Taylor series of exp(r) for |r| <= log(2)/2.
+
+template <typename V>
+V exp_poly(V r, float)
+{
+    static constexpr float c[] = {
+        1.f/5040, 1.f/720, 1.f/120, 1.f/24, 1.f/6, 0.5f, 1.f, 1.f
+    };
+    return horner(r, c);
+}
+
+template <typename V>
+V exp_poly(V r, double)
+{
+    static constexpr double c[] = {
+        1.6059043836821613e-10, 2.08767569878681e-09, 2.505210838544172e-08,
+        2.755731922398589e-07, 2.7557319223985893e-06, 2.48015873015873e-05,
+        0.0001984126984126984, 0.001388888888888889, 0.008333333333333333,
+        0.041666666666666664, 0.16666666666666666, 0.5, 1.0, 1.0
+    };
+    return horner(r, c);
+}
+
+// log(m) = 2 atanh(f) for sqrt(1/2) <= m < sqrt(2), with f = (m-1)/(m+1).
+
+template <typename V>
+V log_poly(V m, float)
+{
+    static constexpr float c[] = {
+        2.f/11, 2.f/9, 2.f/7, 2.f/5, 2.f/3
+    };
+    V f = (m - V(1.f)) / (m + V(1.f));
+    V s = f * f;
+    return f * V(2.f) + f * s * horner(s, c);
+}
+
+template <typename V>
+V log_poly(V m, double)
+{
+    static constexpr double c[] = {
+        0.08695652173913043, 0.09523809523809523, 0.10526315789473684,
+        0.11764705882352941, 0.13333333333333333, 0.15384615384615385,
+        0.18181818181818182, 0.2222222222222222, 0.2857142857142857,
+        0.4, 0.6666666666666666
+    };
+    V f = (m - V(1.0)) / (m + V(1.0));
+    V s = f * f;
+    return f * V(2.0) + f * s * horner(s, c);
+}
+
+// Taylor series of sin(r) and cos(r) for |r| <= pi/4.
+
+template <typename V>
+void sin_cos_poly(V r, V & s, V & c, float)
+{
+    static constexpr float cs[] = {
+        1.f/362880, -1.f/5040, 1.f/120, -1.f/6
+    };
+    static constexpr float cc[] = {
+        -1.f/3628800, 1.f/40320, -1.f/720, 1.f/24, -0.5f
+    };
+    V r2 = r * r;
+    s = r + r * r2 * horner(r2, cs);
+    c = V(1.f) + r2 * horner(r2, cc);
+}
+
+template <typename V>
+void sin_cos_poly(V r, V & s, V & c, double)
+{
+    static constexpr double cs[] = {
+        2.8114572543455206e-15, -7.647163731819816e-13, 1.6059043836821613e-10,
+        -2.505210838544172e-08, 2.7557319223985893e-06, -0.0001984126984126984,
+        0.008333333333333333, -0.16666666666666666
+    };
+    static constexpr double cc[] = {
+        -1.5619206968586225e-16, 4.779477332387385e-14, -1.1470745597729725e-11,
+        2.08767569878681e-09, -2.755731922398589e-07, 2.48015873015873e-05,
+        -0.001388888888888889, 0.041666666666666664, -0.5
+    };
+    V r2 = r * r;
+    s = r + r * r2 * horner(r2, cs);
+    c = V(1.0) + r2 * horner(r2, cc);
+}
+
+// Reduces x to r in [-pi/4, pi/4], with x = r + q * pi/2 and 0 <= q < 4.
+
+template <typename V>
+V reduce_half_pi(V x, V & q, float)
+{
+    V n = nearest(x * V(0.636619772367581343076f));
+    V r = (((x - n * V(1.5703125f)) - n * V(4.837512969970703125e-4f))
+            - n * V(7.549533620476723e-8f)) - n * V(2.5633440682570896e-12f);
+    q = n - V(4.f) * nearest(n * V(0.25f) - V(0.375f));
+    return r;
+}
+
+template <typename V>
+V reduce_half_pi(V x, V & q, double)
+{
+    V n = nearest(x * V(0.636619772367581343076));
+    V r = ((x - n * V(1.57079625129699707031)) - n * V(7.54978941586159635335e-8))
+            - n * V(5.39030285815811905290e-15);
+    q = n - V(4.0) * nearest(n * V(0.25) - V(0.375));
+    return r;
+}
+
+template <typename V>
+V sin_quadrant(V x, V offset)
+{
+    using T = typename element<V>::type;
+    V q;
+    V r = reduce_half_pi(x, q, T());
+    q = q + offset;
+    q = select(q >= V(T(4)), q - V(T(4)), q);
+    V s, c;
+    sin_cos_poly(r, s, c, T());
+    V y = select(q == V(T(0)), s,
+          select(q == V(T(1)), c,
+          select(q == V(T(2)), -s, -c)));
+    // Infinity and NaN
+    return select(x - x == V(T(0)), y, x - x);
+}
+
+}
+
+template <typename V>
+V exp(V x)
+{
+    using namespace detail;
+    using T = typename element<V>::type;
+
+    const bool is_float = sizeof(T) == sizeof(float);
+    const T lowest = is_float ? T(-104) : T(-746);
+    const T highest = is_float ? T(89) : T(710);
+
+    V xc = select(x == x, min(max(x, V(lowest)), V(highest)), V(T(0)));
+    V n = nearest(xc * V(T(1.44269504088896340736)));
+    V r = (xc - n * V(T(0.693145751953125))) - n * V(T(1.42860682030941723212e-6));
+    V y = scale(exp_poly(r, T()), n);
+    return select(x == x, y, x);
+}
+
+template <typename V>
+V exp2(V x)
+{
+    using namespace detail;
+    using T = typename element<V>::type;
+
+    const bool is_float = sizeof(T) == sizeof(float);
+    const T lowest = is_float ? T(-150) : T(-1076);
+    const T highest = is_float ? T(129) : T(1025);
+
+    V xc = select(x == x, min(max(x, V(lowest)), V(highest)), V(T(0)));
+    V n = nearest(xc);
+    V r = (xc - n) * V(T(0.693147180559945309417));
+    V y = scale(exp_poly(r, T()), n);
+    return select(x == x, y, x);
+}
+
+namespace detail {
+
+// log(x) = e * log(2) + log(m), with separate terms.
+
+template <typename V>
+V log_parts(V x, V & e)
+{
+    using T = typename element<V>::type;
+    // Mantissa of a valid value for special cases.
+    V xv = select(x > V(T(0)) && x < V(std::numeric_limits<T>::infinity()), x, V(T(1)));
+    V m;
+    e = exponent(xv, m);
+    return log_poly(m, T());
+}
+
+template <typename V>
+V log_special(V x, V y)
+{
+    using T = typename element<V>::type;
+    const T inf = std::numeric_limits<T>::infinity();
+    y = select(x == V(T(0)), V(-inf), y);
+    y = select(x < V(T(0)), V(std::numeric_limits<T>::quiet_NaN()), y);
+    y = select(x == V(inf), x, y);
+    return select(x == x, y, x);
+}
+
+}
+
+template <typename V>
+V log(V x)
+{
+    using namespace detail;
+    using T = typename element<V>::type;
+    V e;
+    V lm = log_parts(x, e);
+    V y = e * V(T(0.693145751953125)) + (lm + e * V(T(1.42860682030941723212e-6)));
+    return log_special(x, y);
+}
+
+template <typename V>
+V log2(V x)
+{
+    using namespace detail;
+    using T = typename element<V>::type;
+    V e;
+    V lm = log_parts(x, e);
+    V y = e + lm * V(T(1.44269504088896340736));
+    return log_special(x, y);
+}
+
+template <typename V>
+V log10(V x)
+{
+    using namespace detail;
+    using T = typename element<V>::type;
+    V e;
+    V lm = log_parts(x, e);
+    V y = e * V(T(0.301025390625)) + (lm * V(T(0.434294481903251827651)) + e * V(T(4.60503898119521373889e-6)));
+    return log_special(x, y);
+}
+
+template <typename V>
+V sin(V x)
+{
+    using T = typename detail::element<V>::type;
+    return detail::sin_quadrant(x, V(T(0)));
+}
+
+template <typename V>
+V cos(V x)
+{
+    using T = typename detail::element<V>::type;
+    return detail::sin_quadrant(x, V(T(1)));
+}
+
+template <typename V>
+V tan(V x)
+{
+    using namespace detail;
+    using T = typename element<V>::type;
+    V q;
+    V r = reduce_half_pi(x, q, T());
+    V s, c;
+    sin_cos_poly(r, s, c, T());
+    V odd = q - V(T(2)) * nearest(q * V(T(0.5)) - V(T(0.25)));
+    V y = select(odd == V(T(0)), s / c, -c / s);
+    return select(x - x == V(T(0)), y, x - x);
+}
+
+template <typename T>
+T pow(T x, T y)
+{
+    if (x > T(0))
+        return exp2(y * log2(x));
+    return std::pow(x, y);
+}
+
+template <typename T>
+simd::vec<T> pow(simd::vec<T> x, simd::vec<T> y)
+{
+    using V = simd::vec<T>;
+    V r = exp2(y * log2(x));
+    if (!any(!(x > V(T(0)))))
+        return r;
+    T xa[V::width], ya[V::width], ra[V::width];
+    store(xa, x);
+    store(ya, y);
+    store(ra, r);
+    for (int i = 0; i < V::width; ++i)
+    {
+        if (!(xa[i] > T(0)))
+            ra[i] = std::pow(xa[i], ya[i]);
+    }
+    return V::load(ra);
+}
+
+}
+}
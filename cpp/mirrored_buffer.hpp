@@ -0,0 +1,118 @@
+#pragma once
+
+#include <cstddef>
+#include <stdexcept>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace arrp {
+
+// Memory mapped twice in a row in virtual memory,
+// so that data at (data() + size) is the same as data at data().
+// A range of elements that crosses the end of the buffer
+// can therefore be accessed contiguously.
+// The buffer holds at least the requested number of rows,
+// rounded up so that its size is a multiple of the page size
+// of the host.
+
+class mirrored_buffer
+{
+public:
+    mirrored_buffer(std::size_t row_size, std::size_t min_rows):
+        m_rows(rows_for(row_size, min_rows)),
+        m_size(m_rows * row_size)
+    {
+#ifdef __linux__
+        std::size_t size = m_size;
+
+        int fd = memfd_create("arrp-buffer", MFD_CLOEXEC);
+        if (fd < 0)
+            throw std::runtime_error("Failed to create memory for mirrored buffer.");
+
+        if (ftruncate(fd, size) != 0)
+        {
+            close(fd);
+            throw std::runtime_error("Failed to allocate memory for mirrored buffer.");
+        }
+
+        // Reserve address range for both copies, then map the memory into it twice.
+
+        void * base = mmap(nullptr, 2 * size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (base == MAP_FAILED)
+        {
+            close(fd);
+            throw std::runtime_error("Failed to reserve address range for mirrored buffer.");
+        }
+
+        void * first = mmap(base, size, PROT_READ | PROT_WRITE,
+                            MAP_SHARED | MAP_FIXED, fd, 0);
+        void * second = mmap(static_cast<char*>(base) + size, size, PROT_READ | PROT_WRITE,
+                             MAP_SHARED | MAP_FIXED, fd, 0);
+
+        close(fd);
+
+        if (first == MAP_FAILED || second == MAP_FAILED)
+        {
+            munmap(base, 2 * size);
+            throw std::runtime_error("Failed to map mirrored buffer.");
+        }
+
+        m_data = base;
+#else
+        throw std::runtime_error("Mirrored buffers are not supported on this platform.");
+#endif
+    }
+
+    ~mirrored_buffer()
+    {
+#ifdef __linux__
+        if (m_data)
+            munmap(m_data, 2 * m_size);
+#endif
+    }
+
+    mirrored_buffer(const mirrored_buffer &) = delete;
+    mirrored_buffer & operator=(const mirrored_buffer &) = delete;
+
+    void * data() { return m_data; }
+
+    std::size_t size() const { return m_size; }
+
+    std::size_t rows() const { return m_rows; }
+
+    // Smallest number of rows not less than min_rows
+    // that makes a whole number of pages.
+    static std::size_t rows_for(std::size_t row_size, std::size_t min_rows)
+    {
+#ifdef __linux__
+        long page_size = sysconf(_SC_PAGESIZE);
+        if (page_size <= 0)
+            throw std::runtime_error("Failed to get page size for mirrored buffer.");
+        std::size_t step = std::size_t(page_size) / gcd(row_size, std::size_t(page_size));
+        return (min_rows + step - 1) / step * step;
+#else
+        return min_rows;
+#endif
+    }
+
+private:
+    static std::size_t gcd(std::size_t a, std::size_t b)
+    {
+        while (b)
+        {
+            std::size_t r = a % b;
+            a = b;
+            b = r;
+        }
+        return a;
+    }
+
+    std::size_t m_rows = 0;
+    std::size_t m_size = 0;
+    void * m_data = nullptr;
+};
+
+}
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <algorithm>
+#include <ostream>
+#include <iomanip>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include <time.h>
+#endif
+
+namespace arrp {
+
+// Time stamp used by instrumented programs:
+// CPU cycles where available, otherwise nanoseconds.
+
+inline std::uint64_t profile_clock()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return std::uint64_t(t.tv_sec) * 1000000000u + t.tv_nsec;
+#endif
+}
+
+// A polyhedral statement and the location of the source definition
+// it computes.
+
+struct profile_site
+{
+    const char * statement;
+    const char * location;
+};
+
+// Time spent computing a statement and number of its instances computed.
+
+struct profile_counter
+{
+    std::uint64_t time = 0;
+    std::uint64_t count = 0;
+};
+
+struct profile_entry
+{
+    const char * statement;
+    const char * location;
+    std::uint64_t time;
+    std::uint64_t count;
+};
+
+inline std::vector<profile_entry> profile_entries
+(const profile_site * sites, const profile_counter * counters, int size)
+{
+    std::vector<profile_entry> entries;
+    for (int i = 0; i < size; ++i)
+    {
+        entries.push_back({ sites[i].statement, sites[i].location,
+                            counters[i].time, counters[i].count });
+    }
+    return entries;
+}
+
+// Prints entries with most time first,
+// with share of total time and time per instance.
+
+inline void print_profile(std::ostream & out, std::vector<profile_entry> entries)
+{
+    std::sort(entries.begin(), entries.end(),
+              [](const profile_entry & a, const profile_entry & b)
+    { return a.time > b.time; });
+
+    std::uint64_t total = 0;
+    for (auto & e : entries)
+        total += e.time;
+
+    auto flags = out.flags();
+    auto precision = out.precision();
+
+    out << std::setw(8) << "time %"
+        << std::setw(20) << "time"
+        << std::setw(16) << "instances"
+        << std::setw(14) << "time/inst"
+        << "  statement  location" << std::endl;
+
+    for (auto & e : entries)
+    {
+        double share = total ? 100.0 * e.time / total : 0.0;
+        double per_instance = e.count ? double(e.time) / e.count : 0.0;
+        out << std::fixed << std::setprecision(2)
+            << std::setw(8) << share
+            << std::setw(20) << e.time
+            << std::setw(16) << e.count
+            << std::setw(14) << per_instance
+            << "  " << e.statement << "  " << e.location << std::endl;
+    }
+
+    out.flags(flags);
+    out.precision(precision);
+}
+
+}
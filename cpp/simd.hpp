@@ -0,0 +1,651 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <type_traits>
+
+#if defined(__AVX512F__) || defined(__AVX__) || defined(__SSE2__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+namespace arrp {
+namespace simd {
+
+// Vectors of floating point values, with the widest
+// instruction set enabled when compiling the generated code:
+// AVX-512, AVX, SSE2 or NEON (AArch64), else one scalar element.
+//
+// vec<T>::width: number of elements.
+// vec<T>::load(p): elements p[0] ... p[width-1].
+// vec<T>(x): all elements equal to x.
+// store(p, v): writes elements to p[0] ... p[width-1].
+// Comparisons return mask<T>, used by select(m, a, b).
+// any(m): whether any element of m is true.
+//
+// ivec<T>: integers of the same size as T, as many as in vec<T>,
+// for manipulating the bits of floating point values.
+// as_int(v), as_real(i): reinterpret bits without conversion.
+// shift_left(i, n), shift_right(i, n): by n bits, shifting in zeros.
+
+template <typename T> struct vec;
+template <typename T> struct mask;
+template <typename T> struct ivec;
+
+#if defined(__AVX512F__)
+
+template <> struct mask<float>
+{
+    __mmask16 m;
+    friend mask operator&&(mask a, mask b) { return { __mmask16(a.m & b.m) }; }
+    friend mask operator||(mask a, mask b) { return { __mmask16(a.m | b.m) }; }
+    friend mask operator!(mask a) { return { __mmask16(~a.m) }; }
+};
+
+template <> struct vec<float>
+{
+    static constexpr int width = 16;
+    __m512 v;
+    vec() {}
+    vec(__m512 v): v(v) {}
+    vec(float x): v(_mm512_set1_ps(x)) {}
+    static vec load(const float * p) { return _mm512_loadu_ps(p); }
+    friend void store(float * p, vec a) { _mm512_storeu_ps(p, a.v); }
+    friend vec operator+(vec a, vec b) { return _mm512_add_ps(a.v, b.v); }
+    friend vec operator-(vec a, vec b) { return _mm512_sub_ps(a.v, b.v); }
+    friend vec operator*(vec a, vec b) { return _mm512_mul_ps(a.v, b.v); }
+    friend vec operator/(vec a, vec b) { return _mm512_div_ps(a.v, b.v); }
+    friend vec operator-(vec a) { return _mm512_sub_ps(_mm512_setzero_ps(), a.v); }
+    friend mask<float> operator<(vec a, vec b) { return { _mm512_cmp_ps_mask(a.v, b.v, _CMP_LT_OQ) }; }
+    friend mask<float> operator<=(vec a, vec b) { return { _mm512_cmp_ps_mask(a.v, b.v, _CMP_LE_OQ) }; }
+    friend mask<float> operator>(vec a, vec b) { return { _mm512_cmp_ps_mask(a.v, b.v, _CMP_GT_OQ) }; }
+    friend mask<float> operator>=(vec a, vec b) { return { _mm512_cmp_ps_mask(a.v, b.v, _CMP_GE_OQ) }; }
+    friend mask<float> operator==(vec a, vec b) { return { _mm512_cmp_ps_mask(a.v, b.v, _CMP_EQ_OQ) }; }
+    friend mask<float> operator!=(vec a, vec b) { return { _mm512_cmp_ps_mask(a.v, b.v, _CMP_NEQ_UQ) }; }
+    friend vec min(vec a, vec b) { return _mm512_min_ps(a.v, b.v); }
+    friend vec max(vec a, vec b) { return _mm512_max_ps(a.v, b.v); }
+    friend vec sqrt(vec a) { return _mm512_sqrt_ps(a.v); }
+    friend vec abs(vec a) { return _mm512_abs_ps(a.v); }
+    friend vec select(mask<float> m, vec a, vec b) { return _mm512_mask_blend_ps(m.m, b.v, a.v); }
+};
+
+template <> struct mask<double>
+{
+    __mmask8 m;
+    friend mask operator&&(mask a, mask b) { return { __mmask8(a.m & b.m) }; }
+    friend mask operator||(mask a, mask b) { return { __mmask8(a.m | b.m) }; }
+    friend mask operator!(mask a) { return { __mmask8(~a.m) }; }
+};
+
+template <> struct vec<double>
+{
+    static constexpr int width = 8;
+    __m512d v;
+    vec() {}
+    vec(__m512d v): v(v) {}
+    vec(double x): v(_mm512_set1_pd(x)) {}
+    static vec load(const double * p) { return _mm512_loadu_pd(p); }
+    friend void store(double * p, vec a) { _mm512_storeu_pd(p, a.v); }
+    friend vec operator+(vec a, vec b) { return _mm512_add_pd(a.v, b.v); }
+    friend vec operator-(vec a, vec b) { return _mm512_sub_pd(a.v, b.v); }
+    friend vec operator*(vec a, vec b) { return _mm512_mul_pd(a.v, b.v); }
+    friend vec operator/(vec a, vec b) { return _mm512_div_pd(a.v, b.v); }
+    friend vec operator-(vec a) { return _mm512_sub_pd(_mm512_setzero_pd(), a.v); }
+    friend mask<double> operator<(vec a, vec b) { return { _mm512_cmp_pd_mask(a.v, b.v, _CMP_LT_OQ) }; }
+    friend mask<double> operator<=(vec a, vec b) { return { _mm512_cmp_pd_mask(a.v, b.v, _CMP_LE_OQ) }; }
+    friend mask<double> operator>(vec a, vec b) { return { _mm512_cmp_pd_mask(a.v, b.v, _CMP_GT_OQ) }; }
+    friend mask<double> operator>=(vec a, vec b) { return { _mm512_cmp_pd_mask(a.v, b.v, _CMP_GE_OQ) }; }
+    friend mask<double> operator==(vec a, vec b) { return { _mm512_cmp_pd_mask(a.v, b.v, _CMP_EQ_OQ) }; }
+    friend mask<double> operator!=(vec a, vec b) { return { _mm512_cmp_pd_mask(a.v, b.v, _CMP_NEQ_UQ) }; }
+    friend vec min(vec a, vec b) { return _mm512_min_pd(a.v, b.v); }
+    friend vec max(vec a, vec b) { return _mm512_max_pd(a.v, b.v); }
+    friend vec sqrt(vec a) { return _mm512_sqrt_pd(a.v); }
+    friend vec abs(vec a) { return _mm512_abs_pd(a.v); }
+    friend vec select(mask<double> m, vec a, vec b) { return _mm512_mask_blend_pd(m.m, b.v, a.v); }
+};
+
+template <> struct ivec<float>
+{
+    __m512i v;
+    ivec() {}
+    ivec(__m512i v): v(v) {}
+    ivec(std::int32_t x): v(_mm512_set1_epi32(x)) {}
+    friend ivec operator+(ivec a, ivec b) { return _mm512_add_epi32(a.v, b.v); }
+    friend ivec operator-(ivec a, ivec b) { return _mm512_sub_epi32(a.v, b.v); }
+    friend ivec operator&(ivec a, ivec b) { return _mm512_and_si512(a.v, b.v); }
+    friend ivec operator|(ivec a, ivec b) { return _mm512_or_si512(a.v, b.v); }
+    friend ivec shift_left(ivec a, int n) { return _mm512_sll_epi32(a.v, _mm_cvtsi32_si128(n)); }
+    friend ivec shift_right(ivec a, int n) { return _mm512_srl_epi32(a.v, _mm_cvtsi32_si128(n)); }
+};
+
+template <> struct ivec<double>
+{
+    __m512i v;
+    ivec() {}
+    ivec(__m512i v): v(v) {}
+    ivec(std::int64_t x): v(_mm512_set1_epi64(x)) {}
+    friend ivec operator+(ivec a, ivec b) { return _mm512_add_epi64(a.v, b.v); }
+    friend ivec operator-(ivec a, ivec b) { return _mm512_sub_epi64(a.v, b.v); }
+    friend ivec operator&(ivec a, ivec b) { return _mm512_and_si512(a.v, b.v); }
+    friend ivec operator|(ivec a, ivec b) { return _mm512_or_si512(a.v, b.v); }
+    friend ivec shift_left(ivec a, int n) { return _mm512_sll_epi64(a.v, _mm_cvtsi32_si128(n)); }
+    friend ivec shift_right(ivec a, int n) { return _mm512_srl_epi64(a.v, _mm_cvtsi32_si128(n)); }
+};
+
+inline ivec<float> as_int(vec<float> a) { return _mm512_castps_si512(a.v); }
+inline vec<float> as_real(ivec<float> a) { return _mm512_castsi512_ps(a.v); }
+inline ivec<double> as_int(vec<double> a) { return _mm512_castpd_si512(a.v); }
+inline vec<double> as_real(ivec<double> a) { return _mm512_castsi512_pd(a.v); }
+
+inline bool any(mask<float> m) { return m.m != 0; }
+inline bool any(mask<double> m) { return m.m != 0; }
+
+#elif defined(__AVX__)
+
+template <> struct mask<float>
+{
+    __m256 m;
+    friend mask operator&&(mask a, mask b) { return { _mm256_and_ps(a.m, b.m) }; }
+    friend mask operator||(mask a, mask b) { return { _mm256_or_ps(a.m, b.m) }; }
+    friend mask operator!(mask a)
+    { return { _mm256_xor_ps(a.m, _mm256_castsi256_ps(_mm256_set1_epi32(-1))) }; }
+};
+
+template <> struct vec<float>
+{
+    static constexpr int width = 8;
+    __m256 v;
+    vec() {}
+    vec(__m256 v): v(v) {}
+    vec(float x): v(_mm256_set1_ps(x)) {}
+    static vec load(const float * p) { return _mm256_loadu_ps(p); }
+    friend void store(float * p, vec a) { _mm256_storeu_ps(p, a.v); }
+    friend vec operator+(vec a, vec b) { return _mm256_add_ps(a.v, b.v); }
+    friend vec operator-(vec a, vec b) { return _mm256_sub_ps(a.v, b.v); }
+    friend vec operator*(vec a, vec b) { return _mm256_mul_ps(a.v, b.v); }
+    friend vec operator/(vec a, vec b) { return _mm256_div_ps(a.v, b.v); }
+    friend vec operator-(vec a) { return _mm256_xor_ps(a.v, _mm256_set1_ps(-0.0f)); }
+    friend mask<float> operator<(vec a, vec b) { return { _mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ) }; }
+    friend mask<float> operator<=(vec a, vec b) { return { _mm256_cmp_ps(a.v, b.v, _CMP_LE_OQ) }; }
+    friend mask<float> operator>(vec a, vec b) { return { _mm256_cmp_ps(a.v, b.v, _CMP_GT_OQ) }; }
+    friend mask<float> operator>=(vec a, vec b) { return { _mm256_cmp_ps(a.v, b.v, _CMP_GE_OQ) }; }
+    friend mask<float> operator==(vec a, vec b) { return { _mm256_cmp_ps(a.v, b.v, _CMP_EQ_OQ) }; }
+    friend mask<float> operator!=(vec a, vec b) { return { _mm256_cmp_ps(a.v, b.v, _CMP_NEQ_UQ) }; }
+    friend vec min(vec a, vec b) { return _mm256_min_ps(a.v, b.v); }
+    friend vec max(vec a, vec b) { return _mm256_max_ps(a.v, b.v); }
+    friend vec sqrt(vec a) { return _mm256_sqrt_ps(a.v); }
+    friend vec abs(vec a) { return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a.v); }
+    friend vec select(mask<float> m, vec a, vec b) { return _mm256_blendv_ps(b.v, a.v, m.m); }
+};
+
+template <> struct mask<double>
+{
+    __m256d m;
+    friend mask operator&&(mask a, mask b) { return { _mm256_and_pd(a.m, b.m) }; }
+    friend mask operator||(mask a, mask b) { return { _mm256_or_pd(a.m, b.m) }; }
+    friend mask operator!(mask a)
+    { return { _mm256_xor_pd(a.m, _mm256_castsi256_pd(_mm256_set1_epi32(-1))) }; }
+};
+
+template <> struct vec<double>
+{
+    static constexpr int width = 4;
+    __m256d v;
+    vec() {}
+    vec(__m256d v): v(v) {}
+    vec(double x): v(_mm256_set1_pd(x)) {}
+    static vec load(const double * p) { return _mm256_loadu_pd(p); }
+    friend void store(double * p, vec a) { _mm256_storeu_pd(p, a.v); }
+    friend vec operator+(vec a, vec b) { return _mm256_add_pd(a.v, b.v); }
+    friend vec operator-(vec a, vec b) { return _mm256_sub_pd(a.v, b.v); }
+    friend vec operator*(vec a, vec b) { return _mm256_mul_pd(a.v, b.v); }
+    friend vec operator/(vec a, vec b) { return _mm256_div_pd(a.v, b.v); }
+    friend vec operator-(vec a) { return _mm256_xor_pd(a.v, _mm256_set1_pd(-0.0)); }
+    friend mask<double> operator<(vec a, vec b) { return { _mm256_cmp_pd(a.v, b.v, _CMP_LT_OQ) }; }
+    friend mask<double> operator<=(vec a, vec b) { return { _mm256_cmp_pd(a.v, b.v, _CMP_LE_OQ) }; }
+    friend mask<double> operator>(vec a, vec b) { return { _mm256_cmp_pd(a.v, b.v, _CMP_GT_OQ) }; }
+    friend mask<double> operator>=(vec a, vec b) { return { _mm256_cmp_pd(a.v, b.v, _CMP_GE_OQ) }; }
+    friend mask<double> operator==(vec a, vec b) { return { _mm256_cmp_pd(a.v, b.v, _CMP_EQ_OQ) }; }
+    friend mask<double> operator!=(vec a, vec b) { return { _mm256_cmp_pd(a.v, b.v, _CMP_NEQ_UQ) }; }
+    friend vec min(vec a, vec b) { return _mm256_min_pd(a.v, b.v); }
+    friend vec max(vec a, vec b) { return _mm256_max_pd(a.v, b.v); }
+    friend vec sqrt(vec a) { return _mm256_sqrt_pd(a.v); }
+    friend vec abs(vec a) { return _mm256_andnot_pd(_mm256_set1_pd(-0.0), a.v); }
+    friend vec select(mask<double> m, vec a, vec b) { return _mm256_blendv_pd(b.v, a.v, m.m); }
+};
+
+#if !defined(__AVX2__)
+
+// Without AVX2, integer operations are done on 128-bit halves.
+
+template <typename F>
+inline __m256i on_halves(__m256i a, __m256i b, F f)
+{
+    __m128i lo = f(_mm256_castsi256_si128(a), _mm256_castsi256_si128(b));
+    __m128i hi = f(_mm256_extractf128_si256(a, 1), _mm256_extractf128_si256(b, 1));
+    return _mm256_insertf128_si256(_mm256_castsi128_si256(lo), hi, 1);
+}
+
+#endif
+
+template <> struct ivec<float>
+{
+    __m256i v;
+    ivec() {}
+    ivec(__m256i v): v(v) {}
+    ivec(std::int32_t x): v(_mm256_set1_epi32(x)) {}
+#if defined(__AVX2__)
+    friend ivec operator+(ivec a, ivec b) { return _mm256_add_epi32(a.v, b.v); }
+    friend ivec operator-(ivec a, ivec b) { return _mm256_sub_epi32(a.v, b.v); }
+    friend ivec operator&(ivec a, ivec b) { return _mm256_and_si256(a.v, b.v); }
+    friend ivec operator|(ivec a, ivec b) { return _mm256_or_si256(a.v, b.v); }
+    friend ivec shift_left(ivec a, int n) { return _mm256_sll_epi32(a.v, _mm_cvtsi32_si128(n)); }
+    friend ivec shift_right(ivec a, int n) { return _mm256_srl_epi32(a.v, _mm_cvtsi32_si128(n)); }
+#else
+    friend ivec operator+(ivec a, ivec b)
+    { return on_halves(a.v, b.v, [](__m128i x, __m128i y){ return _mm_add_epi32(x, y); }); }
+    friend ivec operator-(ivec a, ivec b)
+    { return on_halves(a.v, b.v, [](__m128i x, __m128i y){ return _mm_sub_epi32(x, y); }); }
+    friend ivec operator&(ivec a, ivec b)
+    { return _mm256_castps_si256(_mm256_and_ps(_mm256_castsi256_ps(a.v), _mm256_castsi256_ps(b.v))); }
+    friend ivec operator|(ivec a, ivec b)
+    { return _mm256_castps_si256(_mm256_or_ps(_mm256_castsi256_ps(a.v), _mm256_castsi256_ps(b.v))); }
+    friend ivec shift_left(ivec a, int n)
+    { return on_halves(a.v, a.v, [n](__m128i x, __m128i){ return _mm_sll_epi32(x, _mm_cvtsi32_si128(n)); }); }
+    friend ivec shift_right(ivec a, int n)
+    { return on_halves(a.v, a.v, [n](__m128i x, __m128i){ return _mm_srl_epi32(x, _mm_cvtsi32_si128(n)); }); }
+#endif
+};
+
+template <> struct ivec<double>
+{
+    __m256i v;
+    ivec() {}
+    ivec(__m256i v): v(v) {}
+    ivec(std::int64_t x): v(_mm256_set1_epi64x(x)) {}
+#if defined(__AVX2__)
+    friend ivec operator+(ivec a, ivec b) { return _mm256_add_epi64(a.v, b.v); }
+    friend ivec operator-(ivec a, ivec b) { return _mm256_sub_epi64(a.v, b.v); }
+    friend ivec operator&(ivec a, ivec b) { return _mm256_and_si256(a.v, b.v); }
+    friend ivec operator|(ivec a, ivec b) { return _mm256_or_si256(a.v, b.v); }
+    friend ivec shift_left(ivec a, int n) { return _mm256_sll_epi64(a.v, _mm_cvtsi32_si128(n)); }
+    friend ivec shift_right(ivec a, int n) { return _mm256_srl_epi64(a.v, _mm_cvtsi32_si128(n)); }
+#else
+    friend ivec operator+(ivec a, ivec b)
+    { return on_halves(a.v, b.v, [](__m128i x, __m128i y){ return _mm_add_epi64(x, y); }); }
+    friend ivec operator-(ivec a, ivec b)
+    { return on_halves(a.v, b.v, [](__m128i x, __m128i y){ return _mm_sub_epi64(x, y); }); }
+    friend ivec operator&(ivec a, ivec b)
+    { return _mm256_castpd_si256(_mm256_and_pd(_mm256_castsi256_pd(a.v), _mm256_castsi256_pd(b.v))); }
+    friend ivec operator|(ivec a, ivec b)
+    { return _mm256_castpd_si256(_mm256_or_pd(_mm256_castsi256_pd(a.v), _mm256_castsi256_pd(b.v))); }
+    friend ivec shift_left(ivec a, int n)
+    { return on_halves(a.v, a.v, [n](__m128i x, __m128i){ return _mm_sll_epi64(x, _mm_cvtsi32_si128(n)); }); }
+    friend ivec shift_right(ivec a, int n)
+    { return on_halves(a.v, a.v, [n](__m128i x, __m128i){ return _mm_srl_epi64(x, _mm_cvtsi32_si128(n)); }); }
+#endif
+};
+
+inline ivec<float> as_int(vec<float> a) { return _mm256_castps_si256(a.v); }
+inline vec<float> as_real(ivec<float> a) { return _mm256_castsi256_ps(a.v); }
+inline ivec<double> as_int(vec<double> a) { return _mm256_castpd_si256(a.v); }
+inline vec<double> as_real(ivec<double> a) { return _mm256_castsi256_pd(a.v); }
+
+inline bool any(mask<float> m) { return _mm256_movemask_ps(m.m) != 0; }
+inline bool any(mask<double> m) { return _mm256_movemask_pd(m.m) != 0; }
+
+#elif defined(__SSE2__)
+
+template <> struct mask<float>
+{
+    __m128 m;
+    friend mask operator&&(mask a, mask b) { return { _mm_and_ps(a.m, b.m) }; }
+    friend mask operator||(mask a, mask b) { return { _mm_or_ps(a.m, b.m) }; }
+    friend mask operator!(mask a)
+    { return { _mm_xor_ps(a.m, _mm_castsi128_ps(_mm_set1_epi32(-1))) }; }
+};
+
+template <> struct vec<float>
+{
+    static constexpr int width = 4;
+    __m128 v;
+    vec() {}
+    vec(__m128 v): v(v) {}
+    vec(float x): v(_mm_set1_ps(x)) {}
+    static vec load(const float * p) { return _mm_loadu_ps(p); }
+    friend void store(float * p, vec a) { _mm_storeu_ps(p, a.v); }
+    friend vec operator+(vec a, vec b) { return _mm_add_ps(a.v, b.v); }
+    friend vec operator-(vec a, vec b) { return _mm_sub_ps(a.v, b.v); }
+    friend vec operator*(vec a, vec b) { return _mm_mul_ps(a.v, b.v); }
+    friend vec operator/(vec a, vec b) { return _mm_div_ps(a.v, b.v); }
+    friend vec operator-(vec a) { return _mm_xor_ps(a.v, _mm_set1_ps(-0.0f)); }
+    friend mask<float> operator<(vec a, vec b) { return { _mm_cmplt_ps(a.v, b.v) }; }
+    friend mask<float> operator<=(vec a, vec b) { return { _mm_cmple_ps(a.v, b.v) }; }
+    friend mask<float> operator>(vec a, vec b) { return { _mm_cmpgt_ps(a.v, b.v) }; }
+    friend mask<float> operator>=(vec a, vec b) { return { _mm_cmpge_ps(a.v, b.v) }; }
+    friend mask<float> operator==(vec a, vec b) { return { _mm_cmpeq_ps(a.v, b.v) }; }
+    friend mask<float> operator!=(vec a, vec b) { return { _mm_cmpneq_ps(a.v, b.v) }; }
+    friend vec min(vec a, vec b) { return _mm_min_ps(a.v, b.v); }
+    friend vec max(vec a, vec b) { return _mm_max_ps(a.v, b.v); }
+    friend vec sqrt(vec a) { return _mm_sqrt_ps(a.v); }
+    friend vec abs(vec a) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), a.v); }
+    friend vec select(mask<float> m, vec a, vec b)
+    { return _mm_or_ps(_mm_and_ps(m.m, a.v), _mm_andnot_ps(m.m, b.v)); }
+};
+
+template <> struct mask<double>
+{
+    __m128d m;
+    friend mask operator&&(mask a, mask b) { return { _mm_and_pd(a.m, b.m) }; }
+    friend mask operator||(mask a, mask b) { return { _mm_or_pd(a.m, b.m) }; }
+    friend mask operator!(mask a)
+    { return { _mm_xor_pd(a.m, _mm_castsi128_pd(_mm_set1_epi32(-1))) }; }
+};
+
+template <> struct vec<double>
+{
+    static constexpr int width = 2;
+    __m128d v;
+    vec() {}
+    vec(__m128d v): v(v) {}
+    vec(double x): v(_mm_set1_pd(x)) {}
+    static vec load(const double * p) { return _mm_loadu_pd(p); }
+    friend void store(double * p, vec a) { _mm_storeu_pd(p, a.v); }
+    friend vec operator+(vec a, vec b) { return _mm_add_pd(a.v, b.v); }
+    friend vec operator-(vec a, vec b) { return _mm_sub_pd(a.v, b.v); }
+    friend vec operator*(vec a, vec b) { return _mm_mul_pd(a.v, b.v); }
+    friend vec operator/(vec a, vec b) { return _mm_div_pd(a.v, b.v); }
+    friend vec operator-(vec a) { return _mm_xor_pd(a.v, _mm_set1_pd(-0.0)); }
+    friend mask<double> operator<(vec a, vec b) { return { _mm_cmplt_pd(a.v, b.v) }; }
+    friend mask<double> operator<=(vec a, vec b) { return { _mm_cmple_pd(a.v, b.v) }; }
+    friend mask<double> operator>(vec a, vec b) { return { _mm_cmpgt_pd(a.v, b.v) }; }
+    friend mask<double> operator>=(vec a, vec b) { return { _mm_cmpge_pd(a.v, b.v) }; }
+    friend mask<double> operator==(vec a, vec b) { return { _mm_cmpeq_pd(a.v, b.v) }; }
+    friend mask<double> operator!=(vec a, vec b) { return { _mm_cmpneq_pd(a.v, b.v) }; }
+    friend vec min(vec a, vec b) { return _mm_min_pd(a.v, b.v); }
+    friend vec max(vec a, vec b) { return _mm_max_pd(a.v, b.v); }
+    friend vec sqrt(vec a) { return _mm_sqrt_pd(a.v); }
+    friend vec abs(vec a) { return _mm_andnot_pd(_mm_set1_pd(-0.0), a.v); }
+    friend vec select(mask<double> m, vec a, vec b)
+    { return _mm_or_pd(_mm_and_pd(m.m, a.v), _mm_andnot_pd(m.m, b.v)); }
+};
+
+template <> struct ivec<float>
+{
+    __m128i v;
+    ivec() {}
+    ivec(__m128i v): v(v) {}
+    ivec(std::int32_t x): v(_mm_set1_epi32(x)) {}
+    friend ivec operator+(ivec a, ivec b) { return _mm_add_epi32(a.v, b.v); }
+    friend ivec operator-(ivec a, ivec b) { return _mm_sub_epi32(a.v, b.v); }
+    friend ivec operator&(ivec a, ivec b) { return _mm_and_si128(a.v, b.v); }
+    friend ivec operator|(ivec a, ivec b) { return _mm_or_si128(a.v, b.v); }
+    friend ivec shift_left(ivec a, int n) { return _mm_sll_epi32(a.v, _mm_cvtsi32_si128(n)); }
+    friend ivec shift_right(ivec a, int n) { return _mm_srl_epi32(a.v, _mm_cvtsi32_si128(n)); }
+};
+
+template <> struct ivec<double>
+{
+    __m128i v;
+    ivec() {}
+    ivec(__m128i v): v(v) {}
+    ivec(std::int64_t x): v(_mm_set1_epi64x(x)) {}
+    friend ivec operator+(ivec a, ivec b) { return _mm_add_epi64(a.v, b.v); }
+    friend ivec operator-(ivec a, ivec b) { return _mm_sub_epi64(a.v, b.v); }
+    friend ivec operator&(ivec a, ivec b) { return _mm_and_si128(a.v, b.v); }
+    friend ivec operator|(ivec a, ivec b) { return _mm_or_si128(a.v, b.v); }
+    friend ivec shift_left(ivec a, int n) { return _mm_sll_epi64(a.v, _mm_cvtsi32_si128(n)); }
+    friend ivec shift_right(ivec a, int n) { return _mm_srl_epi64(a.v, _mm_cvtsi32_si128(n)); }
+};
+
+inline ivec<float> as_int(vec<float> a) { return _mm_castps_si128(a.v); }
+inline vec<float> as_real(ivec<float> a) { return _mm_castsi128_ps(a.v); }
+inline ivec<double> as_int(vec<double> a) { return _mm_castpd_si128(a.v); }
+inline vec<double> as_real(ivec<double> a) { return _mm_castsi128_pd(a.v); }
+
+inline bool any(mask<float> m) { return _mm_movemask_ps(m.m) != 0; }
+inline bool any(mask<double> m) { return _mm_movemask_pd(m.m) != 0; }
+
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+
+template <> struct mask<float>
+{
+    uint32x4_t m;
+    friend mask operator&&(mask a, mask b) { return { vandq_u32(a.m, b.m) }; }
+    friend mask operator||(mask a, mask b) { return { vorrq_u32(a.m, b.m) }; }
+    friend mask operator!(mask a) { return { vmvnq_u32(a.m) }; }
+};
+
+template <> struct vec<float>
+{
+    static constexpr int width = 4;
+    float32x4_t v;
+    vec() {}
+    vec(float32x4_t v): v(v) {}
+    vec(float x): v(vdupq_n_f32(x)) {}
+    static vec load(const float * p) { return vld1q_f32(p); }
+    friend void store(float * p, vec a) { vst1q_f32(p, a.v); }
+    friend vec operator+(vec a, vec b) { return vaddq_f32(a.v, b.v); }
+    friend vec operator-(vec a, vec b) { return vsubq_f32(a.v, b.v); }
+    friend vec operator*(vec a, vec b) { return vmulq_f32(a.v, b.v); }
+    friend vec operator/(vec a, vec b) { return vdivq_f32(a.v, b.v); }
+    friend vec operator-(vec a) { return vnegq_f32(a.v); }
+    friend mask<float> operator<(vec a, vec b) { return { vcltq_f32(a.v, b.v) }; }
+    friend mask<float> operator<=(vec a, vec b) { return { vcleq_f32(a.v, b.v) }; }
+    friend mask<float> operator>(vec a, vec b) { return { vcgtq_f32(a.v, b.v) }; }
+    friend mask<float> operator>=(vec a, vec b) { return { vcgeq_f32(a.v, b.v) }; }
+    friend mask<float> operator==(vec a, vec b) { return { vceqq_f32(a.v, b.v) }; }
+    friend mask<float> operator!=(vec a, vec b) { return { vmvnq_u32(vceqq_f32(a.v, b.v)) }; }
+    friend vec min(vec a, vec b) { return vminq_f32(a.v, b.v); }
+    friend vec max(vec a, vec b) { return vmaxq_f32(a.v, b.v); }
+    friend vec sqrt(vec a) { return vsqrtq_f32(a.v); }
+    friend vec abs(vec a) { return vabsq_f32(a.v); }
+    friend vec select(mask<float> m, vec a, vec b) { return vbslq_f32(m.m, a.v, b.v); }
+};
+
+template <> struct mask<double>
+{
+    uint64x2_t m;
+    friend mask operator&&(mask a, mask b) { return { vandq_u64(a.m, b.m) }; }
+    friend mask operator||(mask a, mask b) { return { vorrq_u64(a.m, b.m) }; }
+    friend mask operator!(mask a) { return { veorq_u64(a.m, vdupq_n_u64(~uint64_t(0))) }; }
+};
+
+template <> struct vec<double>
+{
+    static constexpr int width = 2;
+    float64x2_t v;
+    vec() {}
+    vec(float64x2_t v): v(v) {}
+    vec(double x): v(vdupq_n_f64(x)) {}
+    static vec load(const double * p) { return vld1q_f64(p); }
+    friend void store(double * p, vec a) { vst1q_f64(p, a.v); }
+    friend vec operator+(vec a, vec b) { return vaddq_f64(a.v, b.v); }
+    friend vec operator-(vec a, vec b) { return vsubq_f64(a.v, b.v); }
+    friend vec operator*(vec a, vec b) { return vmulq_f64(a.v, b.v); }
+    friend vec operator/(vec a, vec b) { return vdivq_f64(a.v, b.v); }
+    friend vec operator-(vec a) { return vnegq_f64(a.v); }
+    friend mask<double> operator<(vec a, vec b) { return { vcltq_f64(a.v, b.v) }; }
+    friend mask<double> operator<=(vec a, vec b) { return { vcleq_f64(a.v, b.v) }; }
+    friend mask<double> operator>(vec a, vec b) { return { vcgtq_f64(a.v, b.v) }; }
+    friend mask<double> operator>=(vec a, vec b) { return { vcgeq_f64(a.v, b.v) }; }
+    friend mask<double> operator==(vec a, vec b) { return { vceqq_f64(a.v, b.v) }; }
+    friend mask<double> operator!=(vec a, vec b) { return !mask<double>{ vceqq_f64(a.v, b.v) }; }
+    friend vec min(vec a, vec b) { return vminq_f64(a.v, b.v); }
+    friend vec max(vec a, vec b) { return vmaxq_f64(a.v, b.v); }
+    friend vec sqrt(vec a) { return vsqrtq_f64(a.v); }
+    friend vec abs(vec a) { return vabsq_f64(a.v); }
+    friend vec select(mask<double> m, vec a, vec b) { return vbslq_f64(m.m, a.v, b.v); }
+};
+
+template <> struct ivec<float>
+{
+    int32x4_t v;
+    ivec() {}
+    ivec(int32x4_t v): v(v) {}
+    ivec(std::int32_t x): v(vdupq_n_s32(x)) {}
+    friend ivec operator+(ivec a, ivec b) { return vaddq_s32(a.v, b.v); }
+    friend ivec operator-(ivec a, ivec b) { return vsubq_s32(a.v, b.v); }
+    friend ivec operator&(ivec a, ivec b) { return vandq_s32(a.v, b.v); }
+    friend ivec operator|(ivec a, ivec b) { return vorrq_s32(a.v, b.v); }
+    friend ivec shift_left(ivec a, int n) { return vshlq_s32(a.v, vdupq_n_s32(n)); }
+    friend ivec shift_right(ivec a, int n)
+    { return vreinterpretq_s32_u32(vshlq_u32(vreinterpretq_u32_s32(a.v), vdupq_n_s32(-n))); }
+};
+
+template <> struct ivec<double>
+{
+    int64x2_t v;
+    ivec() {}
+    ivec(int64x2_t v): v(v) {}
+    ivec(std::int64_t x): v(vdupq_n_s64(x)) {}
+    friend ivec operator+(ivec a, ivec b) { return vaddq_s64(a.v, b.v); }
+    friend ivec operator-(ivec a, ivec b) { return vsubq_s64(a.v, b.v); }
+    friend ivec operator&(ivec a, ivec b) { return vandq_s64(a.v, b.v); }
+    friend ivec operator|(ivec a, ivec b) { return vorrq_s64(a.v, b.v); }
+    friend ivec shift_left(ivec a, int n) { return vshlq_s64(a.v, vdupq_n_s64(n)); }
+    friend ivec shift_right(ivec a, int n)
+    { return vreinterpretq_s64_u64(vshlq_u64(vreinterpretq_u64_s64(a.v), vdupq_n_s64(-n))); }
+};
+
+inline ivec<float> as_int(vec<float> a) { return vreinterpretq_s32_f32(a.v); }
+inline vec<float> as_real(ivec<float> a) { return vreinterpretq_f32_s32(a.v); }
+inline ivec<double> as_int(vec<double> a) { return vreinterpretq_s64_f64(a.v); }
+inline vec<double> as_real(ivec<double> a) { return vreinterpretq_f64_s64(a.v); }
+
+inline bool any(mask<float> m) { return vmaxvq_u32(m.m) != 0; }
+inline bool any(mask<double> m) { return vmaxvq_u32(vreinterpretq_u32_u64(m.m)) != 0; }
+
+#else
+
+// No vector instructions: one element.
+
+template <typename T> struct mask
+{
+    bool m;
+    friend mask operator&&(mask a, mask b) { return { a.m && b.m }; }
+    friend mask operator||(mask a, mask b) { return { a.m || b.m }; }
+    friend mask operator!(mask a) { return { !a.m }; }
+};
+
+template <typename T> struct vec
+{
+    static constexpr int width = 1;
+    T v;
+    vec() {}
+    vec(T x): v(x) {}
+    static vec load(const T * p) { return *p; }
+    friend void store(T * p, vec a) { *p = a.v; }
+    friend vec operator+(vec a, vec b) { return a.v + b.v; }
+    friend vec operator-(vec a, vec b) { return a.v - b.v; }
+    friend vec operator*(vec a, vec b) { return a.v * b.v; }
+    friend vec operator/(vec a, vec b) { return a.v / b.v; }
+    friend vec operator-(vec a) { return -a.v; }
+    friend mask<T> operator<(vec a, vec b) { return { a.v < b.v }; }
+    friend mask<T> operator<=(vec a, vec b) { return { a.v <= b.v }; }
+    friend mask<T> operator>(vec a, vec b) { return { a.v > b.v }; }
+    friend mask<T> operator>=(vec a, vec b) { return { a.v >= b.v }; }
+    friend mask<T> operator==(vec a, vec b) { return { a.v == b.v }; }
+    friend mask<T> operator!=(vec a, vec b) { return { a.v != b.v }; }
+    friend vec min(vec a, vec b) { return std::min(a.v, b.v); }
+    friend vec max(vec a, vec b) { return std::max(a.v, b.v); }
+    friend vec sqrt(vec a) { return std::sqrt(a.v); }
+    friend vec abs(vec a) { return std::abs(a.v); }
+    friend vec select(mask<T> m, vec a, vec b) { return m.m ? a.v : b.v; }
+};
+
+template <typename T> struct ivec
+{
+    using type = typename std::conditional<sizeof(T) == 4, std::int32_t, std::int64_t>::type;
+    using unsigned_type = typename std::make_unsigned<type>::type;
+    type v;
+    ivec() {}
+    ivec(type x): v(x) {}
+    friend ivec operator+(ivec a, ivec b) { return type(unsigned_type(a.v) + unsigned_type(b.v)); }
+    friend ivec operator-(ivec a, ivec b) { return type(unsigned_type(a.v) - unsigned_type(b.v)); }
+    friend ivec operator&(ivec a, ivec b) { return type(a.v & b.v); }
+    friend ivec operator|(ivec a, ivec b) { return type(a.v | b.v); }
+    friend ivec shift_left(ivec a, int n) { return type(unsigned_type(a.v) << n); }
+    friend ivec shift_right(ivec a, int n) { return type(unsigned_type(a.v) >> n); }
+};
+
+template <typename T>
+inline ivec<T> as_int(vec<T> a) { ivec<T> r; std::memcpy(&r.v, &a.v, sizeof(T)); return r; }
+template <typename T>
+inline vec<T> as_real(ivec<T> a) { vec<T> r; std::memcpy(&r.v, &a.v, sizeof(T)); return r; }
+
+template <typename T>
+inline bool any(mask<T> m) { return m.m; }
+
+#endif
+
+// Combination of all elements of a vector, in order of elements.
+
+template <typename T, typename F>
+inline T reduce(vec<T> a, F f)
+{
+    T e[vec<T>::width];
+    store(e, a);
+    T r = e[0];
+    for (int i = 1; i < vec<T>::width; ++i)
+        r = f(r, e[i]);
+    return r;
+}
+
+template <typename T>
+inline T reduce_add(vec<T> a) { return reduce(a, [](T x, T y){ return x + y; }); }
+template <typename T>
+inline T reduce_mul(vec<T> a) { return reduce(a, [](T x, T y){ return x * y; }); }
+template <typename T>
+inline T reduce_min(vec<T> a) { return reduce(a, [](T x, T y){ return std::min(x, y); }); }
+template <typename T>
+inline T reduce_max(vec<T> a) { return reduce(a, [](T x, T y){ return std::max(x, y); }); }
+
+// First-order linear recurrence y[k] = a * y[k-1] + u[k],
+// computed for a block of 'width' elements at a time:
+// y[j] = a^(j+1) * y[-1] + sum(i <= j) a^(j-i) * u[i].
+// The terms are independent, so the block does not wait
+// for each element in turn.
+//
+// Set input[0 ... width-1], call r(y[-1]), read output[0 ... width-1].
+
+template <typename T> struct linear_recurrence
+{
+    static constexpr int width = vec<T>::width;
+
+    T input[width];
+    T output[width];
+
+    linear_recurrence(T a)
+    {
+        T p = 1;
+        for (int j = 0; j < width; ++j)
+        {
+            p *= a;
+            m_powers[j] = p;
+        }
+        for (int i = 0; i < width; ++i)
+        {
+            for (int j = 0; j < width; ++j)
+                m_impulses[i][j] = j < i ? T(0) : (j == i ? T(1) : m_powers[j-i-1]);
+        }
+    }
+
+    void operator()(T previous)
+    {
+        vec<T> y = vec<T>::load(m_powers) * vec<T>(previous);
+        for (int i = 0; i < width; ++i)
+            y = y + vec<T>::load(m_impulses[i]) * vec<T>(input[i]);
+        store(output, y);
+    }
+
+private:
+    T m_powers[width];
+    T m_impulses[width][width];
+};
+
+}
+}
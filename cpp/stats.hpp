@@ -0,0 +1,223 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <iomanip>
+
+namespace arrp {
+
+// Durations of periods of a program, in nanoseconds:
+// count, minimum, mean, maximum, a histogram with logarithmic buckets,
+// and number of periods longer than a budget (deadline misses).
+//
+// Periods are recorded by the thread executing the program,
+// and statistics may be read concurrently by any other thread.
+// Values are kept in relaxed atomics, so a reader may see
+// a period counted in some values and not yet in others.
+//
+// Time spent waiting for I/O within a period, as reported by
+// the host using exclude(), does not count towards its duration.
+
+class period_stats
+{
+public:
+    // Each power of two is split into this many buckets.
+    static constexpr int sub_buckets = 4;
+    static constexpr int bucket_count = (64 - 1) * sub_buckets;
+
+    static std::uint64_t now()
+    {
+        using namespace std::chrono;
+        return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+    }
+
+    // Periods longer than budget are counted as misses.
+    // No misses are counted if budget is 0.
+    void set_budget(std::uint64_t ns) { m_budget.store(ns, std::memory_order_relaxed); }
+    std::uint64_t budget() const { return m_budget.load(std::memory_order_relaxed); }
+
+    // Used by the program at start and end of each period.
+
+    void begin()
+    {
+        m_excluded = 0;
+        m_start = now();
+    }
+
+    void end()
+    {
+        std::uint64_t duration = now() - m_start;
+        duration = duration > m_excluded ? duration - m_excluded : 0;
+        record(duration);
+    }
+
+    void exclude(std::uint64_t ns) { m_excluded += ns; }
+
+    void record(std::uint64_t ns)
+    {
+        // Only one thread writes, so increments need not be atomic.
+        auto add = [](std::atomic<std::uint64_t> & a, std::uint64_t v)
+        { a.store(a.load(std::memory_order_relaxed) + v, std::memory_order_relaxed); };
+
+        std::uint64_t n = m_count.load(std::memory_order_relaxed);
+        if (n == 0 || ns < m_min.load(std::memory_order_relaxed))
+            m_min.store(ns, std::memory_order_relaxed);
+        if (ns > m_max.load(std::memory_order_relaxed))
+            m_max.store(ns, std::memory_order_relaxed);
+
+        add(m_sum, ns);
+        add(m_buckets[bucket(ns)], 1);
+
+        std::uint64_t b = budget();
+        if (b && ns > b)
+            add(m_misses, 1);
+
+        m_count.store(n + 1, std::memory_order_release);
+    }
+
+    // Adds periods recorded by other statistics,
+    // for example of another instance of the same program.
+    // Must be called by the thread that records these.
+    void merge(const period_stats & other)
+    {
+        auto add = [](std::atomic<std::uint64_t> & a, std::uint64_t v)
+        { a.store(a.load(std::memory_order_relaxed) + v, std::memory_order_relaxed); };
+
+        std::uint64_t other_n = other.count();
+        if (other_n == 0)
+            return;
+
+        std::uint64_t n = m_count.load(std::memory_order_relaxed);
+        if (n == 0 || other.min() < min())
+            m_min.store(other.min(), std::memory_order_relaxed);
+        if (other.max() > max())
+            m_max.store(other.max(), std::memory_order_relaxed);
+
+        add(m_sum, other.m_sum.load(std::memory_order_relaxed));
+        add(m_misses, other.misses());
+        for (int i = 0; i < bucket_count; ++i)
+            add(m_buckets[i], other.bucket_value(i));
+        if (!budget())
+            set_budget(other.budget());
+
+        m_count.store(n + other_n, std::memory_order_release);
+    }
+
+    std::uint64_t count() const { return m_count.load(std::memory_order_acquire); }
+    std::uint64_t min() const { return m_min.load(std::memory_order_relaxed); }
+    std::uint64_t max() const { return m_max.load(std::memory_order_relaxed); }
+    std::uint64_t misses() const { return m_misses.load(std::memory_order_relaxed); }
+
+    double mean() const
+    {
+        std::uint64_t n = count();
+        return n ? double(m_sum.load(std::memory_order_relaxed)) / n : 0.0;
+    }
+
+    // Upper bound of duration of given fraction of periods,
+    // within resolution of the histogram.
+    std::uint64_t percentile(double fraction) const
+    {
+        std::uint64_t n = 0;
+        for (int i = 0; i < bucket_count; ++i)
+            n += m_buckets[i].load(std::memory_order_relaxed);
+        if (n == 0)
+            return 0;
+
+        // Nearest rank: smallest count covering the fraction.
+        std::uint64_t target = std::uint64_t(std::ceil(fraction * n));
+        if (target < 1)
+            target = 1;
+
+        std::uint64_t sum = 0;
+        for (int i = 0; i < bucket_count; ++i)
+        {
+            sum += m_buckets[i].load(std::memory_order_relaxed);
+            if (sum >= target)
+                return std::min(bucket_end(i), max());
+        }
+        return max();
+    }
+
+    std::uint64_t bucket_value(int i) const { return m_buckets[i].load(std::memory_order_relaxed); }
+
+    // Smallest duration in bucket i.
+    static std::uint64_t bucket_start(int i)
+    {
+        if (i < sub_buckets)
+            return i;
+        int msb = i / sub_buckets + 1;
+        std::uint64_t sub = i % sub_buckets;
+        return (std::uint64_t(sub_buckets) + sub) << (msb - 2);
+    }
+
+    // Largest duration in bucket i.
+    static std::uint64_t bucket_end(int i)
+    {
+        return i + 1 < bucket_count ? bucket_start(i + 1) - 1 : ~std::uint64_t(0);
+    }
+
+    static int bucket(std::uint64_t ns)
+    {
+        if (ns < sub_buckets)
+            return int(ns);
+        int msb = 63 - leading_zeros(ns);
+        int sub = int(ns >> (msb - 2)) & (sub_buckets - 1);
+        return (msb - 1) * sub_buckets + sub;
+    }
+
+    // Prints durations in microseconds.
+    void print(std::ostream & out) const
+    {
+        auto us = [](double ns) { return ns / 1000.0; };
+
+        auto flags = out.flags();
+        auto precision = out.precision();
+
+        out << std::fixed << std::setprecision(3);
+        out << "periods: " << count() << std::endl;
+        out << "period time (us): min " << us(min())
+            << ", mean " << us(mean())
+            << ", p99 " << us(percentile(0.99))
+            << ", max " << us(max()) << std::endl;
+        if (budget())
+        {
+            out << "budget (us): " << us(budget())
+                << ", misses: " << misses() << std::endl;
+        }
+
+        out.flags(flags);
+        out.precision(precision);
+    }
+
+private:
+    static int leading_zeros(std::uint64_t v)
+    {
+#if defined(__GNUC__)
+        return __builtin_clzll(v);
+#else
+        int n = 0;
+        for (std::uint64_t bit = std::uint64_t(1) << 63; !(v & bit); bit >>= 1)
+            ++n;
+        return n;
+#endif
+    }
+
+    std::atomic<std::uint64_t> m_count { 0 };
+    std::atomic<std::uint64_t> m_sum { 0 };
+    std::atomic<std::uint64_t> m_min { 0 };
+    std::atomic<std::uint64_t> m_max { 0 };
+    std::atomic<std::uint64_t> m_misses { 0 };
+    std::atomic<std::uint64_t> m_budget { 0 };
+    std::atomic<std::uint64_t> m_buckets[bucket_count] {};
+
+    // Used only by the thread executing the program.
+    std::uint64_t m_start = 0;
+    std::uint64_t m_excluded = 0;
+};
+
+}
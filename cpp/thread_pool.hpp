@@ -0,0 +1,231 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace arrp {
+
+// Persistent pool of worker threads which execute parallel loops
+// in static chunks.
+// The calling thread executes the first chunk.
+// Idle workers spin for a while before parking,
+// so that successive short loops avoid the cost of waking threads.
+//
+// By default, there is a thread for each CPU the process may run on,
+// and each worker is pinned to one of those CPUs.
+// Pinning can be disabled, for example when several programs
+// share the CPUs.
+
+class thread_pool
+{
+public:
+    thread_pool(int thread_count = 0, bool pin_threads = true)
+    {
+        m_cpus = allowed_cpus();
+
+        if (thread_count <= 0)
+            thread_count = std::max<int>(1, m_cpus.size());
+
+        m_thread_count = thread_count;
+
+        if (!pin_threads)
+            m_cpus.clear();
+
+        for (int i = 1; i < thread_count; ++i)
+            m_workers.emplace_back(&thread_pool::work, this, i);
+    }
+
+    ~thread_pool()
+    {
+        m_stop = true;
+        wake();
+        for (auto & worker : m_workers)
+            worker.join();
+    }
+
+    thread_pool(const thread_pool &) = delete;
+    thread_pool & operator=(const thread_pool &) = delete;
+
+    int size() const { return m_thread_count; }
+
+    // Calls f(i) for each i in [begin, end).
+
+    template <typename F>
+    void parallel_for(int begin, int end, F && f)
+    {
+        using func_type = typename std::remove_reference<F>::type;
+
+        if (end - begin < 2 || m_thread_count < 2)
+        {
+            for (int i = begin; i < end; ++i)
+                f(i);
+            return;
+        }
+
+        m_task = [](void * data, int b, int e)
+        {
+            auto & f = *static_cast<func_type*>(data);
+            for (int i = b; i < e; ++i)
+                f(i);
+        };
+        m_task_data = (void*) &f;
+        m_begin = begin;
+        m_end = end;
+        m_pending.store(m_thread_count - 1, std::memory_order_relaxed);
+
+        wake();
+
+        run_chunk(0);
+
+        for (int i = 0; m_pending.load(std::memory_order_acquire) > 0; ++i)
+        {
+            if (i < spin_count)
+                pause();
+            else
+                std::this_thread::yield();
+        }
+    }
+
+private:
+    typedef void (*task_type)(void *, int, int);
+
+    // Busy-wait iterations before yielding or parking.
+    static constexpr int spin_count = 1000;
+    static constexpr int yield_count = 100;
+
+    static void pause()
+    {
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
+#endif
+    }
+
+    // CPUs in the affinity mask of the calling thread,
+    // else all CPUs if unknown.
+    static std::vector<int> allowed_cpus()
+    {
+        std::vector<int> cpus;
+#ifdef __linux__
+        cpu_set_t mask;
+        CPU_ZERO(&mask);
+        if (sched_getaffinity(0, sizeof(mask), &mask) == 0)
+        {
+            for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+            {
+                if (CPU_ISSET(cpu, &mask))
+                    cpus.push_back(cpu);
+            }
+        }
+#endif
+        if (cpus.empty())
+        {
+            int cpu_count = std::thread::hardware_concurrency();
+            for (int cpu = 0; cpu < cpu_count; ++cpu)
+                cpus.push_back(cpu);
+        }
+        return cpus;
+    }
+
+    void pin(int index)
+    {
+#ifdef __linux__
+        if (m_cpus.empty())
+            return;
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(m_cpus[index % m_cpus.size()], &cpus);
+        pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+#endif
+    }
+
+    void run_chunk(int index)
+    {
+        int count = m_end - m_begin;
+        int chunk = (count + m_thread_count - 1) / m_thread_count;
+        int b = m_begin + index * chunk;
+        int e = std::min(b + chunk, m_end);
+        if (b < e)
+            m_task(m_task_data, b, e);
+    }
+
+    void wake()
+    {
+        m_generation.fetch_add(1);
+
+        if (m_sleeping.load() > 0)
+        {
+            { std::lock_guard<std::mutex> lock(m_mutex); }
+            m_condition.notify_all();
+        }
+    }
+
+    unsigned wait(unsigned last)
+    {
+        for (int i = 0; i < spin_count + yield_count; ++i)
+        {
+            unsigned generation = m_generation.load(std::memory_order_acquire);
+            if (generation != last)
+                return generation;
+            if (i < spin_count)
+                pause();
+            else
+                std::this_thread::yield();
+        }
+
+        std::unique_lock<std::mutex> lock(m_mutex);
+        ++m_sleeping;
+        m_condition.wait(lock, [&]{ return m_generation.load() != last; });
+        --m_sleeping;
+
+        return m_generation.load();
+    }
+
+    void work(int index)
+    {
+        pin(index);
+
+        unsigned generation = 0;
+
+        for(;;)
+        {
+            generation = wait(generation);
+
+            if (m_stop)
+                return;
+
+            run_chunk(index);
+
+            m_pending.fetch_sub(1, std::memory_order_release);
+        }
+    }
+
+    int m_thread_count = 1;
+    // CPUs to pin workers to. Empty if not pinned.
+    std::vector<int> m_cpus;
+    std::vector<std::thread> m_workers;
+
+    task_type m_task = nullptr;
+    void * m_task_data = nullptr;
+    int m_begin = 0;
+    int m_end = 0;
+
+    std::atomic<unsigned> m_generation { 0 };
+    std::atomic<int> m_pending { 0 };
+    std::atomic<int> m_sleeping { 0 };
+    std::atomic<bool> m_stop { false };
+
+    std::mutex m_mutex;
+    std::condition_variable m_condition;
+};
+
+}
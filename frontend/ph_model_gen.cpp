@@ -231,6 +231,7 @@ void polyhedral_gen::make_input(polyhedral::model & model, id_ptr id, bool atomi
         stmt = make_shared<polyhedral::statement>(domain);
         stmt->is_input_or_output = true;
         stmt->is_infinite = ar->is_infinite;
+        stmt->location = id->location;
 
         // functional call expression
 
@@ -315,6 +316,7 @@ void polyhedral_gen::make_output(polyhedral::model & model,
     auto stmt = make_shared<polyhedral::statement>(domain);
     stmt->is_input_or_output = true;
     stmt->is_infinite = array->is_infinite;
+    stmt->location = id->location;
 
     // functional call expression
 
@@ -596,6 +598,8 @@ polyhedral::stmt_ptr polyhedral_gen::make_stmt
         }
     }
 
+    stmt->location = expr.location;
+
     m_current_stmt = stmt;
     stmt->expr = visit(expr);
 
@@ -8,6 +8,8 @@ using namespace std;
 using namespace arrp::hdf5;
 using namespace H5;
 
+// Programs compiled with --batch are not supported:
+// they define program_batch instead, with a value per instance in each element.
 using app_type = APP_NAMESPACE::program<writer>;
 
 int main(int argc, char *argv[])
@@ -26,6 +26,12 @@ void generate_io_function(const json & channel, int index, bool is_input, ostrea
     else
         out << "output(" << index << ", value);";
     out << " }" << endl;
+
+    // Block I/O
+    out << "void " << direction << "_" << name;
+    out << "(" << type << " * values, int count) { ";
+    out << direction << "(" << index << ", values, count);";
+    out << " }" << endl;
 }
 
 void generate(const options & opt, const nlohmann::json & report)
@@ -38,6 +44,11 @@ void generate(const options & opt, const nlohmann::json & report)
 
     string kernel_file_name = report["cpp"]["filename"];
     string kernel_namespace = report["cpp"]["namespace"];
+    bool has_stats = report["cpp"].count("stats") && report["cpp"]["stats"].get<bool>();
+
+    // Audio channels transfer a single value per sample.
+    if (report["cpp"].count("lanes") && report["cpp"]["lanes"].get<int>() > 1)
+        throw stream::error("JACK interface does not support a batch of program instances.");
 
     int commonPeriodFrames = -1;
 
@@ -114,6 +125,11 @@ void generate(const options & opt, const nlohmann::json & report)
     io_text << "#include <memory>" << endl;
     // FIXME: Use standard C++ to sleep forever instead of POSIX sleep from unistd.h
     io_text << "#include <unistd.h>" << endl;
+    if (has_stats)
+    {
+        io_text << "#include <signal.h>" << endl;
+        io_text << "#include <iostream>" << endl;
+    }
 
     io_text << "namespace arrp { namespace jack_io {" << endl;
 
@@ -130,8 +146,24 @@ void generate(const options & opt, const nlohmann::json & report)
             << audio_inputs.size() << ", " << audio_outputs.size() << ")" << endl
             << "{" << endl
             << " d_kernel = std::make_unique<Kernel>();" << endl
-            << " d_kernel->io = this;" << endl
-            << "}" << endl;
+            << " d_kernel->io = this;" << endl;
+    if (has_stats)
+    {
+        // A period must complete in the time it takes to play its frames.
+        io_text << " d_stats = &d_kernel->stats();" << endl;
+        if (commonPeriodFrames > 0)
+        {
+            io_text << " double rate; input_samplerate(rate);" << endl
+                    << " d_stats->set_budget(uint64_t(" << commonPeriodFrames
+                    << " * 1e9 / rate));" << endl;
+        }
+    }
+    io_text << "}" << endl;
+
+    if (has_stats)
+    {
+        io_text << "void print_stats() { d_kernel->stats().print(std::cerr); }" << endl;
+    }
 
     for (int i = 0; i < audio_inputs.size(); ++i)
     {
@@ -153,10 +185,33 @@ void generate(const options & opt, const nlohmann::json & report)
 
     io_text << "}}" << endl; // namespace
 
-    io_text << "int main () {" << endl
-            << "arrp::jack_io::Program program;" << endl
-            << "sleep(-1);" << endl
-            << "}" << endl;
+    if (has_stats)
+    {
+        // Signals are blocked in all threads and handled by main thread,
+        // which prints statistics on SIGUSR1 and before exiting.
+        io_text << "int main () {" << endl
+                << "sigset_t signals;" << endl
+                << "sigemptyset(&signals);" << endl
+                << "sigaddset(&signals, SIGUSR1);" << endl
+                << "sigaddset(&signals, SIGINT);" << endl
+                << "sigaddset(&signals, SIGTERM);" << endl
+                << "pthread_sigmask(SIG_BLOCK, &signals, nullptr);" << endl
+                << "arrp::jack_io::Program program;" << endl
+                << "for(;;) {" << endl
+                << "int signal = 0;" << endl
+                << "sigwait(&signals, &signal);" << endl
+                << "program.print_stats();" << endl
+                << "if (signal != SIGUSR1) return 0;" << endl
+                << "}" << endl
+                << "}" << endl;
+    }
+    else
+    {
+        io_text << "int main () {" << endl
+                << "arrp::jack_io::Program program;" << endl
+                << "sleep(-1);" << endl
+                << "}" << endl;
+    }
 
     {
         string filename = opt.base_file_name + "-jack-client.cpp";
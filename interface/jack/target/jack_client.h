@@ -1,8 +1,10 @@
 #pragma once
 
 #include <arrp/linear_buffer.h>
+#include <arrp/stats.hpp>
 #include <jack/jack.h>
 
+#include <algorithm>
 #include <vector>
 #include <condition_variable>
 #include <mutex>
@@ -38,7 +40,7 @@ public:
         while (d_clock_ticks >= d_frames_to_process)
         {
             d_clock_ticks = 0;
-            transmit();
+            synchronize();
         }
     }
 
@@ -52,12 +54,52 @@ public:
         d_output_bufs[i].push(value);
     }
 
+    // Block I/O copies as many frames as remain in the current JACK cycle,
+    // and continues with the next cycle when those are used up.
+
+    template <typename T>
+    void input(int i, T * values, int count)
+    {
+        auto & buf = d_input_bufs[i];
+        while (count > 0)
+        {
+            if (!buf.readable())
+                synchronize();
+            int n = std::min(count, buf.readable());
+            const float * data = buf.data() + buf.readPos();
+            std::copy(data, data + n, values);
+            buf.consume(n);
+            values += n;
+            count -= n;
+        }
+    }
+
+    template <typename T>
+    void output(int i, const T * values, int count)
+    {
+        auto & buf = d_output_bufs[i];
+        while (count > 0)
+        {
+            if (!buf.writable())
+                synchronize();
+            int n = std::min(count, buf.writable());
+            std::copy(values, values + n, buf.data() + buf.writePos());
+            buf.produce(n);
+            values += n;
+            count -= n;
+        }
+    }
+
     template <typename T>
     void input_samplerate(T & value)
     {
         value = jack_get_sample_rate(d_client);
     }
 
+protected:
+    // Statistics of kernel periods, if recorded.
+    period_stats * d_stats = nullptr;
+
 private:
     using Buffer = Linear_Buffer<float>;
 
@@ -72,6 +114,21 @@ private:
 
     virtual void process() = 0;
 
+    void synchronize()
+    {
+        // Waiting for JACK does not count towards period duration.
+        if (d_stats)
+        {
+            auto start = period_stats::now();
+            transmit();
+            d_stats->exclude(period_stats::now() - start);
+        }
+        else
+        {
+            transmit();
+        }
+    }
+
     jack_client_t * d_client;
     vector<jack_port_t*> d_inputs;
     vector<jack_port_t*> d_outputs;
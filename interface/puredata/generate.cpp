@@ -25,12 +25,23 @@ void generate_io_function(const json & channel, int index, bool is_input, ostrea
     else
         out << "output(" << index << ", value);";
     out << " }" << endl;
+
+    // Block I/O
+    out << "void " << direction << "_" << name;
+    out << "(" << type << " * values, int count) { ";
+    out << direction << "(" << index << ", values, count);";
+    out << " }" << endl;
 }
 
 void generate(const options & opt, const nlohmann::json & report)
 {
     string kernel_file_name = report["cpp"]["filename"];
     string kernel_namespace = report["cpp"]["namespace"];
+    bool has_stats = report["cpp"].count("stats") && report["cpp"]["stats"].get<bool>();
+
+    // Audio channels transfer a single value per sample.
+    if (report["cpp"].count("lanes") && report["cpp"]["lanes"].get<int>() > 1)
+        throw stream::error("Pure Data interface does not support a batch of program instances.");
 
     int commonPeriodFrames = -1;
 
@@ -105,6 +116,11 @@ void generate(const options & opt, const nlohmann::json & report)
     io_text << "#include \"" << kernel_file_name << "\"" << endl;
     io_text << "#include <arrp/puredata_io/interface.h>" << endl;
     io_text << "#include <memory>" << endl;
+    if (has_stats)
+    {
+        io_text << "#include <sstream>" << endl;
+        io_text << "#include <string>" << endl;
+    }
 
     io_text << "namespace arrp { namespace puredata_io {" << endl;
 
@@ -121,6 +137,16 @@ void generate(const options & opt, const nlohmann::json & report)
     io_text << "void prologue() override {" << endl;
     io_text << "kernel = std::make_unique<Kernel>();" << endl;
     io_text << "kernel->io = this;" << endl;
+    if (has_stats)
+    {
+        // A period must complete in the time it takes to play its frames.
+        io_text << "d_stats = &kernel->stats();" << endl;
+        if (commonPeriodFrames > 0)
+        {
+            io_text << "d_stats->set_budget(uint64_t(" << commonPeriodFrames
+                    << " * 1e9 / sys_getsr()));" << endl;
+        }
+    }
     io_text << "kernel->prelude();" << endl;
     io_text << "}" << endl;
 
@@ -128,6 +154,18 @@ void generate(const options & opt, const nlohmann::json & report)
     io_text << "kernel->period();" << endl;
     io_text << "}" << endl;
 
+    if (has_stats)
+    {
+        io_text << "void print_stats() override {" << endl;
+        io_text << "if (!kernel) return;" << endl;
+        io_text << "std::ostringstream text;" << endl;
+        io_text << "kernel->stats().print(text);" << endl;
+        io_text << "std::istringstream lines(text.str());" << endl;
+        io_text << "for (std::string line; std::getline(lines, line);)" << endl;
+        io_text << "post(\"%s\", line.c_str());" << endl;
+        io_text << "}" << endl;
+    }
+
     for (int i = 0; i < audio_inputs.size(); ++i)
     {
         generate_io_function(audio_inputs[i], i, true, io_text);
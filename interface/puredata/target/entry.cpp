@@ -54,6 +54,8 @@ static void destroy_pd_object(my_object_type * object)
 {
     //printf("Destroy\n");
 
+    object->kernel->print_stats();
+
     delete object->kernel;
 
     if (object->has_routine)
@@ -115,6 +117,11 @@ static void kernel_routine_func(void * data)
     object->kernel->process(object->buf_size);
 }
 
+static void print_stats(my_object_type * object)
+{
+    object->kernel->print_stats();
+}
+
 static void setup_pd_process_callback(my_object_type * object, t_signal **sp)
 {
     //printf("Setup DSP\n");
@@ -162,6 +169,9 @@ void library_setup(const char * name, bool has_signal_inputs)
   class_addmethod(my_class,
                   (t_method)setup_pd_process_callback, gensym("dsp"), A_CANT, 0);
 
+  class_addmethod(my_class,
+                  (t_method)print_stats, gensym("stats"), A_NULL);
+
   if (has_signal_inputs)
       CLASS_MAINSIGNALIN(my_class, my_object_type, f);
 }
@@ -1,9 +1,12 @@
 #pragma once
 
 #include <arrp/linear_buffer.h>
+#include <arrp/stats.hpp>
 #include <pcl.h>
 #include <m_pd.h>
 
+#include <algorithm>
+
 namespace arrp {
 namespace puredata_io {
 
@@ -28,7 +31,7 @@ public:
         ++d_elapsed_ticks;
         if(d_elapsed_ticks >= d_buffer_size)
         {
-            co_resume();
+            synchronize();
             d_elapsed_ticks = 0;
         }
     }
@@ -53,10 +56,16 @@ public:
         value = sys_getsr();
     }
 
+    // Posts statistics of kernel periods to Pd console, if recorded.
+    virtual void print_stats() {}
+
 protected:
     virtual void prologue() = 0;
     virtual void period() = 0;
 
+    // Statistics of kernel periods, if recorded.
+    period_stats * d_stats = nullptr;
+
     vector<Buffer> d_inputs;
     vector<Buffer> d_outputs;
     int d_buffer_size = 0;
@@ -71,6 +80,58 @@ protected:
     {
         d_outputs[i].push(value);
     }
+
+    // Block I/O copies as many samples as remain in the current DSP tick,
+    // and continues with the next tick when those are used up.
+
+    template <typename T>
+    void input(int i, T * values, int count)
+    {
+        auto & buf = d_inputs[i];
+        while (count > 0)
+        {
+            if (!buf.readable())
+                synchronize();
+            int n = std::min(count, buf.readable());
+            const float * data = buf.data() + buf.readPos();
+            std::copy(data, data + n, values);
+            buf.consume(n);
+            values += n;
+            count -= n;
+        }
+    }
+
+    template <typename T>
+    void output(int i, const T * values, int count)
+    {
+        auto & buf = d_outputs[i];
+        while (count > 0)
+        {
+            if (!buf.writable())
+                synchronize();
+            int n = std::min(count, buf.writable());
+            std::copy(values, values + n, buf.data() + buf.writePos());
+            buf.produce(n);
+            values += n;
+            count -= n;
+        }
+    }
+
+    // Waits for next DSP tick, which transfers samples.
+    void synchronize()
+    {
+        // Waiting for next DSP tick does not count towards period duration.
+        if (d_stats)
+        {
+            auto start = period_stats::now();
+            co_resume();
+            d_stats->exclude(period_stats::now() - start);
+        }
+        else
+        {
+            co_resume();
+        }
+    }
 };
 
 }
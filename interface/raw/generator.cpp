@@ -105,7 +105,7 @@ string cpp_type_for_arrp_type(const string & type_name)
     return stream::cpp_gen::type_name_for(type);
 }
 
-void write_channel_func(ostream & text, const nlohmann::json & channel, bool is_input)
+void write_channel_func(ostream & text, const nlohmann::json & channel, bool is_input, int lanes)
 {
     string name = channel["name"];
 
@@ -115,7 +115,8 @@ void write_channel_func(ostream & text, const nlohmann::json & channel, bool is_
     else
         func_name = "output_" + name;
 
-    int size = channel["size"];
+    // Values of all program instances in a batch are transferred together.
+    int size = int(channel["size"]) * lanes;
     string type = cpp_type_for_arrp_type(channel["type"]);
 
     text << "shared_ptr<AbstractChannel<" << type << ">> sp_" << name << ";" << endl;
@@ -139,14 +140,25 @@ void write_channel_func(ostream & text, const nlohmann::json & channel, bool is_
             text << "}" << endl;
         }
     }
+
+    bool is_stream = channel["is_stream"];
+    if (is_stream)
+    {
+        // Block I/O
+        text << "void " << func_name << "("
+                << type << " * data, int count"
+                << ") {" << endl;
+        text << "  sp_" << name << "->transfer(data, count);" << endl;
+        text << "}" << endl;
+    }
 }
 
-void write_channel_manager(ostream & text, const nlohmann::json & channel, bool is_input)
+void write_channel_manager(ostream & text, const nlohmann::json & channel, bool is_input, int lanes)
 {
     string name = channel["name"];
     string type = cpp_type_for_arrp_type(channel["type"]);
     bool is_stream = channel["is_stream"];
-    int size = channel["size"];
+    int size = int(channel["size"]) * lanes;
     string manager_type = "ChannelManager<" + type + ">";
     text << "  { "
             << "\"" << name << "\", "
@@ -157,12 +169,57 @@ void write_channel_manager(ostream & text, const nlohmann::json & channel, bool
             << endl;
 }
 
+// With zero-copy I/O, the program does not transfer streams itself,
+// so the kernel is wrapped to transfer them using buffer accessors.
+
+void write_zero_copy_kernel(ostream & text, const nlohmann::json & report,
+                            const string & base_type)
+{
+    string traits = report["cpp"]["namespace"].get<string>() + "::traits";
+
+    auto transfer = [&](const nlohmann::json & channel, bool is_input, const string & phase)
+    {
+        bool is_stream = channel["is_stream"];
+        if (!is_stream)
+            return;
+        string name = channel["name"];
+        string func_name = (is_input ? "input_" : "output_") + name;
+        text << "    io->" << func_name << "(" << func_name << "_buffer(), "
+             << traits << "::" << name << "_" << phase << "_size);" << endl;
+    };
+
+    text << "struct Generated_Kernel : public " << base_type << endl;
+    text << "{" << endl;
+    for (string phase : { "prelude", "period" })
+    {
+        text << "  void " << phase << "()" << endl;
+        text << "  {" << endl;
+        for (auto & channel : report["inputs"])
+            transfer(channel, true, phase);
+        text << "    " << base_type << "::" << phase << "();" << endl;
+        for (auto & channel : report["outputs"])
+            transfer(channel, false, phase);
+        text << "  }" << endl;
+    }
+    text << "};" << endl;
+}
+
 void generate
 (const generic_io::options & options, const nlohmann::json & report)
 {
     string kernel_file_name = report["cpp"]["filename"];
     string kernel_namespace = report["cpp"]["namespace"];
 
+    string kernel_name = "program";
+    int lanes = 1;
+    bool zero_copy_io = false;
+    if (report["cpp"].count("program"))
+        kernel_name = report["cpp"]["program"].get<string>();
+    if (report["cpp"].count("lanes"))
+        lanes = report["cpp"]["lanes"].get<int>();
+    if (report["cpp"].count("zero_copy_io"))
+        zero_copy_io = report["cpp"]["zero_copy_io"].get<bool>();
+
     bool has_period = false;
 
     for (auto & out : report["outputs"])
@@ -185,12 +242,12 @@ void generate
 
     for (auto & channel : report["inputs"])
     {
-        write_channel_func(io_text, channel, true);
+        write_channel_func(io_text, channel, true, lanes);
     }
 
     for (auto & channel : report["outputs"])
     {
-        write_channel_func(io_text, channel, false);
+        write_channel_func(io_text, channel, false, lanes);
     }
 
     // Channel managers
@@ -198,14 +255,14 @@ void generate
     io_text << "ChannelManagerMap input_managers = {" << endl;
     for (auto & channel : report["inputs"])
     {
-        write_channel_manager(io_text, channel, true);
+        write_channel_manager(io_text, channel, true, lanes);
     }
     io_text << "};" << endl;
 
     io_text << "ChannelManagerMap output_managers = {" << endl;
     for (auto & channel : report["outputs"])
     {
-        write_channel_manager(io_text, channel, false);
+        write_channel_manager(io_text, channel, false, lanes);
     }
     io_text << "};" << endl;
 
@@ -227,8 +284,12 @@ void generate
         file << "#include <arrp/generic_io/interface.h>" << endl;
         file << "#include \"" << io_cpp_file_name << "\"" << endl;
         file << "#include \"" << kernel_file_name << "\"" << endl;
-        file << "using Generated_Kernel = " << kernel_namespace
-             << "::program<arrp::generic_io::Generated_IO>;" << endl;
+        string kernel_type = kernel_namespace + "::" + kernel_name
+                + "<arrp::generic_io::Generated_IO>";
+        if (zero_copy_io)
+            write_zero_copy_kernel(file, report, kernel_type);
+        else
+            file << "using Generated_Kernel = " << kernel_type << ";" << endl;
         file << "#include <arrp/generic_io/main.cpp>" << endl;
     }
 }
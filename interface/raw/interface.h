@@ -141,30 +141,29 @@ public:
     {
         using namespace std;
 
-        int dst_index = 0;
+        size_t dst_index = 0;
 
-        for (; d_buffer_index < d_buffer_count and dst_index < count;
-             ++d_buffer_index, ++dst_index)
+        // Count may exceed buffer size when transferring blocks,
+        // so the buffer is refilled as many times as needed.
+        while(true)
         {
-            destination[dst_index] = d_buffer[d_buffer_index];
-        }
+            for (; d_buffer_index < d_buffer_count and dst_index < count;
+                 ++d_buffer_index, ++dst_index)
+            {
+                destination[dst_index] = d_buffer[d_buffer_index];
+            }
+
+            if (dst_index == count)
+                break;
 
-        if (dst_index < count)
-        {
             //cerr << "Reading... " << endl;
             d_buffer_index = 0;
             this->d_stream->read((char*)(d_buffer), d_buffer_size * sizeof(T));
             d_buffer_count = this->d_stream->gcount() / sizeof(T);
             //cerr << "Read " << d_buffer_count << " items." << endl;
-            if (count - dst_index > d_buffer_count)
+            if (d_buffer_count == 0)
                 throw std::ios_base::failure("Extracted fewer characters than required.");
         }
-
-        for (; d_buffer_index < d_buffer_count and dst_index < count;
-             ++d_buffer_index, ++dst_index)
-        {
-            destination[dst_index] = d_buffer[d_buffer_index];
-        }
     }
 
 private:
@@ -200,24 +199,23 @@ public:
 
     virtual void transfer(T* source, size_t count) override
     {
-        int src_index = 0;
-
-        for (; d_buffer_index < d_buffer_size and src_index < count;
-             ++d_buffer_index, ++src_index)
-        {
-            d_buffer[d_buffer_index] = source[src_index];
-        }
+        size_t src_index = 0;
 
-        if (d_buffer_index == d_buffer_size)
+        // Count may exceed buffer size when transferring blocks,
+        // so the buffer is flushed as many times as needed.
+        while(src_index < count)
         {
-            d_buffer_index = 0;
-            write(d_buffer_size);
-        }
+            for (; d_buffer_index < d_buffer_size and src_index < count;
+                 ++d_buffer_index, ++src_index)
+            {
+                d_buffer[d_buffer_index] = source[src_index];
+            }
 
-        for (; d_buffer_index < d_buffer_size and src_index < count;
-             ++d_buffer_index, ++src_index)
-        {
-            d_buffer[d_buffer_index] = source[src_index];
+            if (d_buffer_index == d_buffer_size)
+            {
+                d_buffer_index = 0;
+                write(d_buffer_size);
+            }
         }
     }
 
@@ -1,8 +1,13 @@
 #pragma once
 
 #include <arrp/arguments/arguments.hpp>
+#include <arrp/profile.hpp>
+#include <arrp/stats.hpp>
 
 #include <iostream>
+#include <memory>
+#include <vector>
+#include <csignal>
 
 using namespace std;
 using namespace arrp::generic_io;
@@ -11,9 +16,117 @@ struct Options
 {
     string default_channel_format = "text";
     int max_buffer_size = 1024;
+    bool migrate_state = false;
+    bool profile = false;
+    bool stats = false;
+    double period_budget = 0;
+    int periods_per_call = 1;
     unordered_map<string, string> channel_options;
 };
 
+// Prints profile of kernel compiled with instrumentation,
+// summed with profile of other instance of the same program, if any.
+
+template <typename Kernel>
+static auto print_profile(const Kernel & kernel, const Kernel * other, int)
+-> decltype(kernel.profile(), void())
+{
+    auto entries = kernel.profile();
+
+    if (other)
+    {
+        auto other_entries = other->profile();
+        for (size_t i = 0; i < entries.size(); ++i)
+        {
+            entries[i].time += other_entries[i].time;
+            entries[i].count += other_entries[i].count;
+        }
+    }
+
+    arrp::print_profile(cerr, entries);
+}
+
+template <typename Kernel>
+static void print_profile(const Kernel &, const Kernel *, long)
+{
+    cerr << "Program is not instrumented." << endl;
+}
+
+// Access to period statistics of kernel compiled with them.
+
+template <typename Kernel>
+static auto period_stats(Kernel & kernel, int) -> decltype(&kernel.stats())
+{
+    return &kernel.stats();
+}
+
+template <typename Kernel>
+static arrp::period_stats * period_stats(Kernel &, long)
+{
+    return nullptr;
+}
+
+// Computes a number of periods, in a single call if kernel has process().
+
+template <typename Kernel>
+static auto compute_periods(Kernel & kernel, int count, int) -> decltype(kernel.process(count), void())
+{
+    if (count > 1)
+        kernel.process(count);
+    else
+        kernel.period();
+}
+
+template <typename Kernel>
+static void compute_periods(Kernel & kernel, int count, long)
+{
+    for (int i = 0; i < count; ++i)
+        kernel.period();
+}
+
+// Completes periods still in the pipeline of a pipelined kernel.
+
+template <typename Kernel>
+static auto drain(Kernel & kernel, int) -> decltype(kernel.drain(), void())
+{
+    kernel.drain();
+}
+
+template <typename Kernel>
+static void drain(Kernel &, long) {}
+
+static volatile std::sig_atomic_t stats_requested = 0;
+
+static void request_stats(int)
+{
+    stats_requested = 1;
+}
+
+// Prints period statistics of kernel, combined with those
+// of other instance of the same program, if any.
+
+template <typename Kernel>
+static void print_stats(Kernel & kernel, Kernel * other)
+{
+    auto stats = period_stats(kernel, 0);
+    if (!stats)
+    {
+        cerr << "Program does not record period statistics." << endl;
+        return;
+    }
+
+    if (!other)
+    {
+        stats->print(cerr);
+        return;
+    }
+
+    arrp::period_stats combined;
+    combined.merge(*stats);
+    combined.merge(*period_stats(*other, 0));
+    combined.print(cerr);
+}
+
 static void print_actual_channel_config(ActualChannelConfig config)
 {
     cerr << config.type;
@@ -224,6 +337,16 @@ void print_help(Generated_IO & io)
     cerr << "    ... Use this format for inputs and outputs without explicit format." << endl;
     cerr << "  -b=<size> or --buffer=<size>" << endl;
     cerr << "    ... Maximum amount of buffered data for inputs and outputs." << endl;
+    cerr << "  --migrate-state" << endl;
+    cerr << "    ... Continue in a new program instance after every period, from saved state." << endl;
+    cerr << "  --profile" << endl;
+    cerr << "    ... Print time and instances of each statement when program ends (requires instrumentation)." << endl;
+    cerr << "  --stats" << endl;
+    cerr << "    ... Print period statistics when program ends or receives SIGUSR1 (requires --stats at compilation)." << endl;
+    cerr << "  --period-budget=<microseconds>" << endl;
+    cerr << "    ... Count periods taking longer as deadline misses." << endl;
+    cerr << "  --process=<count>" << endl;
+    cerr << "    ... Compute <count> periods in each call to the program, using process() if available." << endl;
     cerr << "  <input>=<value>" << endl;
     cerr << "    ... Define input value." << endl;
     cerr << "  <input>=<source>[:<format>]" << endl;
@@ -279,6 +402,11 @@ int main(int argc, char *argv[])
     parser.add_option("--format", options.default_channel_format);
     parser.add_option("-b", options.max_buffer_size);
     parser.add_option("--buffer", options.max_buffer_size);
+    parser.add_switch("--migrate-state", options.migrate_state);
+    parser.add_switch("--profile", options.profile);
+    parser.add_switch("--stats", options.stats);
+    parser.add_option("--period-budget", options.period_budget);
+    parser.add_option("--process", options.periods_per_call);
     parser.add_switch("-h", help_requested);
     parser.add_switch("--help", help_requested);
 
@@ -295,6 +423,12 @@ int main(int argc, char *argv[])
         return 0;
     }
 
+    if (options.periods_per_call < 1)
+    {
+        cerr << "Error: Number of periods per call must be at least 1." << endl;
+        return 1;
+    }
+
     try { Config config(options, io); }
     catch (std::exception & e)
     {
@@ -305,15 +439,70 @@ int main(int argc, char *argv[])
     Generated_Kernel kernel;
     kernel.io = &io;
 
+    // Instances take turns in continuing from saved state.
+    unique_ptr<Generated_Kernel> other_kernel;
+    vector<char> state;
+    if (options.migrate_state)
+    {
+        other_kernel.reset(new Generated_Kernel);
+        other_kernel->io = &io;
+        state.resize(Generated_Kernel::state_size());
+    }
+
+    Generated_Kernel * current = &kernel;
+
+    if (options.period_budget > 0)
+    {
+        for (auto k : { &kernel, other_kernel.get() })
+        {
+            auto stats = k ? period_stats(*k, 0) : nullptr;
+            if (stats)
+                stats->set_budget(uint64_t(options.period_budget * 1000));
+        }
+    }
+
+    if (options.stats)
+        std::signal(SIGUSR1, &request_stats);
+
+    auto migrate = [&]() -> bool
+    {
+        if (!other_kernel)
+            return true;
+        auto next = current == &kernel ? other_kernel.get() : &kernel;
+        current->save_state(state.data());
+        if (!next->load_state(state.data()))
+            return false;
+        current = next;
+        return true;
+    };
+
     try
     {
-        kernel.prelude();
+        current->prelude();
+
+        if (!migrate())
+        {
+            cerr << "Error: Saved state could not be loaded." << endl;
+            return 1;
+        }
 
         if (io.has_period)
         {
             while(true)
             {
-                kernel.period();
+                compute_periods(*current, options.periods_per_call, 0);
+
+                if (stats_requested)
+                {
+                    stats_requested = 0;
+                    print_stats(kernel, other_kernel.get());
+                }
+
+                if (!migrate())
+                {
+                    cerr << "Error: Saved state could not be loaded." << endl;
+                    return 1;
+                }
             }
         }
     }
@@ -327,4 +516,24 @@ int main(int argc, char *argv[])
         if (!ok)
             return 1;
     }
+
+    try
+    {
+        drain(*current, 0);
+    }
+    catch(std::ios_base::failure &)
+    {
+        bool ok = true;
+        for(auto & entry : io.output_managers)
+            ok &= report_stream_error(*entry.second->stream(), entry.first);
+        if (!ok)
+            return 1;
+    }
+
+    // With state migration, instances take turns in computing periods.
+    if (options.profile)
+        print_profile(kernel, other_kernel.get(), 0);
+
+    if (options.stats)
+        print_stats(kernel, other_kernel.get());
 }
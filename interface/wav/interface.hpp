@@ -18,6 +18,7 @@ private:
     int m_num_channels = 0;
     int64_t m_output_count = 0;
     vector<char> m_in_frame;
+    vector<char> m_in_block;
 
 public:
     wav_interface(int sample_rate, const string & in_file_name, const string & out_file_name)
@@ -83,10 +84,31 @@ public:
         ++m_output_count;
     }
 
+    // Block I/O: count values of consecutive frames.
+    template <typename T>
+    void output(const T * values, int count)
+    {
+        int frame_count = count / m_num_channels;
+        m_out_file.writef(values, frame_count);
+        m_output_count += frame_count;
+    }
+
     template <typename T>
     void input_main_in(T & value)
     {
         m_in_file.readf((T*)m_in_frame.data(), 1);
         value = ((T*)(m_in_frame.data()))[0];
     }
+
+    // Block I/O: first channel of count consecutive frames.
+    template <typename T>
+    void input_main_in(T * values, int count)
+    {
+        int channel_count = m_in_file.channels();
+        m_in_block.resize(sizeof(T) * channel_count * count);
+        T * frames = (T*) m_in_block.data();
+        m_in_file.readf(frames, count);
+        for (int i = 0; i < count; ++i)
+            values[i] = frames[i * channel_count];
+    }
 };
@@ -7,6 +7,8 @@
 
 using traits = PROGRAM_NAMESPACE::traits;
 using interface_type = wav_interface<traits>;
+// Programs compiled with --batch are not supported:
+// they define program_batch instead, with a value per instance in each frame.
 using program_type = PROGRAM_NAMESPACE::program<interface_type>;
 
 using namespace std;
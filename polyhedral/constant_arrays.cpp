@@ -0,0 +1,855 @@
+/*
+Compiler for language for stream processing
+
+Copyright (C) 2016  Jakob Leben <jakob.leben@gmail.com>
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "constant_arrays.hpp"
+
+#include <isl/set.h>
+#include <isl/point.h>
+#include <isl/val.h>
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+using namespace std;
+
+namespace stream {
+namespace polyhedral {
+
+namespace {
+
+// Thrown when a value can not be computed during compilation.
+struct not_constant {};
+
+}
+
+// Integers and booleans are stored in 'i', reals in 'r'.
+
+struct scalar_value
+{
+    primitive_type type = primitive_type::undefined;
+    int64_t i = 0;
+    double r = 0;
+};
+
+typedef scalar_value value;
+
+static primitive_type type_of(const functional::expression * expr)
+{
+    if (!expr->type || !expr->type->is_scalar())
+        throw not_constant();
+    return expr->type->scalar()->primitive;
+}
+
+static bool is_supported(primitive_type t)
+{
+    switch(t)
+    {
+    case primitive_type::boolean:
+    case primitive_type::int8:
+    case primitive_type::uint8:
+    case primitive_type::int16:
+    case primitive_type::uint16:
+    case primitive_type::int32:
+    case primitive_type::uint32:
+    case primitive_type::real32:
+    case primitive_type::real64:
+        return true;
+    default:
+        return false;
+    }
+}
+
+// Integer wrapped to the range of type, as by conversion in C++.
+
+static int64_t wrap(int64_t v, primitive_type t)
+{
+    switch(t)
+    {
+    case primitive_type::boolean: return v != 0;
+    case primitive_type::int8: return int8_t(v);
+    case primitive_type::uint8: return uint8_t(v);
+    case primitive_type::int16: return int16_t(v);
+    case primitive_type::uint16: return uint16_t(v);
+    case primitive_type::int32: return int32_t(v);
+    case primitive_type::uint32: return uint32_t(v);
+    case primitive_type::int64: return v;
+    default: throw not_constant();
+    }
+}
+
+static double real_of(const value & v)
+{
+    return is_real(v.type) ? v.r : double(v.i);
+}
+
+static value convert(const value & v, primitive_type t)
+{
+    value result;
+    result.type = t;
+
+    if (is_real(t))
+    {
+        result.r = real_of(v);
+        if (t == primitive_type::real32)
+            result.r = float(result.r);
+    }
+    else if (t == primitive_type::boolean)
+    {
+        result.i = is_real(v.type) ? v.r != 0 : v.i != 0;
+    }
+    else if (is_integer(t) && t != primitive_type::uint64)
+    {
+        if (is_real(v.type))
+        {
+            // Conversion of values out of range is undefined.
+            double x = std::trunc(v.r);
+            if (!(x >= -9.2e18 && x <= 9.2e18) || wrap(int64_t(x), t) != int64_t(x))
+                throw not_constant();
+            result.i = int64_t(x);
+        }
+        else
+        {
+            result.i = wrap(v.i, t);
+        }
+    }
+    else
+    {
+        throw not_constant();
+    }
+
+    return result;
+}
+
+static value real_value(double x, primitive_type t)
+{
+    value v;
+    v.type = primitive_type::real64;
+    v.r = x;
+    return convert(v, t);
+}
+
+static value int_value(int64_t x, primitive_type t)
+{
+    value v;
+    v.type = primitive_type::int64;
+    v.i = x;
+    return convert(v, t);
+}
+
+// Value of an element of an array of given type, as stored.
+
+static value stored_value(double x, primitive_type t)
+{
+    value v;
+    v.type = t;
+    if (is_real(t))
+        v.r = x;
+    else
+        v.i = int64_t(x);
+    return v;
+}
+
+// Type in which C++ compares or combines values of given types.
+
+static primitive_type common_type(primitive_type a, primitive_type b)
+{
+    if (a == primitive_type::real64 || b == primitive_type::real64)
+        return primitive_type::real64;
+    if (a == primitive_type::real32 || b == primitive_type::real32)
+        return primitive_type::real32;
+    return primitive_type::int64;
+}
+
+constant_array_evaluator::constant_array_evaluator( model & m ):
+    m_model(m)
+{}
+
+void constant_array_evaluator::process(int max_element_count)
+{
+    m_max_element_count = max_element_count;
+    m_writers.clear();
+    m_state.clear();
+
+    for (auto & stmt : m_model.statements)
+    {
+        for (auto & access : stmt->array_accesses)
+        {
+            if (access->writing)
+                m_writers[access->array.get()].push_back(stmt);
+        }
+    }
+
+    vector<array*> computed_arrays;
+
+    for (auto & array : m_model.arrays)
+    {
+        if (compute(array.get()))
+            computed_arrays.push_back(array.get());
+    }
+
+    // Remove statements computing constant arrays.
+
+    for (auto array : computed_arrays)
+    {
+        auto & writers = m_writers[array];
+        auto & stmts = m_model.statements;
+        stmts.erase(std::remove_if(stmts.begin(), stmts.end(),
+                                   [&](const stmt_ptr & s)
+        { return std::find(writers.begin(), writers.end(), s) != writers.end(); }),
+                    stmts.end());
+
+        if (verbose<constant_array_evaluator>::enabled())
+        {
+            cout << "Constant array " << array->name << ": "
+                 << array->constant_values.size() << " elements." << endl;
+        }
+    }
+}
+
+bool constant_array_evaluator::is_candidate(array * a)
+{
+    if (a->is_infinite || !is_supported(a->type))
+        return false;
+
+    int64_t volume = 1;
+    for (auto s : a->size)
+    {
+        if (s < 1)
+            return false;
+        volume *= s;
+        if (volume > m_max_element_count)
+            return false;
+    }
+
+    auto writers = m_writers.find(a);
+    if (writers == m_writers.end())
+        return false;
+
+    for (auto & stmt : writers->second)
+    {
+        if (stmt->is_input_or_output || stmt->is_infinite)
+            return false;
+
+        auto assign = dynamic_cast<assignment*>(stmt->expr.get());
+        if (!assign)
+            return false;
+        auto dest = dynamic_cast<array_access*>(assign->destination.get());
+        if (!dest || dest->array.get() != a)
+            return false;
+        if (dest->indexes.size() != a->size.size())
+            return false;
+
+        // Writes only this array.
+        for (auto & access : stmt->array_accesses)
+        {
+            if (access->writing && access->array.get() != a)
+                return false;
+        }
+
+        if (isl_set_is_bounded(stmt->domain.get()) != isl_bool_true)
+            return false;
+    }
+
+    return true;
+}
+
+bool constant_array_evaluator::compute(array * a)
+{
+    auto state = m_state.find(a);
+    if (state != m_state.end())
+        return state->second == computed;
+
+    m_state[a] = visiting;
+
+    auto fail = [&]()
+    {
+        m_state[a] = failed;
+        return false;
+    };
+
+    if (!is_candidate(a))
+        return fail();
+
+    auto & writers = m_writers[a];
+
+    // Arrays read must be constant too.
+
+    for (auto & stmt : writers)
+    {
+        for (auto & access : stmt->array_accesses)
+        {
+            if (access->reading && access->array.get() != a &&
+                    !compute(access->array.get()))
+                return fail();
+        }
+    }
+
+    // Statement instances, by offset of element written.
+
+    struct instance
+    {
+        int64_t offset;
+        statement * stmt;
+        vector<int64_t> point;
+    };
+
+    vector<instance> instances;
+
+    for (auto & stmt : writers)
+    {
+        struct collector
+        {
+            statement * stmt;
+            vector<instance> * instances;
+        };
+
+        collector data { stmt.get(), &instances };
+
+        isl_set_foreach_point(stmt->domain.get(), [](isl_point * p, void * user) -> isl_stat
+        {
+            auto data = reinterpret_cast<collector*>(user);
+            int dims = data->stmt->domain.dimensions();
+            vector<int64_t> point(dims);
+            for (int i = 0; i < dims; ++i)
+            {
+                isl_val * v = isl_point_get_coordinate_val(p, isl_dim_set, i);
+                point[i] = isl_val_get_num_si(v);
+                isl_val_free(v);
+            }
+            isl_point_free(p);
+            data->instances->push_back({ 0, data->stmt, point });
+            return isl_stat_ok;
+        }, &data);
+    }
+
+    if ((int64_t) instances.size() > m_max_element_count)
+        return fail();
+
+    vector<double> values;
+    vector<bool> is_computed;
+
+    try
+    {
+        for (auto & inst : instances)
+        {
+            auto assign = static_cast<assignment*>(inst.stmt->expr.get());
+            auto dest = static_cast<array_access*>(assign->destination.get());
+
+            int64_t offset = 0;
+            for (int d = 0; d < (int) dest->indexes.size(); ++d)
+            {
+                auto i = evaluate(dest->indexes[d], inst.point);
+                if (is_real(i.type) || i.i < 0 || i.i >= a->size[d])
+                    return fail();
+                offset = offset * a->size[d] + i.i;
+            }
+            inst.offset = offset;
+        }
+
+        std::stable_sort(instances.begin(), instances.end(),
+                         [](const instance & x, const instance & y)
+        { return x.offset < y.offset; });
+
+        int64_t volume = 1;
+        for (auto s : a->size)
+            volume *= s;
+
+        values.resize(volume, 0);
+        is_computed.resize(volume, false);
+
+        m_current_array = a;
+        m_current_values = &values;
+        m_current_computed = &is_computed;
+
+        for (auto & inst : instances)
+        {
+            if (is_computed[inst.offset])
+                throw not_constant();
+
+            auto assign = static_cast<assignment*>(inst.stmt->expr.get());
+            auto v = convert(evaluate(assign->value, inst.point), a->type);
+
+            values[inst.offset] = is_real(v.type) ? v.r : double(v.i);
+            is_computed[inst.offset] = true;
+        }
+    }
+    catch (not_constant &)
+    {
+        m_current_array = nullptr;
+        return fail();
+    }
+
+    m_current_array = nullptr;
+    m_current_values = nullptr;
+    m_current_computed = nullptr;
+
+    a->constant_values = std::move(values);
+
+    m_state[a] = computed;
+
+    return true;
+}
+
+value constant_array_evaluator::element(array * a, const vector<int64_t> & index)
+{
+    if (index.size() != a->size.size())
+        throw not_constant();
+
+    int64_t offset = 0;
+    for (int d = 0; d < (int) index.size(); ++d)
+    {
+        if (index[d] < 0 || index[d] >= a->size[d])
+            throw not_constant();
+        offset = offset * a->size[d] + index[d];
+    }
+
+    double x;
+
+    if (a == m_current_array)
+    {
+        // Only preceding elements are computed.
+        if (!(*m_current_computed)[offset])
+            throw not_constant();
+        x = (*m_current_values)[offset];
+    }
+    else
+    {
+        if (a->constant_values.empty())
+            throw not_constant();
+        x = a->constant_values[offset];
+    }
+
+    return stored_value(x, a->type);
+}
+
+value scalar_evaluator::evaluate
+(const functional::expr_ptr & expr, const vector<int64_t> & point)
+{
+    if (auto iter = dynamic_cast<iterator_read*>(expr.get()))
+    {
+        return int_value(point.at(iter->index), primitive_type::int64);
+    }
+    else if (auto access = dynamic_cast<array_access*>(expr.get()))
+    {
+        vector<int64_t> index;
+        for (auto & e : access->indexes)
+        {
+            auto i = evaluate(e, point);
+            if (is_real(i.type))
+                throw not_constant();
+            index.push_back(i.i);
+        }
+        return element(access->array.get(), index);
+    }
+    else if (auto c = dynamic_cast<functional::int_const*>(expr.get()))
+    {
+        if (!c->value().fits_slong_p())
+            throw not_constant();
+        return int_value(c->value().get_si(), type_of(c));
+    }
+    else if (auto c = dynamic_cast<functional::constant<double>*>(expr.get()))
+    {
+        auto t = c->type ? type_of(c) : primitive_type::real64;
+        return real_value(c->value, t);
+    }
+    else if (auto c = dynamic_cast<functional::bool_const*>(expr.get()))
+    {
+        return int_value(c->value, primitive_type::boolean);
+    }
+    else if (auto prim = dynamic_cast<functional::primitive*>(expr.get()))
+    {
+        return evaluate_primitive(prim, point);
+    }
+
+    throw not_constant();
+}
+
+value scalar_evaluator::evaluate_primitive
+(functional::primitive * expr, const vector<int64_t> & point)
+{
+    auto r_t = type_of(expr);
+    if (is_complex(r_t))
+        throw not_constant();
+
+    auto operand = [&](int i) { return evaluate(expr->operands[i], point); };
+
+    switch(expr->kind)
+    {
+    case primitive_op::conditional:
+    {
+        auto c = operand(0);
+        return convert(c.i ? operand(1) : operand(2), r_t);
+    }
+    case primitive_op::logic_and:
+        return int_value(operand(0).i && operand(1).i, r_t);
+    case primitive_op::logic_or:
+        return int_value(operand(0).i || operand(1).i, r_t);
+    default:
+        break;
+    }
+
+    vector<value> args;
+    for (int i = 0; i < (int) expr->operands.size(); ++i)
+    {
+        args.push_back(operand(i));
+        if (is_complex(args.back().type))
+            throw not_constant();
+    }
+
+    auto math = [&](double (*f)(double)) { return real_value(f(real_of(args[0])), r_t); };
+
+    switch(expr->kind)
+    {
+    case primitive_op::negate:
+    {
+        if (r_t == primitive_type::boolean)
+            return int_value(!args[0].i, r_t);
+        if (is_real(r_t))
+            return real_value(-convert(args[0], r_t).r, r_t);
+        return int_value(int64_t(0 - uint64_t(args[0].i)), r_t);
+    }
+    case primitive_op::add:
+    case primitive_op::subtract:
+    case primitive_op::multiply:
+    case primitive_op::divide:
+    {
+        if (is_real(r_t))
+        {
+            // Operands are converted to result type first.
+            double a = convert(args[0], r_t).r;
+            double b = convert(args[1], r_t).r;
+            switch(expr->kind)
+            {
+            case primitive_op::add: return real_value(a + b, r_t);
+            case primitive_op::subtract: return real_value(a - b, r_t);
+            case primitive_op::multiply: return real_value(a * b, r_t);
+            default: return real_value(a / b, r_t);
+            }
+        }
+        if (!is_integer(r_t) || is_real(args[0].type) || is_real(args[1].type))
+            throw not_constant();
+        uint64_t a = args[0].i, b = args[1].i;
+        switch(expr->kind)
+        {
+        case primitive_op::add: return int_value(int64_t(a + b), r_t);
+        case primitive_op::subtract: return int_value(int64_t(a - b), r_t);
+        case primitive_op::multiply: return int_value(int64_t(a * b), r_t);
+        default: throw not_constant();
+        }
+    }
+    case primitive_op::divide_integer:
+    {
+        if (is_integer(args[0].type) && is_integer(args[1].type))
+        {
+            if (args[1].i == 0)
+                throw not_constant();
+            return int_value(args[0].i / args[1].i, r_t);
+        }
+        auto t = common_type(args[0].type, args[1].type);
+        double q = convert(args[0], t).r / convert(args[1], t).r;
+        return convert(real_value(q, t), r_t);
+    }
+    case primitive_op::modulo:
+    {
+        if (!is_integer(args[0].type) || !is_integer(args[1].type) || args[1].i == 0)
+            throw not_constant();
+        return int_value(args[0].i % args[1].i, r_t);
+    }
+    case primitive_op::bitwise_not:
+        return int_value(~args[0].i, r_t);
+    case primitive_op::bitwise_and:
+        return int_value(args[0].i & args[1].i, r_t);
+    case primitive_op::bitwise_or:
+        return int_value(args[0].i | args[1].i, r_t);
+    case primitive_op::bitwise_xor:
+        return int_value(args[0].i ^ args[1].i, r_t);
+    case primitive_op::bitwise_lshift:
+    case primitive_op::bitwise_rshift:
+    {
+        if (args[1].i < 0 || args[1].i > 31 || is_real(args[0].type))
+            throw not_constant();
+        if (expr->kind == primitive_op::bitwise_lshift)
+            return int_value(int64_t(uint64_t(args[0].i) << args[1].i), r_t);
+        return int_value(args[0].i >> args[1].i, r_t);
+    }
+    case primitive_op::raise:
+        return real_value(std::pow(real_of(args[0]), real_of(args[1])), r_t);
+    case primitive_op::exp: return math(std::exp);
+    case primitive_op::exp2: return math(std::exp2);
+    case primitive_op::log: return math(std::log);
+    case primitive_op::log2: return math(std::log2);
+    case primitive_op::log10: return math(std::log10);
+    case primitive_op::sqrt: return math(std::sqrt);
+    case primitive_op::sin: return math(std::sin);
+    case primitive_op::cos: return math(std::cos);
+    case primitive_op::tan: return math(std::tan);
+    case primitive_op::asin: return math(std::asin);
+    case primitive_op::acos: return math(std::acos);
+    case primitive_op::atan: return math(std::atan);
+    case primitive_op::ceil:
+    case primitive_op::floor:
+    {
+        if (!is_real(args[0].type))
+            return convert(args[0], r_t);
+        double x = expr->kind == primitive_op::ceil ?
+                    std::ceil(args[0].r) : std::floor(args[0].r);
+        return convert(real_value(x, args[0].type), r_t);
+    }
+    case primitive_op::abs:
+    {
+        if (is_real(args[0].type))
+            return real_value(std::abs(args[0].r), r_t);
+        return int_value(args[0].i < 0 ? -args[0].i : args[0].i, r_t);
+    }
+    case primitive_op::min:
+    case primitive_op::max:
+    {
+        auto a = convert(args[0], r_t);
+        auto b = convert(args[1], r_t);
+        bool a_less = is_real(r_t) ? a.r < b.r : a.i < b.i;
+        if (expr->kind == primitive_op::min)
+            return a_less ? a : b;
+        else
+            return a_less ? b : a;
+    }
+    case primitive_op::to_int:
+    case primitive_op::to_int8:
+    case primitive_op::to_uint8:
+    case primitive_op::to_int16:
+    case primitive_op::to_uint16:
+    case primitive_op::to_int32:
+    case primitive_op::to_uint32:
+    case primitive_op::to_int64:
+    case primitive_op::to_real32:
+    case primitive_op::to_real64:
+        return convert(args[0], r_t);
+    case primitive_op::compare_eq:
+    case primitive_op::compare_neq:
+    case primitive_op::compare_l:
+    case primitive_op::compare_g:
+    case primitive_op::compare_leq:
+    case primitive_op::compare_geq:
+    {
+        auto t = common_type(args[0].type, args[1].type);
+        auto a = convert(args[0], t);
+        auto b = convert(args[1], t);
+        int order;
+        if (is_real(t))
+            order = a.r < b.r ? -1 : (a.r > b.r ? 1 : 0);
+        else
+            order = a.i < b.i ? -1 : (a.i > b.i ? 1 : 0);
+        if (is_real(t) && (std::isnan(a.r) || std::isnan(b.r)))
+            return int_value(expr->kind == primitive_op::compare_neq, r_t);
+        bool result;
+        switch(expr->kind)
+        {
+        case primitive_op::compare_eq: result = order == 0; break;
+        case primitive_op::compare_neq: result = order != 0; break;
+        case primitive_op::compare_l: result = order < 0; break;
+        case primitive_op::compare_g: result = order > 0; break;
+        case primitive_op::compare_leq: result = order <= 0; break;
+        default: result = order >= 0;
+        }
+        return int_value(result, r_t);
+    }
+    default:
+        throw not_constant();
+    }
+}
+
+prelude_evaluator::prelude_evaluator( model & m, const schedule & s ):
+    m_model(m),
+    m_schedule(s)
+{}
+
+bool prelude_evaluator::process(int max_instance_count)
+{
+    m_values.clear();
+
+    unordered_map<string, statement*> statements;
+    for (auto & stmt : m_model.statements)
+        statements.emplace(stmt->name, stmt.get());
+
+    // Statement instances, with their time in prelude.
+
+    struct instance
+    {
+        vector<int64_t> time;
+        statement * stmt;
+        vector<int64_t> point;
+    };
+
+    vector<instance> instances;
+
+    bool ok = true;
+
+    m_schedule.prelude.for_each([&](const isl::map & m)
+    {
+        auto space = m.get_space();
+
+        auto stmt = statements.find(space.id(isl::space::input).name());
+        if (stmt == statements.end() || stmt->second->is_input_or_output ||
+                !dynamic_cast<assignment*>(stmt->second->expr.get()))
+        {
+            ok = false;
+            return false;
+        }
+
+        auto points = m.wrapped();
+        if (isl_set_is_bounded(points.get()) != isl_bool_true)
+        {
+            ok = false;
+            return false;
+        }
+
+        struct collector
+        {
+            statement * stmt;
+            int in_dims;
+            int out_dims;
+            int max_count;
+            vector<instance> * instances;
+        };
+
+        collector data { stmt->second,
+                         space.dimension(isl::space::input),
+                         space.dimension(isl::space::output),
+                         max_instance_count,
+                         &instances };
+
+        auto result = isl_set_foreach_point(points.get(), [](isl_point * p, void * user) -> isl_stat
+        {
+            auto data = reinterpret_cast<collector*>(user);
+            if ((int) data->instances->size() >= data->max_count)
+            {
+                isl_point_free(p);
+                return isl_stat_error;
+            }
+            instance inst;
+            inst.stmt = data->stmt;
+            for (int i = 0; i < data->in_dims + data->out_dims; ++i)
+            {
+                isl_val * v = isl_point_get_coordinate_val(p, isl_dim_set, i);
+                if (i < data->in_dims)
+                    inst.point.push_back(isl_val_get_num_si(v));
+                else
+                    inst.time.push_back(isl_val_get_num_si(v));
+                isl_val_free(v);
+            }
+            isl_point_free(p);
+            data->instances->push_back(std::move(inst));
+            return isl_stat_ok;
+        }, &data);
+
+        if (result != isl_stat_ok)
+        {
+            ok = false;
+            return false;
+        }
+
+        return true;
+    });
+
+    if (!ok)
+        return false;
+
+    std::stable_sort(instances.begin(), instances.end(),
+                     [](const instance & x, const instance & y)
+    { return x.time < y.time; });
+
+    std::unordered_map<array*, vector<element_value>> writes;
+
+    try
+    {
+        for (auto & inst : instances)
+        {
+            auto assign = static_cast<assignment*>(inst.stmt->expr.get());
+            auto dest = dynamic_cast<array_access*>(assign->destination.get());
+            if (!dest)
+                throw not_constant();
+
+            auto a = dest->array.get();
+            if (!is_supported(a->type) || dest->indexes.size() != a->size.size())
+                throw not_constant();
+
+            vector<int64_t> index;
+            for (int d = 0; d < (int) dest->indexes.size(); ++d)
+            {
+                auto i = evaluate(dest->indexes[d], inst.point);
+                if (is_real(i.type) || i.i < 0 || (a->size[d] >= 0 && i.i >= a->size[d]))
+                    throw not_constant();
+                index.push_back(i.i);
+            }
+
+            auto v = convert(evaluate(assign->value, inst.point), a->type);
+            double x = is_real(v.type) ? v.r : double(v.i);
+
+            m_values[a][index] = x;
+
+            // Only values read in later periods are kept.
+            if (a->inter_period_dependency)
+                writes[a].push_back({ vector<int>(index.begin(), index.end()), x });
+        }
+    }
+    catch (not_constant &)
+    {
+        return false;
+    }
+
+    for (auto & entry : writes)
+        entry.first->prelude_writes = std::move(entry.second);
+
+    m_model.prelude_is_computed = true;
+
+    if (verbose<prelude_evaluator>::enabled())
+    {
+        cout << "Computed prelude: " << instances.size() << " statement instances." << endl;
+    }
+
+    return true;
+}
+
+value prelude_evaluator::element(array * a, const vector<int64_t> & index)
+{
+    auto values = m_values.find(a);
+    if (values != m_values.end())
+    {
+        auto v = values->second.find(index);
+        if (v != values->second.end())
+            return stored_value(v->second, a->type);
+    }
+
+    if (a->constant_values.empty() || index.size() != a->size.size())
+        throw not_constant();
+
+    int64_t offset = 0;
+    for (int d = 0; d < (int) index.size(); ++d)
+    {
+        if (index[d] < 0 || index[d] >= a->size[d])
+            throw not_constant();
+        offset = offset * a->size[d] + index[d];
+    }
+
+    return stored_value(a->constant_values[offset], a->type);
+}
+
+}
+}
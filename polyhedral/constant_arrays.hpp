@@ -0,0 +1,124 @@
+/*
+Compiler for language for stream processing
+
+Copyright (C) 2016  Jakob Leben <jakob.leben@gmail.com>
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef STREAM_LANG_POLYHEDRAL_CONSTANT_ARRAYS_INCLUDED
+#define STREAM_LANG_POLYHEDRAL_CONSTANT_ARRAYS_INCLUDED
+
+#include "../common/ph_model.hpp"
+#include "../utility/debug.hpp"
+
+#include <map>
+#include <unordered_map>
+
+namespace stream {
+namespace polyhedral {
+
+// Value of a scalar expression computed during compilation.
+struct scalar_value;
+
+// Computes values of statement expressions during compilation.
+// Subclasses provide values of array elements read.
+
+class scalar_evaluator
+{
+public:
+    virtual ~scalar_evaluator() {}
+
+protected:
+    typedef scalar_value value;
+
+    value evaluate(const functional::expr_ptr &, const vector<int64_t> & point);
+    value evaluate_primitive(functional::primitive *, const vector<int64_t> & point);
+    virtual value element(array *, const vector<int64_t> & index) = 0;
+};
+
+/*
+Computes finite arrays which do not depend on inputs
+during compilation, such as wavetables, windows and transform matrices.
+Their values are stored in array::constant_values,
+and the statements computing them are removed from the model.
+
+Elements are computed in row-major order, so an element may read
+preceding elements of the same array and any elements of other
+constant arrays. Arrays of complex or 64-bit integer elements,
+and arrays with more than a given number of elements, are not computed.
+
+Real values are computed in double precision and rounded
+to the element type, so results of math functions may differ
+from those computed at run time in the last digit.
+*/
+
+class constant_array_evaluator : private scalar_evaluator
+{
+public:
+    constant_array_evaluator( model & );
+
+    void process(int max_element_count);
+
+private:
+    enum state_type { visiting, computed, failed };
+
+    bool compute(array *);
+    bool is_candidate(array *);
+    value element(array *, const vector<int64_t> & index) override;
+
+    model & m_model;
+    int m_max_element_count = 0;
+    std::unordered_map<array*, vector<stmt_ptr>> m_writers;
+    std::unordered_map<array*, state_type> m_state;
+
+    // Array being computed, and which of its elements are computed.
+    array * m_current_array = nullptr;
+    vector<double> * m_current_values = nullptr;
+    vector<bool> * m_current_computed = nullptr;
+};
+
+/*
+Executes the prelude during compilation, if it reads no inputs
+and writes no outputs, so that the generated prelude only copies
+its result into buffers. Statement instances are executed in
+order of the prelude schedule. Values written to arrays which
+are read in later periods are stored in array::prelude_writes,
+in order of writing, and model::prelude_is_computed is set.
+
+The prelude is not computed if any instance can not be
+computed by scalar_evaluator, or if it has more than a given
+number of instances.
+*/
+
+class prelude_evaluator : private scalar_evaluator
+{
+public:
+    prelude_evaluator( model &, const schedule & );
+
+    bool process(int max_instance_count);
+
+private:
+    value element(array *, const vector<int64_t> & index) override;
+
+    model & m_model;
+    const schedule & m_schedule;
+    std::unordered_map<array*, std::map<vector<int64_t>, double>> m_values;
+};
+
+}
+}
+
+#endif // STREAM_LANG_POLYHEDRAL_CONSTANT_ARRAYS_INCLUDED
@@ -23,12 +23,15 @@ along with this program; if not, write to the Free Software Foundation, Inc.,
 #include "../utility/stacker.hpp"
 
 #include <isl/ast_build.h>
+#include <isl/schedule.h>
 #include <isl/schedule_node.h>
 
 #include <isl-cpp/context.hpp>
 #include <isl-cpp/schedule.hpp>
 
 #include <iostream>
+#include <algorithm>
+#include <unordered_set>
 
 using namespace std;
 
@@ -211,7 +214,19 @@ ast_isl ast_gen::generate()
     {
         if (verbose<ast_gen>::enabled())
             cout << endl << "** Building AST for prelude." << endl;
-        m_allow_parallel_for = false;
+
+        m_allow_parallel_for = m_options.parallel | m_options.vectorize;
+        m_parallel_dim = m_options.prelude_parallel_dim;
+
+        int num_sched_dim = 0;
+
+        m_schedule.prelude.for_each([&](const isl::map & m){
+            num_sched_dim = m.get_space().dimension(isl::space::output);
+            return false;
+        });
+
+        build = set_loop_iterators(build, num_sched_dim, m_parallel_dim);
+
         output.prelude =
                 isl_ast_build_node_from_schedule(build, m_schedule.prelude_tree.copy());
     }
@@ -221,6 +236,7 @@ ast_isl ast_gen::generate()
             cout << endl << "** Building AST for period." << endl;
 
         m_allow_parallel_for = m_options.parallel | m_options.vectorize;
+        m_parallel_dim = m_options.parallel_dim;
 
         int num_sched_dim = 0;
 
@@ -229,10 +245,30 @@ ast_isl ast_gen::generate()
             return false;
         });
 
-        build = set_loop_iterators(build, num_sched_dim, m_options.parallel_dim);
+        build = set_loop_iterators(build, num_sched_dim, m_parallel_dim);
 
         output.period =
                 isl_ast_build_node_from_schedule(build, m_schedule.period_tree.copy());
+
+        for (int stage = 0; m_model.pipeline_stage_count > 1 &&
+             stage < m_model.pipeline_stage_count; ++stage)
+        {
+            if (verbose<ast_gen>::enabled())
+                cout << endl << "** Building AST for pipeline stage " << stage << endl;
+
+            isl::union_set stage_domain(m_model.context);
+            for (auto & stmt : m_model.statements)
+            {
+                if (stmt->is_infinite && stmt->pipeline_stage == stage)
+                    stage_domain |= stmt->domain;
+            }
+
+            auto stage_schedule = isl_schedule_intersect_domain
+                    (m_schedule.period_tree.copy(), stage_domain.copy());
+
+            output.period_stages.push_back
+                    (isl_ast_build_node_from_schedule(build, stage_schedule));
+        }
     }
 
     isl_ast_build_free(build);
@@ -321,7 +357,7 @@ isl_ast_node * ast_gen::after_for(isl_ast_node *node, isl_ast_build * builder)
         if (verbose<ast_gen>::enabled())
             cout << "   Not parallelizable." << endl;
     }
-    else if (m_options.parallel_dim < 0)
+    else if (m_parallel_dim < 0)
     {
         if (m_num_parallelizable_loops != 1)
         {
@@ -358,12 +394,39 @@ isl_ast_node * ast_gen::after_for(isl_ast_node *node, isl_ast_build * builder)
 
         info->is_vector = true;
     }
+    else if (m_options.vectorize && is_deepest_loop && !info->is_parallelizable &&
+             current_loop_computes_only_recurrence(builder))
+    {
+        if (verbose<ast_gen>::enabled())
+            cout << "-- Loop computes linear recurrence in blocks." << endl;
+
+        info->is_recurrence = true;
+    }
 
     if (info->is_parallel || info->is_vector)
     {
         store_parallel_accesses_for_current_dimension(builder);
     }
 
+    // Replace loop by a kernel if it computes entire contractions,
+    // reductions or scans, unless parallelized.
+
+    if (!info->is_parallel)
+    {
+        info->contraction = kernel_computed_by_current_loop
+                (builder, m_model.contractions, &info->kernel_batch);
+        if (info->contraction < 0)
+        {
+            info->reduction = kernel_computed_by_current_loop
+                    (builder, m_model.reductions, &info->kernel_batch);
+        }
+        if (info->contraction < 0 && info->reduction < 0)
+        {
+            info->scan = kernel_computed_by_current_loop
+                    (builder, m_model.scans, &info->kernel_batch);
+        }
+    }
+
     if (info->is_parallelizable)
         --m_num_parallelizable_loops;
 
@@ -437,6 +500,152 @@ bool ast_gen::current_schedule_dimension_is_parallel(isl_ast_build * builder)
     return is_parallel;
 }
 
+// Projection of statement instances onto batch dimensions of reduction.
+
+static isl_union_map * reduction_batches(const reduction & c)
+{
+    isl_union_map * batches = nullptr;
+
+    for (auto & stmt : { c.init, c.update })
+    {
+        isl_space * space = isl_set_get_space(stmt->domain.get());
+        isl_map * m = isl_map_identity(isl_space_map_from_set(space));
+
+        for (int d = stmt->domain.dimensions() - 1; d >= 0; --d)
+        {
+            if (std::find(c.batch_dims.begin(), c.batch_dims.end(), d) == c.batch_dims.end())
+                m = isl_map_project_out(m, isl_dim_out, d, 1);
+        }
+
+        m = isl_map_set_tuple_name(m, isl_dim_out, "batch");
+        m = isl_map_intersect_domain(m, stmt->domain.copy());
+
+        if (batches)
+            batches = isl_union_map_union(batches, isl_union_map_from_map(m));
+        else
+            batches = isl_union_map_from_map(m);
+    }
+
+    return batches;
+}
+
+// Returns whether the only statement in the current loop
+// updates a linear recurrence.
+
+bool ast_gen::current_loop_computes_only_recurrence(isl_ast_build * builder)
+{
+    if (m_model.recurrences.empty())
+        return false;
+
+    isl::union_map schedule = isl_ast_build_get_schedule(builder);
+
+    unordered_set<string> stmt_names;
+    schedule.domain().for_each([&](const isl::set & s){
+        stmt_names.insert(s.name());
+        return true;
+    });
+
+    if (stmt_names.size() != 1)
+        return false;
+
+    for (auto & r : m_model.recurrences)
+    {
+        if (stmt_names.count(r.update->name))
+            return true;
+    }
+
+    return false;
+}
+
+// Returns the index of the contraction, reduction or scan
+// whose statement instances are the only ones in the current loop,
+// if they form entire batches determined by the enclosing loops.
+// Otherwise returns -1.
+// Stores the batch as a function of loop iterators in 'batch'.
+
+template <typename T>
+int ast_gen::kernel_computed_by_current_loop
+(isl_ast_build * builder, const vector<T> & kernels, isl_ast_expr ** batch)
+{
+    if (kernels.empty())
+        return -1;
+
+    isl::union_map schedule = isl_ast_build_get_schedule(builder);
+
+    unordered_set<string> stmt_names;
+    schedule.domain().for_each([&](const isl::set & s){
+        stmt_names.insert(s.name());
+        return true;
+    });
+
+    int index = -1;
+    for (int i = 0; i < (int) kernels.size(); ++i)
+    {
+        auto & c = kernels[i];
+        if (!stmt_names.count(c.update->name))
+            continue;
+        stmt_names.erase(c.init->name);
+        stmt_names.erase(c.update->name);
+        if (stmt_names.empty())
+            index = i;
+        break;
+    }
+
+    if (index < 0)
+        return -1;
+
+    auto & c = kernels[index];
+
+    isl_union_map * batches = reduction_batches(c);
+
+    // Statement instances for each iteration of enclosing loops.
+
+    isl_space * sched_space = isl_ast_build_get_schedule_space(builder);
+    int depth = isl_space_dim(sched_space, isl_dim_set);
+    isl_map * outer = isl_map_identity(isl_space_map_from_set(sched_space));
+    outer = isl_map_project_out(outer, isl_dim_out, depth - 1, 1);
+
+    isl_union_map * instances =
+            isl_union_map_reverse(isl_union_map_apply_range
+                                  (schedule.copy(), isl_union_map_from_map(isl_map_copy(outer))));
+
+    isl_union_map * outer_batches =
+            isl_union_map_apply_range(isl_union_map_copy(instances),
+                                      isl_union_map_copy(batches));
+
+    bool is_kernel = isl_union_map_is_single_valued(outer_batches) == isl_bool_true;
+
+    if (is_kernel)
+    {
+        isl_union_map * batch_instances =
+                isl_union_map_apply_range(isl_union_map_copy(outer_batches),
+                                          isl_union_map_reverse(isl_union_map_copy(batches)));
+        is_kernel = isl_union_map_is_subset(batch_instances, instances) == isl_bool_true;
+        isl_union_map_free(batch_instances);
+    }
+
+    if (is_kernel)
+    {
+        // Batch as a function of enclosing loop iterators only.
+        isl_union_map * time_batches =
+                isl_union_map_apply_range(isl_union_map_from_map(isl_map_copy(outer)),
+                                          isl_union_map_copy(outer_batches));
+        isl_map * m = isl_map_from_union_map(time_batches);
+        isl_pw_multi_aff * f = isl_pw_multi_aff_from_map(m);
+        *batch = isl_ast_build_call_from_pw_multi_aff(builder, f);
+
+        if (verbose<ast_gen>::enabled())
+            cout << "-- Loop computes " << c.accumulator->name << " by a kernel" << endl;
+    }
+
+    isl_union_map_free(outer_batches);
+    isl_union_map_free(instances);
+    isl_union_map_free(batches);
+    isl_map_free(outer);
+
+    return is_kernel ? index : -1;
+}
+
 void ast_gen::store_parallel_accesses_for_current_dimension(isl_ast_build * builder)
 {
     // Parallel = { [a[i] -> a[j]] -> [[t_i] -> [t_j]] : t_i < t_j }
@@ -39,6 +39,7 @@ public:
         bool separate_loops = false;
         bool parallel = false;
         int parallel_dim = -1;
+        int prelude_parallel_dim = -1;
         bool vectorize = false;
     };
 
@@ -67,6 +68,10 @@ private:
     isl_id * before_for(isl_ast_build *);
     isl_ast_node * after_for(isl_ast_node *node, isl_ast_build *);
     bool current_schedule_dimension_is_parallel(isl_ast_build *);
+    template <typename T>
+    int kernel_computed_by_current_loop(isl_ast_build *, const vector<T> & kernels,
+                                        isl_ast_expr ** batch);
+    bool current_loop_computes_only_recurrence(isl_ast_build *);
     void store_parallel_accesses_for_current_dimension(isl_ast_build *);
 
     model & m_model;
@@ -77,6 +82,7 @@ private:
     isl::union_map m_order;
 
     bool m_allow_parallel_for = false;
+    int m_parallel_dim = -1;
     int m_parallel_loop_id = 0;
 
     int m_deepest_loop = 0;
@@ -1,350 +1,392 @@
+/*
+Compiler for language for stream processing
+
+Copyright (C) 2016  Jakob Leben <jakob.leben@gmail.com>
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
 #include "modulo_avoidance.hpp"
 
+#include <isl-cpp/space.hpp>
+#include <isl-cpp/set.hpp>
+#include <isl-cpp/map.hpp>
+
+#include <isl/schedule.h>
+#include <isl/aff.h>
+
 #include <iostream>
-#include <unordered_set>
 #include <cmath>
+#include <numeric>
 
 using namespace std;
 
 namespace stream {
 namespace polyhedral {
 
-struct access_info
-{
-    isl::set domain { nullptr };
-    isl::map relation { nullptr };
-    int min_a0 = 0;
-    int max_a0 = 0;
-    int max_offset = 0;
-    bool needs_modulo = false;
-};
-
-access_info is_candidate_array(array_ptr array, stmt_ptr stmt, const schedule & sched,
-                               const model_summary & model,
-                               isl::printer & printer)
+// More parts generate more code than modulo costs.
+static const int max_part_count = 8;
+
+static int floor_div(int a, int b)
 {
-    access_info access;
+    int q = a / b;
+    if (a % b != 0 && (a < 0) != (b < 0))
+        --q;
+    return q;
+}
 
-    if (!array->is_infinite)
-        return access;
+modulo_avoidance::modulo_avoidance( model & m, schedule & s, bool power_of_two ):
+    m_model(m),
+    m_schedule(s),
+    m_power_of_two(power_of_two),
+    m_printer(m.context)
+{}
 
-    int buf_size = array->buffer_size[0];
+void modulo_avoidance::process()
+{
+    if (verbose<modulo_avoidance>::enabled())
+        cout << "### MODULO AVOIDANCE ### " << endl;
 
-    if (buf_size < 2)
-        return access;
+    auto ctx = m_model.context;
 
-    auto stmt_sched = sched.period.in_domain(stmt->domain);
-    auto stmt_sched_domain = stmt_sched.domain().set_for(stmt->domain.get_space());
+    // Maps instances of new statements to instances of original statements.
+    isl_union_pw_multi_aff * renaming =
+            isl_union_pw_multi_aff_empty(isl_space_params_alloc(ctx.get(), 0));
 
-    auto access_space = isl::space::from(stmt->domain.get_space(), array->domain.get_space());
+    auto add_renaming = [&](const isl::set & domain, const stmt_ptr & target)
+    {
+        auto target_space = isl_space_align_params
+                (target->domain.get_space().copy(), domain.get_space().copy());
+        auto space = isl_space_map_from_domain_and_range
+                (domain.get_space().copy(), target_space);
+        auto identity = isl_pw_multi_aff_from_multi_aff(isl_multi_aff_identity(space));
+        identity = isl_pw_multi_aff_intersect_domain(identity, domain.copy());
+        renaming = isl_union_pw_multi_aff_add_pw_multi_aff(renaming, identity);
+    };
 
-    auto write = model.write_relations.map_for(access_space);
-    auto read = model.read_relations.map_for(access_space);
-    access.relation = write | read;
-    access.domain = access.relation(stmt_sched_domain) & array->domain;
+    auto period_domains = m_schedule.period.domain();
 
-    if (verbose<modulo_avoidance>::enabled())
+    vector<stmt_ptr> new_stmts;
+
+    for (auto & stmt : m_model.statements)
     {
-        cout << "..Accessed array:";
-        printer.print(access.domain);
-        cout << endl;
+        auto domain = period_domains.set_for(stmt->domain.get_space());
+        if (domain.is_empty())
+            continue;
+
+        if (verbose<modulo_avoidance>::enabled())
+            cout << "Statement " << stmt->name << endl;
+
+        vector<part> parts;
+
+        if (!split(stmt, parts))
+        {
+            add_renaming(domain, stmt);
+            continue;
+        }
+
+        if (parts.size() == 1)
+        {
+            // All accesses are within a single wrap for all phases.
+
+            if (verbose<modulo_avoidance>::enabled())
+                cout << "..Not split." << endl;
+
+            stmt->array_access_offset = parts[0].offsets;
+            add_renaming(domain, stmt);
+            continue;
+        }
+
+        if (verbose<modulo_avoidance>::enabled())
+            cout << "..Split into " << parts.size() << " parts." << endl;
+
+        for (int i = 0; i < (int) parts.size(); ++i)
+        {
+            auto new_stmt = make_part(stmt, parts[i], i);
+            new_stmts.push_back(new_stmt);
+            add_renaming(new_stmt->domain, stmt);
+        }
     }
 
+    for (auto & entry : m_phases)
     {
-        auto a0 = access.domain.get_space()(isl::space::variable, 0);
-        access.min_a0 = access.domain.minimum(a0).integer() - array->period_offset;
-        access.max_a0 = access.domain.maximum(a0).integer() - array->period_offset;
+        auto & array = entry.second;
+        m_schedule.params &= phase_range(array, wrap_size(array));
+        m_model.phase_ids[entry.first] = array;
     }
 
+    m_schedule.period_tree = isl_schedule_pullback_union_pw_multi_aff
+            (m_schedule.period_tree.copy(), isl_union_pw_multi_aff_copy(renaming));
 
-    int period_increment = array->period % buf_size;
-    if (period_increment == 0)
-        access.max_offset = 0;
-    else if (buf_size % period_increment == 0)
-        access.max_offset = ((buf_size / period_increment) - 1) * period_increment;
-    else
-        // FIXME: Not always true
-        access.max_offset = buf_size - 1;
+    isl::union_map renaming_map = isl_union_map_from_union_pw_multi_aff(renaming);
+    m_schedule.period = isl_union_map_apply_range
+            (renaming_map.copy(), m_schedule.period.copy());
 
-    if (verbose<modulo_avoidance>::enabled())
-    {
-        cout << "..Accessed range: [" << access.min_a0 << "," << access.max_a0 << "]"
-             << " + [0," << access.max_offset << "]" << endl;
-    }
+    m_model.statements.insert(m_model.statements.end(),
+                              new_stmts.begin(), new_stmts.end());
 
-    if ( access.max_offset + access.max_a0 >= buf_size )
+    if (verbose<modulo_avoidance>::enabled())
     {
-        // Needs modulo.
-        access.needs_modulo = true;
-
-        // FIXME: shouldn't modify buffer size after
-        // array->period_offset is chosen
-#if 0
-        // Extend buffer to next power of two.
-        int buf_size_power_of_two = std::pow(2, std::ceil(std::log2(buf_size)));
-        array->buffer_size[0] = buf_size_power_of_two;
-#endif
+        cout << "New period schedule:" << endl;
+        m_printer.print_each_in(m_schedule.period);
+        cout << "Parameters:" << endl;
+        m_printer.print(m_schedule.params);
+        cout << endl;
     }
-
-    return access;
 }
 
-void avoid_modulo(schedule & sched, model & m, bool split_statements)
+// Splits period instances of statement into parts,
+// so that in each part, all accesses to the same buffer are in the same wrap.
+// Returns false if no splitting is possible.
+
+bool modulo_avoidance::split(const stmt_ptr & stmt, vector<part> & parts)
 {
-    if (verbose<modulo_avoidance>::enabled())
-        cout << "### MODULO AVOIDANCE ### " << endl;
+    // Parts of I/O statements would be reordered relative to each other.
+    if (stmt->is_input_or_output || stmt->self_relations.is_valid())
+        return false;
 
-    model_summary ms(m);
-    isl::printer printer(m.context);
+    auto domain = m_schedule.period.domain().set_for(stmt->domain.get_space());
 
-    auto sched_stmt_domains = sched.period.domain();
-    for (auto & array : m.arrays)
+    vector<array_ptr> arrays;
+    unordered_map<array*, vector<array_access*>> accesses;
+
+    for (auto & access : stmt->array_accesses)
     {
-        if (!array->is_infinite)
-            continue;
+        auto & array_accesses = accesses[access->array.get()];
+        if (array_accesses.empty())
+            arrays.push_back(access->array);
+        array_accesses.push_back(access.get());
+    }
 
-        auto written = ms.write_relations
-                .in_range(array->domain)(sched_stmt_domains);
-        auto read = ms.read_relations
-                .in_range(array->domain)(sched_stmt_domains);
+    parts.push_back(part { domain, {} });
 
-        auto accessed = (written | read).set_for(array->domain.get_space()) & array->domain;
+    bool is_split = false;
 
-        auto a0 = accessed.get_space().var(0);
-        int min_a0 = accessed.minimum(a0).integer();
-        int buf_size = array->buffer_size[0];
-        array->period_offset = (min_a0 / buf_size) * buf_size;
-    }
+    for (auto & array : arrays)
+    {
+        int size = wrap_size(array);
+        if (size < 2)
+            continue;
 
-    isl::union_map new_sched(m.context);
+        auto & array_accesses = accesses[array.get()];
 
-    vector<stmt_ptr> new_stmts;
+        // Only exact affine accesses are known to remain within a wrap.
 
-    for (auto & stmt : m.statements)
-    {
-        unordered_set<array_ptr> checked_arrays;
-        unordered_map<array_ptr, access_info> candidate_arrays;
+        bool is_affine = true;
+        for (auto access : array_accesses)
+        {
+            if (access->indexes.empty() ||
+                    isl_map_is_single_valued(access->map.get()) != isl_bool_true)
+                is_affine = false;
+        }
 
-        auto stmt_sched = sched.period.in_domain(stmt->domain);
-        if (!stmt->is_infinite)
+        if (!is_affine)
         {
-            new_sched = new_sched | stmt_sched;
+            if (verbose<modulo_avoidance>::enabled())
+                cout << "..Non-affine access to " << array->name << endl;
             continue;
         }
 
-        if (verbose<modulo_avoidance>::enabled())
-            cout << "Statement " << stmt->name << endl;
+        bool has_phase = array->period % size != 0;
 
-#if 0
-        auto stmt_sched_domain = stmt_sched.domain();
-        auto write_rel = ms.write_relations.in_domain(stmt->domain).in_range(array->domain);
-        auto array_sched_domain =
-                write_rel(stmt_sched_domain)
-                .set_for(array->domain.get_space());
-        cout << "..Accessed array:" << endl;
-        printer.print(array_sched_domain);
-        cout << endl;
+        int min_index = 0;
+        int max_index = 0;
 
-        int min_a0, max_a0;
+        for (int a = 0; a < (int) array_accesses.size(); ++a)
         {
-            auto a0 = array_sched_domain.get_space()(isl::space::variable, 0);
-            min_a0 = array_sched_domain.minimum(a0).integer() - array->period_offset;
-            max_a0 = array_sched_domain.maximum(a0).integer() - array->period_offset;
-            cout << "..Accessed range: [" << min_a0 << "," << max_a0 << "]" << endl;
+            auto accessed = array_accesses[a]->map.in_domain(domain).range();
+            auto i0 = accessed.get_space().var(0);
+            int min = accessed.minimum(i0).integer();
+            int max = accessed.maximum(i0).integer();
+            min_index = a == 0 ? min : std::min(min_index, min);
+            max_index = a == 0 ? max : std::max(max_index, max);
         }
 
-        auto is_candidate_array = [&](array_ptr array) -> bool
+        if (has_phase)
+            max_index += size - 1;
+
+        int min_wrap = floor_div(min_index, size);
+        int max_wrap = floor_div(max_index, size);
+
+        if (verbose<modulo_avoidance>::enabled())
         {
-            if (!array->is_infinite)
-                return false;
+            cout << "..Accessed " << array->name
+                 << " range: [" << min_index << "," << max_index << "]"
+                 << " wraps: [" << min_wrap << "," << max_wrap << "]" << endl;
+        }
+
+        isl::set range(nullptr);
+        if (has_phase)
+            range = phase_range(array, size);
 
-            int buf_size = array->buffer_size[0];
+        vector<part> new_parts;
 
-            if (buf_size < 2)
-                return false;
+        for (auto & p : parts)
+        {
+            auto part_domain = p.domain;
+            if (has_phase)
+                part_domain &= range;
 
-            if (max_a0 == min_a0)
-                return false;
+            isl::set covered(nullptr);
 
-            // FIXME: Not always true
-            if (array->period % buf_size != 0)
-                return true;
+            for (int k = min_wrap; k <= max_wrap; ++k)
+            {
+                auto band = wrap_band(array, size, k);
 
-            int max_array_offset =
-                    ((buf_size - 1) / array->period) * array->period;
+                auto band_domain = part_domain;
+                for (auto access : array_accesses)
+                    band_domain &= access->map.in_range(band).domain();
 
-            if ( max_array_offset + max_a0 < buf_size )
-                return false;
+                if (band_domain.is_empty())
+                    continue;
 
-            return true;
-        };
-#endif
+                part new_part { band_domain, p.offsets };
+                new_part.offsets[array.get()] = -k * size;
+                new_parts.push_back(new_part);
 
-        // Check write relation
-        {
-            auto array = stmt->write_relation.array;
-            if (array)
-            {
-                auto info = is_candidate_array(array, stmt, sched, ms, printer);
-                if (info.needs_modulo)
-                    candidate_arrays.emplace(array, info);
-                checked_arrays.insert(array);
+                if (covered.is_valid())
+                    covered = isl_set_union(covered.copy(), band_domain.copy());
+                else
+                    covered = band_domain;
             }
-        }
-
-        // Check read relations
-        for (auto relation : stmt->read_relations)
-        {
-            auto array = relation.array;
-            if (checked_arrays.find(array) != checked_arrays.end())
-                continue;
-            auto info = is_candidate_array(array, stmt, sched, ms, printer);
-            if (info.needs_modulo)
-                candidate_arrays.emplace(array, info);
-            checked_arrays.insert(array);
-        }
 
-        bool keep_going = true;
+            isl::set rest = part_domain;
+            if (covered.is_valid())
+                rest = isl_set_subtract(part_domain.copy(), covered.copy());
 
-        if (candidate_arrays.size() == 0)
-        {
-            if (verbose<modulo_avoidance>::enabled())
-                cout << "..Does not need modulo." << endl;
-            keep_going = false;
+            if (!rest.is_empty())
+                new_parts.push_back(part { rest, p.offsets });
         }
-        else
-            stmt->streaming_needs_modulo = true;
 
-        if (keep_going && candidate_arrays.size() > 1)
+        if (new_parts.size() > max_part_count)
         {
             if (verbose<modulo_avoidance>::enabled())
-                cout << "..Needs modulo for more than 1 array access." << endl;
-            keep_going = false;
-        }
-
-        if (keep_going)
-        {
-            auto sched_domain = stmt_sched.domain().set_for(stmt->domain.get_space());
-            if (sched_domain.is_singleton())
-            {
-                if (verbose<modulo_avoidance>::enabled())
-                    cout << "..Needs modulo, but domain is singleton." << endl;
-                keep_going = false;
-            }
+                cout << "..Too many parts for " << array->name << endl;
+            continue;
         }
 
-        // FIXME: Skip if a single iteration has multiple accesses
-        // that would have to be split.
+        parts = new_parts;
+        is_split = true;
 
-        if (!keep_going || !split_statements)
+        if (has_phase)
         {
-            new_sched = new_sched | stmt_sched;
-            continue;
+            m_phases[array->name + "_ph"] = array;
         }
+    }
 
-        stmt->streaming_needs_modulo = false;
-
-        auto array = candidate_arrays.begin()->first;
-        auto access = candidate_arrays.begin()->second;
+    return is_split;
+}
 
-        string offset_name = array->name + "_offset";
-        m.phase_ids.emplace(offset_name, array);
+stmt_ptr modulo_avoidance::make_part(const stmt_ptr & stmt, const part & p, int index)
+{
+    auto new_stmt = make_shared<statement>(*stmt);
+    new_stmt->name = stmt->name + "_p" + to_string(index);
+    new_stmt->domain = isl_set_set_tuple_name(p.domain.copy(), new_stmt->name.c_str());
+    new_stmt->array_access_offset = p.offsets;
 
-        int buf_size = array->buffer_size[0];
-        assert(buf_size >= 2);
+    new_stmt->array_accesses.clear();
+    for (auto & access : stmt->array_accesses)
+    {
+        auto new_access = make_shared<array_access>(*access);
+        new_access->map = isl_map_set_tuple_name
+                (access->map.copy(), isl_dim_in, new_stmt->name.c_str());
+        new_stmt->array_accesses.push_back(new_access);
+    }
 
-        int min_a0 = access.min_a0;
-        int max_a0 = access.max_a0 + access.max_offset;
-        int num_parts = (int) std::ceil((max_a0 - min_a0 + 1) / (float) buf_size);
+    if (verbose<modulo_avoidance>::enabled())
+    {
+        cout << "..Part " << new_stmt->name << ": ";
+        m_printer.print(new_stmt->domain);
+        cout << endl;
+        for (auto & offset : new_stmt->array_access_offset)
+            cout << "....Offset " << offset.first->name << " by " << offset.second << endl;
+    }
 
-        if (verbose<modulo_avoidance>::enabled())
-        {
-            cout << "..# Parts = " << num_parts << endl;
-            assert(num_parts >= 2);
-        }
+    return new_stmt;
+}
 
-        auto array_sched_domain = access.domain;
+// Size of buffer along first dimension, if it wraps.
+// Must match buffer size in C++ generator.
 
-        auto offset_space = array_sched_domain.get_space();
-        offset_space.insert_dimensions(isl::space::parameter, 0, 1);
-        offset_space.set_name(isl::space::parameter, 0, offset_name);
-        auto offset_set = isl::set::universe(offset_space);
-        auto offset = offset_space(isl::space::parameter, 0);
-        offset_set.add_constraint(offset >= 0);
-        offset_set.add_constraint(offset < buf_size);
+int modulo_avoidance::wrap_size(const array_ptr & array)
+{
+    if (!array->is_infinite || array->buffer_size.empty())
+        return 0;
 
-        sched.params = sched.params | offset_set.parameters();
+    int size = array->buffer_size[0];
+    if (size < 2)
+        return 0;
 
-        array_sched_domain = array_sched_domain & offset_set;
+    if (m_power_of_two)
+        size = (int) std::pow(2, std::ceil(std::log2(size)));
 
-        int lower_bound = (min_a0 / buf_size) * buf_size;
+    return size;
+}
 
-        for (int i = 0; i < num_parts; ++i, lower_bound += buf_size)
-        {
-            auto array_part = array_sched_domain;
-            auto a0 = array_part.get_space()(isl::space::variable, 0);
-            array_part.add_constraint(a0 + offset >= lower_bound);
-            array_part.add_constraint(a0 + offset < lower_bound + buf_size);
+// Values of phase: multiples of gcd(period, size) less than size.
 
-            if (verbose<modulo_avoidance>::enabled())
-            {
-                cout << "..Array Part " << i << ":" << endl;
-                printer.print(array_part);
-                cout << endl;
-            }
+isl::set modulo_avoidance::phase_range(const array_ptr & array, int size)
+{
+    int step = std::gcd(array->period, size);
 
-            auto stmt_part = access.relation.inverse()(array_part);
+    isl::space space(m_model.context, isl::set_tuple(1));
+    space.add_dimensions(isl::space::parameter, 1);
+    space.set_name(isl::space::parameter, 0, array->name + "_ph");
 
-            if (verbose<modulo_avoidance>::enabled())
-            {
-                cout << "..Stmt Part " << i << ":" << endl;
-                printer.print(stmt_part);
-                cout << endl;
-            }
+    auto phase = space.param(0);
+    auto t = space.var(0);
 
-            auto new_stmt = make_shared<statement>(*stmt);
-            new_stmt->domain = stmt_part;
-            new_stmt->name = stmt->name + "_p" + std::to_string(i);
-            new_stmt->array_access_offset.emplace(array.get(), -lower_bound);
+    auto range = isl::set::universe(space);
+    range.add_constraint(phase == t * step);
+    range.add_constraint(phase >= 0);
+    range.add_constraint(phase < size);
 
-            new_stmts.push_back(new_stmt);
+    return isl_set_params(range.copy());
+}
 
-            auto sched_part = stmt_sched.in_domain(stmt_part);
+// Elements of array in k-th wrap of buffer: k * size <= i + phase < (k+1) * size
 
-            sched_part.for_each([&](isl::map & map){
-                map.set_name(isl::space::input, new_stmt->name);
-                new_sched = new_sched | map;
-                return true;
-            });
-        }
-    }
+isl::set modulo_avoidance::wrap_band(const array_ptr & array, int size, int k)
+{
+    bool has_phase = array->period % size != 0;
 
-#if 1
-    sched.period = new_sched;
+    auto space = array->domain.get_space();
 
-    if (verbose<modulo_avoidance>::enabled())
+    int phase_dim = space.dimension(isl::space::parameter);
+    if (has_phase)
     {
-        cout << "New period schedule:" << endl;
-        new_sched.for_each([&](const isl::map & m){
-            printer.print(m);
-            cout << endl;
-            return true;
-        });
+        space.add_dimensions(isl::space::parameter, 1);
+        space.set_name(isl::space::parameter, phase_dim, array->name + "_ph");
     }
 
-    if (sched.params.is_empty())
-        sched.params = isl::set::universe(sched.params.get_space());
+    auto band = isl::set::universe(space);
 
-    if (verbose<modulo_avoidance>::enabled())
+    auto i = space.var(0);
+    if (has_phase)
     {
-        cout << "Parameters:" << endl;
-        printer.print(sched.params);
-        cout << endl;
+        auto phase = space.param(phase_dim);
+        band.add_constraint(i + phase >= k * size);
+        band.add_constraint(i + phase < (k + 1) * size);
+    }
+    else
+    {
+        band.add_constraint(i >= k * size);
+        band.add_constraint(i < (k + 1) * size);
     }
 
-    m.statements.insert(m.statements.end(),
-                        new_stmts.begin(), new_stmts.end());
-#endif
+    return band;
 }
 
 }
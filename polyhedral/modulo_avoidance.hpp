@@ -1,14 +1,78 @@
+/*
+Compiler for language for stream processing
+
+Copyright (C) 2016  Jakob Leben <jakob.leben@gmail.com>
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
 #ifndef STREAM_LANG_POLYHEDRAL_MODULO_AVOIDANCE_INCLUDED
 #define STREAM_LANG_POLYHEDRAL_MODULO_AVOIDANCE_INCLUDED
 
 #include "../common/ph_model.hpp"
+#include "../utility/debug.hpp"
+
+#include <isl-cpp/printer.hpp>
+
+#include <unordered_map>
+#include <vector>
 
 namespace stream {
 namespace polyhedral {
 
-struct modulo_avoidance;
+/*
+Splits period instances of statements at points where
+accesses to stream buffers wrap around.
+
+The phase of a buffer is represented by a parameter,
+and each part of a statement accesses a buffer at
+(index + phase - k * buffer size) without wrapping.
+Instances where accesses to the same buffer fall into different
+wraps remain in a part which uses modulo.
+
+Must run after storage allocation, and the period AST must be
+generated again afterwards.
+*/
+
+class modulo_avoidance
+{
+public:
+    modulo_avoidance( model &, schedule &, bool buffer_size_power_of_two );
+
+    void process();
+
+private:
+    struct part
+    {
+        isl::set domain;
+        std::unordered_map<array*, int> offsets;
+    };
+
+    int wrap_size(const array_ptr &);
+    isl::set phase_range(const array_ptr &, int size);
+    isl::set wrap_band(const array_ptr &, int size, int k);
+    bool split(const stmt_ptr &, std::vector<part> & parts);
+    stmt_ptr make_part(const stmt_ptr &, const part &, int index);
 
-void avoid_modulo(schedule &, model &, bool split_statements);
+    model & m_model;
+    schedule & m_schedule;
+    bool m_power_of_two;
+    isl::printer m_printer;
+    // Phase parameters used by parts.
+    std::unordered_map<string, array_ptr> m_phases;
+};
 
 }
 }
@@ -0,0 +1,361 @@
+/*
+Compiler for language for stream processing
+
+Copyright (C) 2016  Jakob Leben <jakob.leben@gmail.com>
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "pipelining.hpp"
+#include "../common/error.hpp"
+
+#include <isl-cpp/space.hpp>
+#include <isl-cpp/set.hpp>
+#include <isl-cpp/map.hpp>
+
+#include <algorithm>
+#include <functional>
+#include <iostream>
+#include <unordered_map>
+
+using namespace std;
+
+namespace stream {
+namespace polyhedral {
+
+pipeline_partitioner::pipeline_partitioner( model & m ):
+    m_model(m),
+    m_model_summary(m)
+{}
+
+int pipeline_partitioner::partition(const schedule & sched, int max_stage_count)
+{
+    auto & statements = m_model.statements;
+
+    for (auto & stmt : statements)
+        stmt->pipeline_stage = 0;
+
+    for (auto & array : m_model.arrays)
+        array->pipeline_stage = 0;
+
+    m_model.pipeline_stage_count = 1;
+
+    if (max_stage_count < 2)
+        return 1;
+
+    // Group statements into strongly connected components,
+    // and order components topologically.
+
+    auto stmt_graph = statement_graph();
+
+    int component_count = 0;
+    auto component = components(stmt_graph, component_count);
+
+    graph component_graph(component_count);
+    for (int s = 0; s < (int) stmt_graph.size(); ++s)
+    {
+        for (int t : stmt_graph[s])
+        {
+            if (component[s] != component[t])
+                component_graph[component[s]].push_back(component[t]);
+        }
+    }
+
+    auto order = topological_order(component_graph);
+
+    // Split the topological order into contiguous ranges of similar weight.
+
+    auto weights = statement_weights(sched);
+
+    vector<int64_t> component_weight(component_count, 0);
+    int64_t total_weight = 0;
+    for (int s = 0; s < (int) statements.size(); ++s)
+    {
+        if (component[s] < 0)
+            continue;
+        component_weight[component[s]] += weights[s];
+        total_weight += weights[s];
+    }
+
+    vector<int> component_stage(component_count, 0);
+
+    if (total_weight > 0)
+    {
+        int64_t accumulated_weight = 0;
+        for (int c : order)
+        {
+            int64_t center = accumulated_weight + component_weight[c] / 2;
+            int stage = int(center * max_stage_count / total_weight);
+            component_stage[c] = std::min(stage, max_stage_count - 1);
+            accumulated_weight += component_weight[c];
+        }
+    }
+
+    for (int s = 0; s < (int) statements.size(); ++s)
+    {
+        if (component[s] >= 0)
+            statements[s]->pipeline_stage = component_stage[component[s]];
+    }
+
+    // Keep all inputs and all outputs in a single thread each.
+
+    int last_stage = 0;
+    for (auto & stmt : statements)
+        last_stage = std::max(last_stage, stmt->pipeline_stage);
+
+    for (auto & channel : m_model.inputs)
+    {
+        if (channel.statement->is_infinite)
+            channel.statement->pipeline_stage = 0;
+    }
+
+    for (auto & channel : m_model.outputs)
+    {
+        if (channel.statement->is_infinite)
+            channel.statement->pipeline_stage = last_stage;
+    }
+
+    // Remove empty stages
+
+    vector<int> stage_map(last_stage + 1, -1);
+    for (auto & stmt : statements)
+    {
+        if (stmt->is_infinite)
+            stage_map[stmt->pipeline_stage] = 0;
+    }
+
+    int stage_count = 0;
+    for (auto & stage : stage_map)
+    {
+        if (stage >= 0)
+            stage = stage_count++;
+    }
+
+    for (auto & stmt : statements)
+    {
+        if (stmt->is_infinite)
+            stmt->pipeline_stage = stage_map[stmt->pipeline_stage];
+    }
+
+    m_model.pipeline_stage_count = std::max(1, stage_count);
+
+    // Arrays are accessed relative to the first stage writing them.
+
+    for (auto & array : m_model.arrays)
+    {
+        if (!array->is_infinite)
+            continue;
+
+        int first_writer_stage = m_model.pipeline_stage_count;
+
+        for (auto & stmt : statements)
+        {
+            if (!stmt->is_infinite)
+                continue;
+
+            for (auto & access : stmt->array_accesses)
+            {
+                if (access->array == array && access->writing)
+                    first_writer_stage = std::min(first_writer_stage, stmt->pipeline_stage);
+            }
+        }
+
+        if (first_writer_stage < m_model.pipeline_stage_count)
+            array->pipeline_stage = first_writer_stage;
+    }
+
+    if (verbose<pipeline_partitioner>::enabled())
+    {
+        cout << "Pipeline stages: " << m_model.pipeline_stage_count << endl;
+        for (int s = 0; s < (int) statements.size(); ++s)
+        {
+            if (!statements[s]->is_infinite)
+                continue;
+            cout << "  " << statements[s]->name
+                 << ": stage " << statements[s]->pipeline_stage
+                 << ", weight " << weights[s]
+                 << endl;
+        }
+    }
+
+    return m_model.pipeline_stage_count;
+}
+
+pipeline_partitioner::graph pipeline_partitioner::statement_graph()
+{
+    auto & statements = m_model.statements;
+
+    unordered_map<string, int> index;
+    for (int s = 0; s < (int) statements.size(); ++s)
+    {
+        if (statements[s]->is_infinite)
+            index.emplace(statements[s]->name, s);
+    }
+
+    graph g(statements.size());
+
+    auto relations = m_model_summary.dependencies | m_model_summary.order_relations;
+
+    relations.for_each([&](const isl::map & m)
+    {
+        auto space = m.get_space();
+        auto source = index.find(space.id(isl::space::input).name());
+        auto sink = index.find(space.id(isl::space::output).name());
+        if (source == index.end() || sink == index.end())
+            return true;
+        if (source->second != sink->second)
+            g[source->second].push_back(sink->second);
+        return true;
+    });
+
+    return g;
+}
+
+// Tarjan's algorithm.
+// Nodes of finite statements are not assigned a component (-1).
+
+vector<int> pipeline_partitioner::components(const graph & g, int & count)
+{
+    int n = g.size();
+
+    vector<int> component(n, -1);
+    vector<int> order(n, -1);
+    vector<int> low(n, 0);
+    vector<bool> on_stack(n, false);
+    vector<int> stack;
+    int next_order = 0;
+
+    count = 0;
+
+    std::function<void(int)> visit = [&](int v)
+    {
+        order[v] = low[v] = next_order++;
+        stack.push_back(v);
+        on_stack[v] = true;
+
+        for (int w : g[v])
+        {
+            if (order[w] < 0)
+            {
+                visit(w);
+                low[v] = std::min(low[v], low[w]);
+            }
+            else if (on_stack[w])
+            {
+                low[v] = std::min(low[v], order[w]);
+            }
+        }
+
+        if (low[v] == order[v])
+        {
+            int w;
+            do
+            {
+                w = stack.back();
+                stack.pop_back();
+                on_stack[w] = false;
+                component[w] = count;
+            }
+            while(w != v);
+            ++count;
+        }
+    };
+
+    for (int v = 0; v < n; ++v)
+    {
+        if (m_model.statements[v]->is_infinite && order[v] < 0)
+            visit(v);
+    }
+
+    return component;
+}
+
+// Kahn's algorithm, preferring nodes with lower index.
+
+vector<int> pipeline_partitioner::topological_order(const graph & g)
+{
+    int n = g.size();
+
+    vector<int> in_degree(n, 0);
+    for (auto & edges : g)
+        for (int w : edges)
+            ++in_degree[w];
+
+    vector<int> ready;
+    for (int v = 0; v < n; ++v)
+        if (in_degree[v] == 0)
+            ready.push_back(v);
+
+    vector<int> order;
+
+    while(!ready.empty())
+    {
+        auto min_pos = std::min_element(ready.begin(), ready.end());
+        int v = *min_pos;
+        ready.erase(min_pos);
+
+        order.push_back(v);
+
+        for (int w : g[v])
+        {
+            if (--in_degree[w] == 0)
+                ready.push_back(w);
+        }
+    }
+
+    assert_or_throw(order.size() == n);
+
+    return order;
+}
+
+// Estimate work per period of each statement
+// using the bounding box of its instances in the period.
+
+vector<int64_t> pipeline_partitioner::statement_weights(const schedule & sched)
+{
+    auto & statements = m_model.statements;
+
+    vector<int64_t> weights(statements.size(), 0);
+
+    auto period_domains = sched.period.domain();
+
+    for (int s = 0; s < (int) statements.size(); ++s)
+    {
+        auto & stmt = statements[s];
+        if (!stmt->is_infinite)
+            continue;
+
+        auto space = stmt->domain.get_space();
+        auto domain = period_domains.set_for(space);
+        if (domain.is_empty())
+            continue;
+
+        int64_t volume = 1;
+        for (int d = 0; d < stmt->domain.dimensions(); ++d)
+        {
+            auto min = domain.minimum(space.var(d));
+            auto max = domain.maximum(space.var(d));
+            if (min.is_integer() && max.is_integer())
+                volume *= max.integer() - min.integer() + 1;
+        }
+
+        weights[s] = volume;
+    }
+
+    return weights;
+}
+
+}
+}
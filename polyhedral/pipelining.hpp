@@ -0,0 +1,65 @@
+/*
+Compiler for language for stream processing
+
+Copyright (C) 2016  Jakob Leben <jakob.leben@gmail.com>
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef STREAM_LANG_POLYHEDRAL_PIPELINING_INCLUDED
+#define STREAM_LANG_POLYHEDRAL_PIPELINING_INCLUDED
+
+#include "../common/ph_model.hpp"
+#include "../utility/debug.hpp"
+
+#include <vector>
+
+namespace stream {
+namespace polyhedral {
+
+/*
+Assigns infinite statements to pipeline stages.
+
+Stage s executes period (n - s) during the n-th execution of the period,
+so stages can execute concurrently.
+Statements which depend on each other in a cycle are kept in the same stage,
+and a statement is never in an earlier stage than any statement it depends on.
+Inputs are in the first and outputs in the last stage.
+*/
+
+class pipeline_partitioner
+{
+public:
+    pipeline_partitioner( model & );
+
+    // Returns the number of stages actually used.
+    int partition(const schedule &, int max_stage_count);
+
+private:
+    typedef std::vector<std::vector<int>> graph;
+
+    graph statement_graph();
+    std::vector<int> components(const graph &, int & count);
+    std::vector<int> topological_order(const graph &);
+    std::vector<int64_t> statement_weights(const schedule &);
+
+    model & m_model;
+    model_summary m_model_summary;
+};
+
+}
+}
+
+#endif // STREAM_LANG_POLYHEDRAL_PIPELINING_INCLUDED
@@ -0,0 +1,707 @@
+/*
+Compiler for language for stream processing
+
+Copyright (C) 2016  Jakob Leben <jakob.leben@gmail.com>
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "reduction.hpp"
+#include "../common/error.hpp"
+
+#include <isl-cpp/space.hpp>
+#include <isl-cpp/set.hpp>
+#include <isl-cpp/map.hpp>
+
+#include <isl/set.h>
+#include <isl/map.h>
+
+#include <iostream>
+
+using namespace std;
+
+namespace stream {
+namespace polyhedral {
+
+// Collects dimensions of statement domain used by expression.
+// Returns false if expression accesses the given array
+// or calls an external function.
+
+static bool collect_dims(const functional::expr_ptr & expr,
+                         const array * excluded,
+                         std::set<int> & dims)
+{
+    if (auto iter = dynamic_cast<iterator_read*>(expr.get()))
+    {
+        dims.insert(iter->index);
+        return true;
+    }
+    else if (auto access = dynamic_cast<array_access*>(expr.get()))
+    {
+        if (access->array.get() == excluded)
+            return false;
+        for (auto & index : access->indexes)
+        {
+            if (!collect_dims(index, excluded, dims))
+                return false;
+        }
+        return true;
+    }
+    else if (auto prim = dynamic_cast<functional::primitive*>(expr.get()))
+    {
+        for (auto & operand : prim->operands)
+        {
+            if (!collect_dims(operand, excluded, dims))
+                return false;
+        }
+        return true;
+    }
+    else if (dynamic_cast<external_call*>(expr.get()))
+    {
+        return false;
+    }
+
+    return true;
+}
+
+static primitive_type type_of(const functional::expr_ptr & expr)
+{
+    auto scalar = dynamic_pointer_cast<functional::scalar_type>(expr->type);
+    return scalar ? scalar->primitive : primitive_type::undefined;
+}
+
+// Value of a constant number, possibly converted or negated.
+
+static bool constant_value(const functional::expr_ptr & expr, double & value)
+{
+    if (auto c = dynamic_cast<functional::real_const*>(expr.get()))
+    {
+        value = c->value;
+        return true;
+    }
+    else if (auto c = dynamic_cast<functional::int_const*>(expr.get()))
+    {
+        value = c->value().get_d();
+        return true;
+    }
+    else if (auto prim = dynamic_cast<functional::primitive*>(expr.get()))
+    {
+        switch(prim->kind)
+        {
+        case primitive_op::to_real32:
+        case primitive_op::to_real64:
+            return constant_value(prim->operands[0], value);
+        case primitive_op::negate:
+            if (!constant_value(prim->operands[0], value))
+                return false;
+            value = -value;
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    return false;
+}
+
+reduction_finder::reduction_finder( model & m ):
+    m_model(m)
+{}
+
+void reduction_finder::find_contractions()
+{
+    m_model.contractions.clear();
+
+    for (auto & stmt : m_model.statements)
+    {
+        contraction c;
+        if (!match_contraction(stmt, c))
+            continue;
+
+        if (verbose<reduction_finder>::enabled())
+        {
+            cout << "Contraction " << c.accumulator->name << ":"
+                 << " init = " << c.init->name
+                 << ", update = " << c.update->name
+                 << ", reduction dim = " << c.reduction_dim
+                 << " [" << c.reduction_begin << "," << c.reduction_end << "]"
+                 << ", row dim = " << c.row_dim
+                 << " [" << c.row_begin << "," << c.row_end << "]"
+                 << ", column dim = " << c.col_dim
+                 << " [" << c.col_begin << "," << c.col_end << "]"
+                 << endl;
+        }
+
+        m_model.contractions.push_back(c);
+    }
+}
+
+void reduction_finder::find_reductions()
+{
+    m_model.reductions.clear();
+
+    for (auto & stmt : m_model.statements)
+    {
+        bool is_contraction = false;
+        for (auto & c : m_model.contractions)
+            is_contraction |= c.update == stmt;
+        if (is_contraction)
+            continue;
+
+        // Found without rows and columns.
+        contraction c;
+        if (!match_reduction(stmt, c))
+            continue;
+        if (!only_last_element_read(c))
+            continue;
+
+        if (verbose<reduction_finder>::enabled())
+        {
+            cout << "Reduction " << c.accumulator->name << ":"
+                 << " init = " << c.init->name
+                 << ", update = " << c.update->name
+                 << ", reduction dim = " << c.reduction_dim
+                 << " [" << c.reduction_begin << "," << c.reduction_end << "]"
+                 << endl;
+        }
+
+        m_model.reductions.push_back(c);
+    }
+}
+
+void reduction_finder::find_scans()
+{
+    m_model.scans.clear();
+
+    for (auto & stmt : m_model.statements)
+    {
+        bool is_reduction = false;
+        for (auto & c : m_model.contractions)
+            is_reduction |= c.update == stmt;
+        for (auto & r : m_model.reductions)
+            is_reduction |= r.update == stmt;
+        if (is_reduction)
+            continue;
+
+        contraction c;
+        if (!match_reduction(stmt, c))
+            continue;
+
+        if (verbose<reduction_finder>::enabled())
+        {
+            cout << "Scan " << c.accumulator->name << ":"
+                 << " init = " << c.init->name
+                 << ", update = " << c.update->name
+                 << ", scan dim = " << c.reduction_dim
+                 << " [" << c.reduction_begin << "," << c.reduction_end << "]"
+                 << endl;
+        }
+
+        m_model.scans.push_back(c);
+    }
+}
+
+void reduction_finder::find_linear_recurrences()
+{
+    m_model.recurrences.clear();
+
+    auto is_kernel_update = [&](const stmt_ptr & stmt)
+    {
+        for (auto & c : m_model.contractions)
+            if (c.update == stmt) return true;
+        for (auto & r : m_model.reductions)
+            if (r.update == stmt) return true;
+        for (auto & r : m_model.scans)
+            if (r.update == stmt) return true;
+        return false;
+    };
+
+    for (auto & stmt : m_model.statements)
+    {
+        if (is_kernel_update(stmt))
+            continue;
+
+        linear_recurrence r;
+        if (!match_linear_recurrence(stmt, r))
+            continue;
+
+        if (verbose<reduction_finder>::enabled())
+        {
+            cout << "Linear recurrence " << r.array->name << ":"
+                 << " update = " << r.update->name
+                 << ", dim = " << r.dim
+                 << ", coefficient = " << r.coefficient
+                 << endl;
+        }
+
+        m_model.recurrences.push_back(r);
+    }
+}
+
+// Matches statement of form:
+// s[..., k] = a * s[..., k-1] + u
+// or equivalent, where a is a constant and u does not read s.
+
+bool reduction_finder::match_linear_recurrence
+(const stmt_ptr & update, linear_recurrence & r)
+{
+    if (update->is_input_or_output)
+        return false;
+
+    auto assign = dynamic_cast<assignment*>(update->expr.get());
+    if (!assign)
+        return false;
+
+    auto dest = dynamic_pointer_cast<array_access>(assign->destination);
+    if (!dest)
+        return false;
+
+    auto array = dest->array;
+
+    int dim_count = update->domain.dimensions();
+
+    if (!is_real(array->type))
+        return false;
+    if (array->domain.dimensions() != dim_count)
+        return false;
+    if ((int) dest->indexes.size() != dim_count)
+        return false;
+    if (type_of(assign->value) != array->type)
+        return false;
+
+    auto sum = dynamic_cast<functional::primitive*>(assign->value.get());
+    if (!sum || sum->kind != primitive_op::add)
+        return false;
+
+    // Find a * s[..., k-1] among operands of sum.
+
+    auto is_self = [&](const functional::expr_ptr & e)
+    {
+        auto access = dynamic_cast<array_access*>(e.get());
+        return access && access->array == array;
+    };
+
+    auto match_scaled = [&](const functional::expr_ptr & e) -> bool
+    {
+        if (is_self(e))
+        {
+            r.previous = e;
+            r.coefficient = 1;
+            return true;
+        }
+
+        auto product = dynamic_cast<functional::primitive*>(e.get());
+        if (!product || product->kind != primitive_op::multiply)
+            return false;
+
+        for (int i = 0; i < 2; ++i)
+        {
+            if (is_self(product->operands[i]) &&
+                    constant_value(product->operands[1-i], r.coefficient))
+            {
+                r.previous = product->operands[i];
+                return true;
+            }
+        }
+
+        return false;
+    };
+
+    if (match_scaled(sum->operands[0]))
+        r.input = sum->operands[1];
+    else if (match_scaled(sum->operands[1]))
+        r.input = sum->operands[0];
+    else
+        return false;
+
+    std::set<int> dims;
+    if (!collect_dims(r.input, array.get(), dims))
+        return false;
+
+    auto previous = dynamic_cast<array_access*>(r.previous.get());
+
+    r.dim = recurrence_dim(update, *dest, *previous);
+    if (r.dim < 0)
+        return false;
+
+    r.array = array;
+    r.update = update;
+
+    return true;
+}
+
+// Returns dimension k if statement reads s[x - e_k] and writes s[x],
+// else -1.
+
+int reduction_finder::recurrence_dim
+(const stmt_ptr & update, const array_access & write, const array_access & read)
+{
+    int dim_count = update->domain.dimensions();
+    int dim = -1;
+
+    isl_map * read_map = isl_map_intersect_domain(read.map.copy(), update->domain.copy());
+    isl_map * write_map = isl_map_reverse(write.map.copy());
+    isl_set * deltas = isl_map_deltas(isl_map_apply_range(write_map, read_map));
+
+    for (int d = 0; d < dim_count && dim < 0; ++d)
+    {
+        isl_set * unit = isl_set_universe(isl_set_get_space(deltas));
+        for (int i = 0; i < dim_count; ++i)
+            unit = isl_set_fix_si(unit, isl_dim_set, i, i == d ? -1 : 0);
+        if (isl_set_is_equal(deltas, unit) == isl_bool_true)
+            dim = d;
+        isl_set_free(unit);
+    }
+
+    isl_set_free(deltas);
+
+    return dim;
+}
+
+// Matches statement of form:
+// s[..., k] = s[..., k-1] + x * y
+
+bool reduction_finder::match_contraction(const stmt_ptr & update, contraction & c)
+{
+    functional::expr_ptr value;
+    if (!match_update(update, c, value))
+        return false;
+
+    if (c.op != primitive_op::add)
+        return false;
+
+    auto product = dynamic_cast<functional::primitive*>(value.get());
+    if (!product || product->kind != primitive_op::multiply)
+        return false;
+
+    // Factors must not depend on the accumulated array.
+
+    std::set<int> left_dims, right_dims;
+    if (!collect_dims(product->operands[0], c.accumulator.get(), left_dims))
+        return false;
+    if (!collect_dims(product->operands[1], c.accumulator.get(), right_dims))
+        return false;
+
+    // Dimensions indexing only one of the factors are blocked by kernels.
+
+    int dim_count = update->domain.dimensions();
+
+    for (int d = dim_count - 1; d >= 0; --d)
+    {
+        if (d == c.reduction_dim)
+            continue;
+        if (update->is_infinite && d == 0)
+            continue;
+
+        bool left = left_dims.count(d);
+        bool right = right_dims.count(d);
+        if (left && !right && c.row_dim < 0)
+            c.row_dim = d;
+        else if (right && !left && c.col_dim < 0)
+            c.col_dim = d;
+    }
+
+    for (int d = 0; d < dim_count; ++d)
+    {
+        if (d != c.reduction_dim && d != c.row_dim && d != c.col_dim)
+            c.batch_dims.push_back(d);
+    }
+
+    if (!has_box_domain(c))
+        return false;
+
+    if (!only_last_element_read(c))
+        return false;
+
+    return true;
+}
+
+// Matches statement of form:
+// s[..., k] = s[..., k-1] op x
+// where op is associative and commutative.
+
+bool reduction_finder::match_reduction(const stmt_ptr & update, contraction & c)
+{
+    functional::expr_ptr value;
+    if (!match_update(update, c, value))
+        return false;
+
+    switch(c.op)
+    {
+    case primitive_op::add:
+    case primitive_op::multiply:
+    case primitive_op::min:
+    case primitive_op::max:
+        break;
+    case primitive_op::bitwise_and:
+    case primitive_op::bitwise_or:
+    case primitive_op::bitwise_xor:
+        if (!is_integer(c.accumulator->type))
+            return false;
+        break;
+    default:
+        return false;
+    }
+
+    std::set<int> dims;
+    if (!collect_dims(value, c.accumulator.get(), dims))
+        return false;
+
+    int dim_count = update->domain.dimensions();
+
+    for (int d = 0; d < dim_count; ++d)
+    {
+        if (d != c.reduction_dim)
+            c.batch_dims.push_back(d);
+    }
+
+    if (!has_box_domain(c))
+        return false;
+
+    return true;
+}
+
+// Matches statement of form:
+// s[..., k] = s[..., k-1] op x
+// and finds the statement initializing s.
+// Stores x into 'value'.
+
+bool reduction_finder::match_update
+(const stmt_ptr & update, reduction & r, functional::expr_ptr & value)
+{
+    if (update->is_input_or_output)
+        return false;
+
+    auto assign = dynamic_cast<assignment*>(update->expr.get());
+    if (!assign)
+        return false;
+
+    auto dest = dynamic_pointer_cast<array_access>(assign->destination);
+    if (!dest)
+        return false;
+
+    auto array = dest->array;
+    int dim_count = update->domain.dimensions();
+
+    if (!is_integer(array->type) && !is_real(array->type))
+        return false;
+    if (array->domain.dimensions() != dim_count)
+        return false;
+    if ((int) dest->indexes.size() != dim_count)
+        return false;
+
+    auto combination = dynamic_cast<functional::primitive*>(assign->value.get());
+    if (!combination || combination->operands.size() != 2)
+        return false;
+
+    // Accumulate without conversions.
+
+    if (type_of(assign->value) != array->type)
+        return false;
+
+    auto self = dynamic_pointer_cast<array_access>(combination->operands[0]);
+    value = combination->operands[1];
+    if (!self || self->array != array)
+    {
+        self = dynamic_pointer_cast<array_access>(combination->operands[1]);
+        value = combination->operands[0];
+    }
+
+    if (!self || self->array != array)
+        return false;
+
+    // Find reduction dimension: s[x] reads s[x - e_k].
+
+    r.reduction_dim = recurrence_dim(update, *dest, *self);
+
+    if (r.reduction_dim < 0)
+        return false;
+
+    // The stream dimension can not be reduced by a kernel.
+
+    if (update->is_infinite && r.reduction_dim == 0)
+        return false;
+
+    r.accumulator = array;
+    r.update = update;
+    r.op = combination->kind;
+    r.init = find_init(r);
+    if (!r.init)
+        return false;
+
+    return true;
+}
+
+// Returns the only other statement writing the accumulator,
+// if it does not read the accumulator.
+
+stmt_ptr reduction_finder::find_init(const reduction & c)
+{
+    stmt_ptr init;
+
+    for (auto & stmt : m_model.statements)
+    {
+        if (stmt == c.update)
+            continue;
+
+        bool writes = false;
+        bool reads = false;
+        for (auto & access : stmt->array_accesses)
+        {
+            if (access->array != c.accumulator)
+                continue;
+            writes |= access->writing;
+            reads |= access->reading;
+        }
+
+        if (!writes)
+            continue;
+        if (reads || init)
+            return nullptr;
+
+        init = stmt;
+    }
+
+    if (!init || init->is_input_or_output)
+        return nullptr;
+
+    auto assign = dynamic_cast<assignment*>(init->expr.get());
+    if (!assign)
+        return nullptr;
+
+    auto dest = dynamic_pointer_cast<array_access>(assign->destination);
+    if (!dest || (int) dest->indexes.size() != c.update->domain.dimensions())
+        return nullptr;
+
+    if (init->domain.dimensions() != c.update->domain.dimensions())
+        return nullptr;
+
+    return init;
+}
+
+// Checks that for each value of batch dimensions,
+// the update domain is the same box, and the init domain
+// is the same box, preceding it in reduction dimension.
+
+bool reduction_finder::has_box_domain(contraction & c)
+{
+    auto & update_domain = c.update->domain;
+    auto space = update_domain.get_space();
+
+    if (update_domain.is_empty())
+        return false;
+
+    auto bounds = [&](int dim, int & begin, int & end) -> bool
+    {
+        auto min = update_domain.minimum(space.var(dim));
+        auto max = update_domain.maximum(space.var(dim));
+        if (!min.is_integer() || !max.is_integer())
+            return false;
+        begin = (int) min.integer();
+        end = (int) max.integer();
+        return true;
+    };
+
+    if (!bounds(c.reduction_dim, c.reduction_begin, c.reduction_end))
+        return false;
+    if (c.row_dim >= 0 && !bounds(c.row_dim, c.row_begin, c.row_end))
+        return false;
+    if (c.col_dim >= 0 && !bounds(c.col_dim, c.col_begin, c.col_end))
+        return false;
+
+    // The init statement writes the element before the first update.
+    --c.reduction_begin;
+
+    // Batches of the given domain, times a box in other dimensions.
+
+    auto box = [&](isl_set * domain, int reduction_begin, int reduction_end) -> isl_set *
+    {
+        for (int d = 0; d < (int) isl_set_dim(domain, isl_dim_set); ++d)
+        {
+            if (d == c.reduction_dim || d == c.row_dim || d == c.col_dim)
+                domain = isl_set_eliminate(domain, isl_dim_set, d, 1);
+        }
+
+        domain = isl_set_lower_bound_si(domain, isl_dim_set, c.reduction_dim, reduction_begin);
+        domain = isl_set_upper_bound_si(domain, isl_dim_set, c.reduction_dim, reduction_end);
+
+        if (c.row_dim >= 0)
+        {
+            domain = isl_set_lower_bound_si(domain, isl_dim_set, c.row_dim, c.row_begin);
+            domain = isl_set_upper_bound_si(domain, isl_dim_set, c.row_dim, c.row_end);
+        }
+        if (c.col_dim >= 0)
+        {
+            domain = isl_set_lower_bound_si(domain, isl_dim_set, c.col_dim, c.col_begin);
+            domain = isl_set_upper_bound_si(domain, isl_dim_set, c.col_dim, c.col_end);
+        }
+
+        return domain;
+    };
+
+    isl_set * update_set = isl_set_reset_tuple_id(update_domain.copy());
+    isl_set * init_set = isl_set_reset_tuple_id(c.init->domain.copy());
+
+    isl_set * update_box = box(isl_set_copy(update_set),
+                               c.reduction_begin + 1, c.reduction_end);
+    isl_set * init_box = box(isl_set_copy(update_set),
+                             c.reduction_begin, c.reduction_begin);
+
+    bool ok =
+            isl_set_is_equal(update_box, update_set) == isl_bool_true &&
+            isl_set_is_equal(init_box, init_set) == isl_bool_true;
+
+    isl_set_free(update_box);
+    isl_set_free(init_box);
+    isl_set_free(update_set);
+    isl_set_free(init_set);
+
+    return ok;
+}
+
+// Checks that other statements only read the last element
+// along the reduction dimension.
+
+bool reduction_finder::only_last_element_read(const reduction & c)
+{
+    isl_set * last = isl_set_fix_si(c.accumulator->domain.copy(), isl_dim_set,
+                                    c.reduction_dim, c.reduction_end);
+
+    bool ok = true;
+
+    for (auto & stmt : m_model.statements)
+    {
+        if (stmt == c.update)
+            continue;
+
+        for (auto & access : stmt->array_accesses)
+        {
+            if (access->array != c.accumulator || !access->reading)
+                continue;
+
+            isl_map * read = isl_map_intersect_domain(access->map.copy(), stmt->domain.copy());
+            isl_set * elements = isl_map_range(read);
+            ok &= isl_set_is_subset(elements, last) == isl_bool_true;
+            isl_set_free(elements);
+        }
+    }
+
+    isl_set_free(last);
+
+    return ok;
+}
+
+}
+}
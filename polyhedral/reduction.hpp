@@ -0,0 +1,79 @@
+/*
+Compiler for language for stream processing
+
+Copyright (C) 2016  Jakob Leben <jakob.leben@gmail.com>
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef STREAM_LANG_POLYHEDRAL_REDUCTION_INCLUDED
+#define STREAM_LANG_POLYHEDRAL_REDUCTION_INCLUDED
+
+#include "../common/ph_model.hpp"
+#include "../utility/debug.hpp"
+
+#include <set>
+
+namespace stream {
+namespace polyhedral {
+
+/*
+Finds arrays that accumulate values along one dimension
+using an associative operation (see class reduction),
+including accumulation of products, such as matrix products
+and dot products (see class contraction).
+Arrays of which all elements are read are scans.
+
+Also finds first-order linear recurrences with constant coefficients
+(see class linear_recurrence), along any dimension, including streams.
+
+The accumulated dimension and the dimensions indexing each factor
+must have constant bounds. The C++ backend computes such an array
+using kernels, wherever a loop computes all elements
+for given values of batch dimensions (see ast_gen).
+*/
+
+class reduction_finder
+{
+public:
+    reduction_finder( model & );
+
+    void find_contractions();
+    // Only arrays that are not contractions.
+    void find_reductions();
+    // Only arrays that are not contractions or reductions.
+    void find_scans();
+    // Only statements not updating other kernels.
+    void find_linear_recurrences();
+
+private:
+    bool match_contraction(const stmt_ptr & update, contraction &);
+    bool match_reduction(const stmt_ptr & update, contraction &);
+    bool match_update(const stmt_ptr & update, reduction &,
+                      functional::expr_ptr & value);
+    bool match_linear_recurrence(const stmt_ptr & update, linear_recurrence &);
+    int recurrence_dim(const stmt_ptr & update, const array_access & write,
+                       const array_access & read);
+    stmt_ptr find_init(const reduction &);
+    bool has_box_domain(contraction &);
+    bool only_last_element_read(const reduction &);
+
+    model & m_model;
+};
+
+}
+}
+
+#endif // STREAM_LANG_POLYHEDRAL_REDUCTION_INCLUDED
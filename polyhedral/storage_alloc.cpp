@@ -25,8 +25,12 @@ along with this program; if not, write to the Free Software Foundation, Inc.,
 #include <isl-cpp/map.hpp>
 #include <isl-cpp/utility.hpp>
 
+#include <isl/set.h>
+
 #include <stdexcept>
 #include <sstream>
+#include <algorithm>
+#include <unordered_set>
 
 using namespace std;
 
@@ -54,12 +58,194 @@ void storage_allocator::allocate(const polyhedral::schedule & schedule)
             cout << endl << "== Array " << array->name << endl;
         }
 
+        // Constant arrays are stored entirely and never written.
+        if (!array->constant_values.empty())
+        {
+            array->buffer_size = array->size;
+            array->inter_period_dependency = true;
+            continue;
+        }
+
         compute_buffer_size(schedule, array);
 
         find_inter_period_dependency(schedule, array);
+
+        if (m_model.pipeline_stage_count > 1)
+            add_pipeline_slack(array);
     }
 }
 
+void storage_allocator::share_storage(const polyhedral::schedule & schedule)
+{
+    if (verbose<storage_allocator>::enabled())
+    {
+        cout << endl << "== Storage sharing" << endl;
+    }
+
+    // Arrays accessed by I/O statements may be accessed by the host.
+
+    unordered_set<array*> io_arrays;
+    for (auto & stmt : m_model.statements)
+    {
+        if (!stmt->is_input_or_output)
+            continue;
+        for (auto & access : stmt->array_accesses)
+            io_arrays.insert(access->array.get());
+    }
+
+    auto buffer_volume = [](const array_ptr & array) -> int64_t
+    {
+        int64_t v = 1;
+        for (auto s : array->buffer_size)
+            v *= s;
+        return v;
+    };
+
+    vector<array_ptr> candidates;
+
+    for (auto & array : m_model.arrays)
+    {
+        // Data of other arrays would overwrite data kept between periods.
+        if (array->inter_period_dependency)
+            continue;
+        if (io_arrays.count(array.get()))
+            continue;
+        if (buffer_volume(array) < 2)
+            continue;
+        candidates.push_back(array);
+    }
+
+    auto writes = m_model_summary.write_relations.in_domain(m_model_summary.domains);
+    auto reads = m_model_summary.read_relations.in_domain(m_model_summary.domains);
+    auto accesses = writes | reads;
+
+    for (auto & array : candidates)
+    {
+        auto & prelude = m_prelude_lifetimes[array.get()];
+        prelude.writes = access_times(schedule.prelude, writes, array);
+        prelude.accesses = access_times(schedule.prelude, accesses, array);
+
+        auto & period = m_period_lifetimes[array.get()];
+        period.writes = access_times(schedule.period, writes, array);
+        period.accesses = access_times(schedule.period, accesses, array);
+    }
+
+    // Larger arrays first, so smaller ones reuse their storage.
+
+    std::stable_sort(candidates.begin(), candidates.end(),
+                     [&](const array_ptr & a, const array_ptr & b)
+    { return buffer_volume(a) > buffer_volume(b); });
+
+    // Same element type avoids aliasing between different types.
+
+    vector<vector<array_ptr>> groups;
+
+    for (auto & array : candidates)
+    {
+        bool is_placed = false;
+
+        for (auto & group : groups)
+        {
+            if (group.front()->type != array->type)
+                continue;
+
+            bool has_conflict = std::any_of(group.begin(), group.end(),
+                                            [&](const array_ptr & other)
+            { return lifetimes_overlap(array, other); });
+
+            if (has_conflict)
+                continue;
+
+            group.push_back(array);
+            is_placed = true;
+            break;
+        }
+
+        if (!is_placed)
+            groups.push_back({ array });
+    }
+
+    int group_index = 0;
+
+    for (auto & group : groups)
+    {
+        if (group.size() < 2)
+            continue;
+
+        if (verbose<storage_allocator>::enabled())
+        {
+            cout << ".. Storage group " << group_index << ":";
+            for (auto & array : group)
+                cout << " " << array->name;
+            cout << endl;
+        }
+
+        for (auto & array : group)
+            array->storage_group = group_index;
+
+        ++group_index;
+    }
+
+    m_prelude_lifetimes.clear();
+    m_period_lifetimes.clear();
+}
+
+// Schedule times of accesses to array, or null if none.
+
+isl::set storage_allocator::access_times
+( const isl::union_map & sched,
+  const isl::union_map & relations,
+  const array_ptr & array )
+{
+    isl::space sched_space(nullptr);
+    sched.for_each([&](const isl::map & m){
+        sched_space = m.get_space().range();
+        return false;
+    });
+
+    if (!sched_space.is_valid())
+        return isl::set(nullptr);
+
+    auto array_sched_space = isl::space::from(array->domain.get_space(), sched_space);
+
+    auto access_sched = sched;
+    access_sched.map_domain_through(relations);
+
+    auto times = access_sched.map_for(array_sched_space).in_domain(array->domain).range();
+    if (times.is_empty())
+        return isl::set(nullptr);
+
+    return times;
+}
+
+/*
+Arrays a and b are live at the same time if
+some write of a is not after some access of b,
+and some write of b is not after some access of a.
+This is checked separately in the prelude and in a period,
+since neither array carries data between them.
+*/
+
+bool storage_allocator::lifetimes_overlap
+( const array_ptr & a, const array_ptr & b )
+{
+    auto precedes = [](const isl::set & writes, const isl::set & accesses)
+    {
+        if (!writes.is_valid() || !accesses.is_valid())
+            return false;
+        isl::map order = isl_set_lex_le_set(writes.copy(), accesses.copy());
+        return !order.is_empty();
+    };
+
+    auto overlap = [&](const lifetime & x, const lifetime & y)
+    {
+        return precedes(x.writes, y.accesses) && precedes(y.writes, x.accesses);
+    };
+
+    return overlap(m_prelude_lifetimes[a.get()], m_prelude_lifetimes[b.get()]) ||
+            overlap(m_period_lifetimes[a.get()], m_period_lifetimes[b.get()]);
+}
+
 void storage_allocator::compute_buffer_size
 ( const polyhedral::schedule & schedule,
   const array_ptr & array )
@@ -388,6 +574,48 @@ void storage_allocator::compute_buffer_size_from_conflicts
     }
 }
 
+/*
+With pipelining, a statement in stage s accesses the array
+while executing period (n - s), concurrently with other stages.
+Elements written by an earlier stage remain live while later stages
+catch up, so the buffer is extended by the period size
+times the distance between the earliest writer and the latest reader.
+*/
+void storage_allocator::add_pipeline_slack( const array_ptr & array )
+{
+    if (!array->is_infinite)
+        return;
+
+    int last_reader_stage = -1;
+
+    for (auto & stmt : m_model.statements)
+    {
+        if (!stmt->is_infinite)
+            continue;
+
+        for (auto & access : stmt->array_accesses)
+        {
+            if (access->array == array && access->reading)
+                last_reader_stage = std::max(last_reader_stage, stmt->pipeline_stage);
+        }
+    }
+
+    int lag = last_reader_stage - array->pipeline_stage;
+    if (lag <= 0)
+        return;
+
+    array->buffer_size[0] += lag * array->period;
+
+    // Stages access the buffer in different periods.
+    array->inter_period_dependency = true;
+
+    if (verbose<storage_allocator>::enabled())
+    {
+        cout << ".. Pipeline slack: " << lag << " periods"
+             << ", buffer size = " << array->buffer_size[0] << endl;
+    }
+}
+
 void storage_allocator::find_inter_period_dependency
 ( const polyhedral::schedule & schedule,
   const array_ptr & array )
@@ -26,6 +26,8 @@ along with this program; if not, write to the Free Software Foundation, Inc.,
 
 #include <isl-cpp/printer.hpp>
 
+#include <unordered_map>
+
 namespace stream {
 namespace polyhedral {
 
@@ -36,6 +38,12 @@ public:
 
     void allocate(const schedule &);
 
+    // Groups arrays of same type whose lifetimes within
+    // the prelude and within a period are disjoint,
+    // so they can share memory.
+    // Must run after allocate().
+    void share_storage(const schedule &);
+
 private:
 
     void compute_buffer_size
@@ -54,6 +62,26 @@ private:
     ( const schedule &,
       const array_ptr & );
 
+    void add_pipeline_slack( const array_ptr & );
+
+    isl::set access_times
+    ( const isl::union_map & sched,
+      const isl::union_map & relations,
+      const array_ptr & );
+
+    bool lifetimes_overlap
+    ( const array_ptr & a, const array_ptr & b );
+
+    struct lifetime
+    {
+        isl::set writes { nullptr };
+        isl::set accesses { nullptr };
+    };
+
+    // Per array, in prelude and in period.
+    unordered_map<array*, lifetime> m_prelude_lifetimes;
+    unordered_map<array*, lifetime> m_period_lifetimes;
+
     model & m_model;
     model_summary m_model_summary;
     isl::printer m_printer;
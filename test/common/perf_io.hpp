@@ -52,6 +52,23 @@ public:
         }
     }
 
+    // Block I/O
+    template <typename T>
+    ALWAYS_INLINE
+    void output(const T * values, int count)
+    {
+        using namespace std;
+
+        if (m_print)
+        {
+            for (int i = 0; i < count; ++i)
+            {
+                ostringstream text;
+                print(text, values[i]);
+            }
+        }
+    }
+
 private:
     template <typename T, size_t S>
     void print(ostringstream & text, T (&a)[S])
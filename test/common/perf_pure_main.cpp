@@ -116,10 +116,7 @@ int main(int argc, char * argv[])
 
     p->prelude();
 
-    for (int i = 0; i < period_count; ++i)
-    {
-        p->period();
-    }
+    p->process(period_count);
 #else
     perf_test t(period_count);
     t.initialize();
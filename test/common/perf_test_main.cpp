@@ -36,10 +36,7 @@ public:
 
     void run()
     {
-        for (int i = 0; i < m_period_count; ++i)
-        {
-            p->period();
-        }
+        p->process(m_period_count);
     }
 
 private:
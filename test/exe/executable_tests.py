@@ -17,9 +17,9 @@ def error(msg):
 def info(msg):
   sys.stderr.write(msg + '\n');
 
-def compile_arrp(source, output_name):
+def compile_arrp(source, output_name, options=[]):
   info("Compiling Arrp...")
-  subprocess.run([arrp_exe, '--interface', 'stdio', '--output', output_name],
+  subprocess.run([arrp_exe, '--interface', 'stdio', '--output', output_name] + options,
                  input=source, universal_newlines=True, check=True)
   info("Compiling C++...")
   subprocess.run(
@@ -173,6 +173,23 @@ def test_binary_stream_buffered_noinput():
   expected_output = to_byte_array(expected_output, '=i')
   return compare(result.stdout, expected_output)
 
+def test_binary_stream_buffered_block():
+  # Period of 4 elements is larger than buffer
+  source = 'input x : [~]int; output y = [t] -> x[(t//4)*4 + 3 - t%4];'
+
+  compile_arrp(source, 'arrp-test', ['--io-block'])
+
+  input = list(range(0,16))
+  raw_input = to_byte_array(input, '=i')
+  info("Input: " + str(input))
+
+  result = subprocess.run(['./arrp-test', '-b=2', '-f=raw'], input=raw_input, stdout=subprocess.PIPE, check=True)
+  output = from_byte_array(result.stdout,'=i')
+  info("Got output: " + str(output))
+
+  expected_output = [3,2,1,0, 7,6,5,4, 11,10,9,8]
+  return compare(output[:len(expected_output)], expected_output)
+
 def test_explicit_format():
   source = 'input x : [~]int; output y = x * 100;'
 
@@ -320,6 +337,7 @@ tests = {
     'binary-unbuffered-stream-noinput': test_binary_stream_unbuffered_noinput,
     'binary-buffered-stream': test_binary_stream_buffered,
     'binary-buffered-stream-noinput': test_binary_stream_buffered_noinput,
+    'binary-buffered-block-stream': test_binary_stream_buffered_block,
     'explicit-format': test_explicit_format,
     'file-text': test_file_text,
     'file-binary': test_file_binary,
@@ -559,6 +559,40 @@ void block_statement::generate_nested(state & state, ostream & stream)
     generate(state, stream);
 }
 
+void pool_for_statement::generate(cpp_gen::state & state, ostream & stream)
+{
+    generate_subexpr(op::member_of_reference, pool, left_sub_expr, state, stream);
+    stream << ".parallel_for(";
+    begin->generate(state, stream);
+    stream << ", ";
+    end->generate(state, stream);
+    stream << ", [&](int " << iterator << ")";
+    body->generate_nested(state, stream);
+    stream << ");";
+}
+
+void try_statement::generate(cpp_gen::state & state, ostream & stream)
+{
+    stream << "try";
+    body->generate_nested(state, stream);
+
+    state.new_line(stream);
+    stream << "catch (...)";
+    state.new_line(stream);
+    stream << "{";
+    state.increase_indentation();
+    for (auto stmt : handler->statements)
+    {
+        state.new_line(stream);
+        stmt->generate(state, stream);
+    }
+    state.new_line(stream);
+    stream << "throw;";
+    state.decrease_indentation();
+    state.new_line(stream);
+    stream << "}";
+}
+
 void expr_statement::generate(cpp_gen::state & state, ostream & stream)
 {
     expr->generate(state, stream);
@@ -733,6 +733,30 @@ public:
     void generate(state &, ostream &);
 };
 
+// Loop with iterations distributed over a thread pool:
+// <pool>.parallel_for(<begin>, <end>, [&](int <iterator>) <body>);
+class pool_for_statement : public complex_statement
+{
+public:
+    expression_ptr pool;
+    string iterator;
+    expression_ptr begin;
+    expression_ptr end;
+    std::shared_ptr<block_statement> body;
+    void generate(state &, ostream &);
+};
+
+// Statement with a handler for any exception,
+// which rethrows the exception after the handler:
+// try <body> catch (...) { <handler> throw; }
+class try_statement : public complex_statement
+{
+public:
+    std::shared_ptr<block_statement> body;
+    std::shared_ptr<block_statement> handler;
+    void generate(state &, ostream &);
+};
+
 class comment_statement : public statement
 {
 public: